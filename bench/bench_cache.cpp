@@ -0,0 +1,74 @@
+#include <benchmark/benchmark.h>
+
+#include "api.h"
+#include "api/api_channel.h"
+#include "api/api_guild.h"
+#include "channel.h"
+#include "fixtures.h"
+#include "guild.h"
+
+namespace
+{
+  const size_t CachedGuilds = 1000;
+  const size_t CachedChannels = 20;
+
+  //  Fill the guild and channel caches once, so lookups never fall through to the API.
+  void fill_caches()
+  {
+    static bool filled = false;
+
+    if (filled)
+    {
+      return;
+    }
+
+    Fixtures::disable_logging();
+
+    for (size_t i = 0; i < CachedGuilds; ++i)
+    {
+      Discord::API::Guild::update_cache(std::make_shared<Discord::Guild>(Fixtures::make_guild(10, CachedChannels, i)));
+    }
+
+    filled = true;
+  }
+}
+
+static void BM_Cache_GuildGet(benchmark::State& state)
+{
+  fill_caches();
+  size_t i = 0;
+
+  for (auto _ : state)
+  {
+    auto guild = Discord::API::Guild::get(Fixtures::GuildId + (i++ % CachedGuilds));
+    benchmark::DoNotOptimize(guild);
+  }
+}
+BENCHMARK(BM_Cache_GuildGet)->ThreadRange(1, 8);
+
+static void BM_Cache_ChannelGet(benchmark::State& state)
+{
+  fill_caches();
+  size_t i = 0;
+
+  for (auto _ : state)
+  {
+    auto channel = Discord::API::Channel::get(Fixtures::ChannelBase + (i++ % (CachedGuilds * CachedChannels)));
+    benchmark::DoNotOptimize(channel);
+  }
+}
+BENCHMARK(BM_Cache_ChannelGet)->ThreadRange(1, 8);
+
+//  The key and rate limit bucket built for every request, here for sending a message.
+static void BM_APICall_Build(benchmark::State& state)
+{
+  Discord::Snowflake channel_id(Fixtures::ChannelBase);
+
+  for (auto _ : state)
+  {
+    auto call = Discord::API::APICall(channel_id) << "channels" << channel_id << "messages";
+    benchmark::DoNotOptimize(call.hash());
+    benchmark::DoNotOptimize(call.endpoint());
+  }
+}
+BENCHMARK(BM_APICall_Build);
@@ -0,0 +1,72 @@
+#include <benchmark/benchmark.h>
+
+#include "fixtures.h"
+#include "guild.h"
+#include "member.h"
+#include "message.h"
+#include "user.h"
+
+static void BM_Decode_User(benchmark::State& state)
+{
+  auto data = Fixtures::make_user(1);
+
+  for (auto _ : state)
+  {
+    Discord::User user(data);
+    benchmark::DoNotOptimize(user);
+  }
+}
+BENCHMARK(BM_Decode_User);
+
+static void BM_Decode_Member(benchmark::State& state)
+{
+  auto data = Fixtures::make_member(1);
+
+  for (auto _ : state)
+  {
+    Discord::Member member(data);
+    benchmark::DoNotOptimize(member);
+  }
+}
+BENCHMARK(BM_Decode_Member);
+
+static void BM_Decode_Message(benchmark::State& state)
+{
+  auto data = Fixtures::make_message(1);
+
+  for (auto _ : state)
+  {
+    Discord::Message message(data);
+    benchmark::DoNotOptimize(message);
+  }
+}
+BENCHMARK(BM_Decode_Message);
+
+static void BM_Decode_Guild(benchmark::State& state)
+{
+  auto data = Fixtures::make_guild(state.range(0));
+
+  for (auto _ : state)
+  {
+    Discord::Guild guild(data);
+    benchmark::DoNotOptimize(guild.member_count());
+  }
+
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Decode_Guild)->Arg(100)->Arg(1000);
+
+//  Parsing the text of a GUILD_CREATE, which happens before the guild is decoded.
+static void BM_Parse_GuildPayload(benchmark::State& state)
+{
+  auto text = nlohmann::json({ { "op", 0 }, { "s", 2 }, { "t", "GUILD_CREATE" }, { "d", Fixtures::make_guild(state.range(0)) } }).dump();
+
+  for (auto _ : state)
+  {
+    auto payload = nlohmann::json::parse(text);
+    benchmark::DoNotOptimize(payload);
+  }
+
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_Parse_GuildPayload)->Arg(100)->Arg(1000);
@@ -0,0 +1,55 @@
+#include <benchmark/benchmark.h>
+
+#include "bot.h"
+#include "fixtures.h"
+#include "guild.h"
+
+namespace
+{
+  //  A bot that has loaded one guild, like it would be after READY.
+  std::shared_ptr<Discord::Bot> loaded_bot()
+  {
+    static std::shared_ptr<Discord::Bot> bot;
+
+    if (!bot)
+    {
+      Fixtures::disable_logging();
+      bot = Discord::Bot::create(std::string("benchmark"));
+      bot->handle_dispatch("GUILD_CREATE", Fixtures::make_guild(1000));
+    }
+
+    return bot;
+  }
+}
+
+static void BM_Dispatch(benchmark::State& state, std::string event, nlohmann::json data)
+{
+  auto bot = loaded_bot();
+
+  for (auto _ : state)
+  {
+    bot->handle_dispatch(event, data);
+  }
+}
+
+BENCHMARK_CAPTURE(BM_Dispatch, MESSAGE_CREATE, "MESSAGE_CREATE", Fixtures::make_message(1));
+BENCHMARK_CAPTURE(BM_Dispatch, MESSAGE_UPDATE, "MESSAGE_UPDATE", nlohmann::json({
+  { "id", "400000000000000001" }, { "channel_id", std::to_string(Fixtures::ChannelBase) }, { "content", "Edited." },
+  { "edited_timestamp", "2017-07-11T17:28:07.299000+00:00" }
+}));
+BENCHMARK_CAPTURE(BM_Dispatch, MESSAGE_DELETE, "MESSAGE_DELETE", nlohmann::json({
+  { "id", "400000000000000002" }, { "channel_id", std::to_string(Fixtures::ChannelBase) }, { "guild_id", std::to_string(Fixtures::GuildId) }
+}));
+BENCHMARK_CAPTURE(BM_Dispatch, TYPING_START, "TYPING_START", nlohmann::json({
+  { "user_id", std::to_string(Fixtures::UserBase + 1) }, { "channel_id", std::to_string(Fixtures::ChannelBase) },
+  { "guild_id", std::to_string(Fixtures::GuildId) }, { "timestamp", 1499794027 }
+}));
+BENCHMARK_CAPTURE(BM_Dispatch, PRESENCE_UPDATE, "PRESENCE_UPDATE", nlohmann::json({
+  { "user", { { "id", std::to_string(Fixtures::UserBase + 1) } } }, { "guild_id", std::to_string(Fixtures::GuildId) },
+  { "status", "idle" }, { "roles", { "290926798626357999" } }, { "game", nullptr }
+}));
+BENCHMARK_CAPTURE(BM_Dispatch, GUILD_MEMBER_UPDATE, "GUILD_MEMBER_UPDATE", nlohmann::json({
+  { "guild_id", std::to_string(Fixtures::GuildId) }, { "user", Fixtures::make_user(1) },
+  { "roles", { "290926798626357999" } }, { "nick", "renamed" }
+}));
+BENCHMARK_CAPTURE(BM_Dispatch, CHANNEL_UPDATE, "CHANNEL_UPDATE", Fixtures::make_channel(1));
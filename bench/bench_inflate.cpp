@@ -0,0 +1,25 @@
+#include <benchmark/benchmark.h>
+#include <zlib.h>
+
+#include "common.h"
+#include "fixtures.h"
+
+//  Inflating a compressed GUILD_CREATE, the first step for every large gateway payload.
+static void BM_Inflate_GuildCreate(benchmark::State& state)
+{
+  auto text = nlohmann::json({ { "op", 0 }, { "s", 2 }, { "t", "GUILD_CREATE" }, { "d", Fixtures::make_guild(state.range(0)) } }).dump();
+
+  auto size = compressBound(static_cast<uLong>(text.size()));
+  std::string compressed(size, '\0');
+  compress(reinterpret_cast<Bytef*>(&compressed[0]), &size, reinterpret_cast<const Bytef*>(text.data()), static_cast<uLong>(text.size()));
+  compressed.resize(size);
+
+  for (auto _ : state)
+  {
+    auto inflated = Discord::zlib_inflate(compressed);
+    benchmark::DoNotOptimize(inflated);
+  }
+
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_Inflate_GuildCreate)->Arg(100)->Arg(1000);
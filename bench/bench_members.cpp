@@ -0,0 +1,44 @@
+#include <benchmark/benchmark.h>
+
+#include "fixtures.h"
+#include "guild.h"
+#include "member.h"
+
+static void BM_MembersChunk_AddMember(benchmark::State& state)
+{
+  auto chunk = Fixtures::make_member_chunk(state.range(0));
+
+  for (auto _ : state)
+  {
+    Discord::Guild guild;
+
+    //  The per-member path GUILD_MEMBERS_CHUNK used before add_members.
+    auto members = chunk.get<std::vector<std::shared_ptr<Discord::Member>>>();
+
+    for (auto& member : members)
+    {
+      guild.add_member(member);
+    }
+
+    benchmark::DoNotOptimize(guild.member_count());
+  }
+
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_MembersChunk_AddMember)->Arg(1000);
+
+static void BM_MembersChunk_AddMembers(benchmark::State& state)
+{
+  auto chunk = Fixtures::make_member_chunk(state.range(0));
+
+  for (auto _ : state)
+  {
+    Discord::Guild guild;
+    guild.add_members(chunk);
+
+    benchmark::DoNotOptimize(guild.member_count());
+  }
+
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_MembersChunk_AddMembers)->Arg(1000);
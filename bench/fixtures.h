@@ -0,0 +1,162 @@
+#pragma once
+
+#include <string>
+
+#include "common.h"
+
+//  Payloads shaped like the ones Discord sends, shared by the benchmarks.
+namespace Fixtures
+{
+  const uint64_t GuildId = 290926798626357250ull;
+  const uint64_t ChannelBase = 300000000000000000ull;
+  const uint64_t UserBase = 200000000000000000ull;
+  const uint64_t MessageBase = 400000000000000000ull;
+  const uint64_t BotId = 600000000000000000ull;
+
+  //  Logging would dominate some of the timings, so benchmarks that touch the caches turn it off.
+  inline void disable_logging()
+  {
+    el::Loggers::reconfigureAllLoggers(el::ConfigurationType::Enabled, "false");
+  }
+
+  inline nlohmann::json make_user(size_t index)
+  {
+    return {
+      { "id", std::to_string(UserBase + index) },
+      { "username", "member" + std::to_string(index) },
+      { "discriminator", "0001" },
+      { "avatar", "a_1269e74af4df7417b13759eae50c83dc" }
+    };
+  }
+
+  inline nlohmann::json make_member(size_t index)
+  {
+    return {
+      { "user", make_user(index) },
+      { "nick", index % 3 == 0 ? nlohmann::json("nick" + std::to_string(index)) : nlohmann::json() },
+      { "roles", { "290926798626357999", "290926798626357250" } },
+      { "joined_at", "2017-03-22T18:40:57.185000+00:00" },
+      { "deaf", false },
+      { "mute", false }
+    };
+  }
+
+  //  A GUILD_MEMBERS_CHUNK member array.
+  inline nlohmann::json make_member_chunk(size_t count)
+  {
+    auto members = nlohmann::json::array();
+
+    for (size_t i = 0; i < count; ++i)
+    {
+      members.push_back(make_member(i));
+    }
+
+    return members;
+  }
+
+  //  A GUILD_MEMBER_ADD payload.
+  inline nlohmann::json make_join(size_t index, uint64_t guild_id = GuildId)
+  {
+    auto member = make_member(index);
+    member["guild_id"] = std::to_string(guild_id);
+    return member;
+  }
+
+  //  A presence as GUILD_CREATE sends it. PRESENCE_UPDATE adds the guild id and the member's roles.
+  inline nlohmann::json make_presence(size_t user, std::string status = "online", std::string game = "a game")
+  {
+    return {
+      { "user", { { "id", std::to_string(UserBase + user) } } },
+      { "status", status },
+      { "game", game.empty() ? nlohmann::json() : nlohmann::json({ { "name", game }, { "type", 0 } }) }
+    };
+  }
+
+  inline nlohmann::json make_channel(size_t index, uint64_t guild_id = GuildId)
+  {
+    return {
+      { "id", std::to_string(ChannelBase + index) },
+      { "type", 0 },
+      { "guild_id", std::to_string(guild_id) },
+      { "name", "channel-" + std::to_string(index) },
+      { "position", index },
+      { "topic", "A channel for talking about things." },
+      { "nsfw", false },
+      { "permission_overwrites", {
+        { { "id", "290926798626357999" }, { "type", "role" }, { "allow", 0 }, { "deny", 2048 } }
+      } }
+    };
+  }
+
+  //  A GUILD_CREATE payload with every member online. Tools that need several guilds pass an index,
+  //  which gives guild GuildId + index with channels numbered on from ChannelBase + index * channels.
+  inline nlohmann::json make_guild(size_t members, size_t channels = 20, size_t index = 0)
+  {
+    auto guild_id = GuildId + index;
+    auto channel_list = nlohmann::json::array();
+    auto presences = nlohmann::json::array();
+
+    for (size_t i = 0; i < channels; ++i)
+    {
+      channel_list.push_back(make_channel(index * channels + i, guild_id));
+    }
+
+    for (size_t i = 0; i < members; ++i)
+    {
+      presences.push_back(make_presence(i, "online", i % 2 == 0 ? "a game" : ""));
+    }
+
+    return {
+      { "id", std::to_string(guild_id) },
+      { "name", index == 0 ? "Benchmark Guild" : "Benchmark Guild " + std::to_string(index) },
+      { "icon", "1269e74af4df7417b13759eae50c83dc" },
+      { "splash", nullptr },
+      { "owner_id", std::to_string(UserBase) },
+      { "region", "us-east" },
+      { "afk_channel_id", nullptr },
+      { "afk_timeout", 300 },
+      { "verification_level", 1 },
+      { "default_message_notifications", 1 },
+      { "explicit_content_filter", 0 },
+      { "roles", {
+        { { "id", std::to_string(guild_id) }, { "name", "@everyone" }, { "color", 0 }, { "hoist", false }, { "position", 0 }, { "permissions", 104324161 }, { "managed", false }, { "mentionable", false } },
+        { { "id", "290926798626357999" }, { "name", "Moderators" }, { "color", 3447003 }, { "hoist", true }, { "position", 1 }, { "permissions", 2146958591 }, { "managed", false }, { "mentionable", true } }
+      } },
+      { "emojis", nlohmann::json::array() },
+      { "features", nlohmann::json::array() },
+      { "mfa_level", 0 },
+      { "joined_at", "2017-03-22T18:40:57.185000+00:00" },
+      { "large", false },
+      { "unavailable", false },
+      { "member_count", members },
+      { "voice_states", nlohmann::json::array() },
+      { "members", make_member_chunk(members) },
+      { "channels", channel_list },
+      { "presences", presences }
+    };
+  }
+
+  //  A MESSAGE_CREATE payload from a guild channel.
+  inline nlohmann::json make_message(size_t index, uint64_t channel_id = ChannelBase, uint64_t guild_id = GuildId)
+  {
+    return {
+      { "id", std::to_string(MessageBase + index) },
+      { "channel_id", std::to_string(channel_id) },
+      { "guild_id", std::to_string(guild_id) },
+      { "author", make_user(index % 100) },
+      { "member", { { "roles", { "290926798626357999" } }, { "joined_at", "2017-03-22T18:40:57.185000+00:00" }, { "deaf", false }, { "mute", false } } },
+      { "content", "Has anyone tried the new release yet? It is supposed to be a lot faster. <@" + std::to_string(UserBase + 1) + ">" },
+      { "timestamp", "2017-07-11T17:27:07.299000+00:00" },
+      { "edited_timestamp", nullptr },
+      { "tts", false },
+      { "mention_everyone", false },
+      { "mentions", { make_user(1) } },
+      { "mention_roles", nlohmann::json::array() },
+      { "attachments", nlohmann::json::array() },
+      { "embeds", nlohmann::json::array() },
+      { "pinned", false },
+      { "type", 0 },
+      { "nonce", std::to_string(500000000000000000ull + index) }
+    };
+  }
+}
@@ -0,0 +1,375 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../fixtures.h"
+#include "bot.h"
+#include "event/event_message.h"
+#include "gateway.h"
+#include "gateway_recording.h"
+#include "guild.h"
+#include "user.h"
+
+//  Finds the highest event rate a bot can keep up with by feeding it synthetic gateway events.
+//
+//    libdiscord_load [--guilds 50] [--members 500] [--channels 10] [--rate 1000] [--max-rate 200000]
+//                    [--step 1.5] [--duration 5] [--messages 60] [--presences 30] [--joins 10]
+//                    [--commands 20] [--burst 50] [--max-p99 50] [--on-message]
+//
+//  Every step loads the guilds into a fresh bot, then sends a mix of MESSAGE_CREATE, PRESENCE_UPDATE
+//  and GUILD_MEMBER_ADD at --rate events per second for --duration seconds through the gateway's
+//  receive pipeline, so each frame is parsed, decoded and dispatched like one from the socket. The
+//  rate grows by --step until a step can't keep up.
+//
+//  --messages, --presences and --joins weigh the mix. --commands is the percentage of messages that
+//  are commands, which run a handler on their own thread like a real command. Presences and joins
+//  arrive in storms of --burst events at once, with the average rate unchanged. A step keeps up when
+//  it handles at least 95% of the offered rate and the p99 time from a frame arriving to the end of
+//  its dispatch is under --max-p99 milliseconds.
+namespace
+{
+  using nlohmann::json;
+
+  struct Options
+  {
+    uint32_t guilds = 50;
+    uint32_t members = 500;
+    uint32_t channels = 10;
+    uint32_t rate = 1000;           //  Events per second in the first step.
+    uint32_t max_rate = 200000;
+    double step = 1.5;              //  How much the rate grows each step.
+    uint32_t duration = 5;          //  Seconds per step.
+    uint32_t messages = 60;
+    uint32_t presences = 30;
+    uint32_t joins = 10;
+    uint32_t commands = 20;         //  Percentage of messages that are commands.
+    uint32_t burst = 50;            //  Presences and joins sent back to back in one storm.
+    double max_p99 = 50;            //  Slowest p99 in milliseconds for a step to count as keeping up.
+    bool on_message = false;        //  Also run an on_message handler for messages that aren't commands.
+  };
+
+  Options Settings;
+
+  const std::vector<std::string> LoadEvents = { "MESSAGE_CREATE", "PRESENCE_UPDATE", "GUILD_MEMBER_ADD" };
+
+  //  Joined members get ids past the generated ones, and keep counting across steps so they stay new.
+  uint64_t NextJoin = 0;
+  uint64_t NextMessage = 0;
+
+  struct StepResult
+  {
+    double offered;
+    double achieved;
+    std::map<std::string, Discord::EventStats> events;
+    double worst_p99;
+    bool kept_up;
+  };
+
+  std::string dispatch(const std::string& name, const json& data, uint64_t sequence)
+  {
+    return json({ { "op", 0 }, { "s", sequence }, { "t", name }, { "d", data } }).dump();
+  }
+
+  //  READY and a GUILD_CREATE for every guild, sent as fast as possible before the load starts.
+  std::vector<Discord::RecordedFrame> make_setup(uint64_t& sequence)
+  {
+    std::vector<Discord::RecordedFrame> frames;
+    auto guilds = json::array();
+
+    for (uint32_t g = 0; g < Settings.guilds; ++g)
+    {
+      guilds.push_back({ { "id", std::to_string(Fixtures::GuildId + g) }, { "unavailable", true } });
+    }
+
+    json ready =
+    {
+      { "v", 6 },
+      { "user", { { "id", std::to_string(Fixtures::BotId) }, { "username", "load" }, { "discriminator", "0001" }, { "avatar", nullptr }, { "bot", true } } },
+      { "private_channels", json::array() },
+      { "guilds", guilds },
+      { "session_id", "load" }
+    };
+
+    frames.push_back({ std::chrono::microseconds(0), false, dispatch("READY", ready, sequence++) });
+
+    for (uint32_t g = 0; g < Settings.guilds; ++g)
+    {
+      frames.push_back({ std::chrono::microseconds(0), false, dispatch("GUILD_CREATE", Fixtures::make_guild(Settings.members, Settings.channels, g), sequence++) });
+    }
+
+    return frames;
+  }
+
+  json make_message(std::mt19937& rng)
+  {
+    uint64_t guild = rng() % Settings.guilds;
+    auto channel = Fixtures::ChannelBase + guild * Settings.channels + rng() % Settings.channels;
+    auto id = NextMessage++;
+    auto command = rng() % 100 < Settings.commands;
+
+    auto message = Fixtures::make_message(id, channel, Fixtures::GuildId + guild);
+    message["author"] = Fixtures::make_user(rng() % Settings.members);
+    message["content"] = command ? "!ping " + std::to_string(id) : "Message " + std::to_string(id) + " with some ordinary chat text in it";
+    return message;
+  }
+
+  json make_presence(uint64_t guild, std::mt19937& rng)
+  {
+    static const char* statuses[] = { "online", "idle", "dnd", "offline" };
+    auto user = rng() % Settings.members;
+    auto status = statuses[rng() % 4];
+    auto game = rng() % 2 == 0 ? "Game " + std::to_string(rng() % 100) : "";
+
+    auto presence = Fixtures::make_presence(user, status, game);
+    presence["guild_id"] = std::to_string(Fixtures::GuildId + guild);
+    presence["roles"] = json::array();
+    return presence;
+  }
+
+  json make_join(uint64_t guild)
+  {
+    return Fixtures::make_join(Settings.members + NextJoin++, Fixtures::GuildId + guild);
+  }
+
+  //  Events are spaced evenly at the rate. A storm of presences or joins takes up as many slots as
+  //  it has events but arrives all at once, like a raid or a large guild coming online.
+  std::vector<Discord::RecordedFrame> make_load(double rate, uint64_t& sequence, std::mt19937& rng)
+  {
+    std::vector<Discord::RecordedFrame> frames;
+    auto total = static_cast<size_t>(rate * Settings.duration);
+    auto burst = std::max(Settings.burst, 1u);
+
+    //  Pick storms less often so each kind still makes up its share of events.
+    std::discrete_distribution<int> kind({ static_cast<double>(Settings.messages), Settings.presences / static_cast<double>(burst), Settings.joins / static_cast<double>(burst) });
+
+    frames.reserve(total + burst);
+
+    while (frames.size() < total)
+    {
+      auto offset = std::chrono::microseconds(static_cast<int64_t>(frames.size() * 1000000.0 / rate));
+      auto picked = kind(rng);
+
+      if (picked == 0)
+      {
+        frames.push_back({ offset, false, dispatch("MESSAGE_CREATE", make_message(rng), sequence++) });
+        continue;
+      }
+
+      uint64_t guild = rng() % Settings.guilds;
+
+      for (uint32_t i = 0; i < burst; ++i)
+      {
+        auto data = picked == 1 ? make_presence(guild, rng) : make_join(guild);
+        frames.push_back({ offset, false, dispatch(picked == 1 ? "PRESENCE_UPDATE" : "GUILD_MEMBER_ADD", data, sequence++) });
+      }
+    }
+
+    return frames;
+  }
+
+  StepResult run_step(double rate, std::mt19937& rng)
+  {
+    auto bot = Discord::Bot::create(std::string("load"), "!");
+
+    //  A command that looks at the caches like a real one would, without calling the API.
+    bot->add_command("ping", [](Discord::MessageEvent event)
+    {
+      auto guild = event.guild();
+      auto member = guild ? guild->get_member(event.author()->id()) : nullptr;
+      volatile auto length = event.content().size() + (member ? 1 : 0);
+      (void)length;
+    });
+
+    if (Settings.on_message)
+    {
+      bot->on_message([](Discord::MessageEvent event)
+      {
+        volatile auto length = event.content().size();
+        (void)length;
+      });
+    }
+
+    uint64_t sequence = 1;
+    bot->replay_gateway(make_setup(sequence));
+
+    auto frames = make_load(rate, sequence, rng);
+
+    auto start = std::chrono::steady_clock::now();
+    bot->replay_gateway(frames, true);
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    StepResult result;
+    result.offered = rate;
+    result.achieved = frames.size() / elapsed;
+    result.worst_p99 = 0;
+
+    for (auto& event : bot->event_stats())
+    {
+      if (std::find(std::begin(LoadEvents), std::end(LoadEvents), event.name) != std::end(LoadEvents))
+      {
+        result.events[event.name] = event;
+        result.worst_p99 = std::max(result.worst_p99, event.p99_ms);
+      }
+    }
+
+    result.kept_up = result.achieved >= 0.95 * rate && result.worst_p99 <= Settings.max_p99;
+    return result;
+  }
+
+  void print_header()
+  {
+    std::cout << std::right << std::setw(12) << "Offered/s" << std::setw(12) << "Handled/s";
+
+    for (auto& name : LoadEvents)
+    {
+      std::cout << std::setw(28) << name + " p50/p99";
+    }
+
+    std::cout << std::setw(10) << "" << std::endl;
+  }
+
+  void print_step(const StepResult& result)
+  {
+    std::cout << std::fixed << std::setprecision(0) << std::right << std::setw(12) << result.offered << std::setw(12) << result.achieved;
+    std::cout << std::setprecision(2);
+
+    for (auto& name : LoadEvents)
+    {
+      auto event = result.events.find(name);
+
+      if (event == std::end(result.events))
+      {
+        std::cout << std::setw(28) << "-";
+        continue;
+      }
+
+      std::ostringstream latency;
+      latency << std::fixed << std::setprecision(2) << event->second.p50_ms << " / " << event->second.p99_ms;
+      std::cout << std::setw(28) << latency.str();
+    }
+
+    std::cout << std::setw(10) << (result.kept_up ? "ok" : "behind") << std::endl;
+  }
+
+  bool parse_options(int argc, char* argv[])
+  {
+    std::map<std::string, uint32_t*> numbers =
+    {
+      { "--guilds", &Settings.guilds },
+      { "--members", &Settings.members },
+      { "--channels", &Settings.channels },
+      { "--rate", &Settings.rate },
+      { "--max-rate", &Settings.max_rate },
+      { "--duration", &Settings.duration },
+      { "--messages", &Settings.messages },
+      { "--presences", &Settings.presences },
+      { "--joins", &Settings.joins },
+      { "--commands", &Settings.commands },
+      { "--burst", &Settings.burst }
+    };
+
+    std::map<std::string, double*> decimals =
+    {
+      { "--step", &Settings.step },
+      { "--max-p99", &Settings.max_p99 }
+    };
+
+    for (int i = 1; i < argc; ++i)
+    {
+      std::string option = argv[i];
+
+      if (option == "--on-message")
+      {
+        Settings.on_message = true;
+      }
+      else if (numbers.count(option) && i + 1 < argc)
+      {
+        *numbers[option] = static_cast<uint32_t>(std::stoul(argv[++i]));
+      }
+      else if (decimals.count(option) && i + 1 < argc)
+      {
+        *decimals[option] = std::stod(argv[++i]);
+      }
+      else
+      {
+        std::cerr << "Unknown option " << option << std::endl;
+        return false;
+      }
+    }
+
+    if (Settings.guilds == 0 || Settings.members == 0 || Settings.channels == 0 || Settings.rate == 0 || Settings.duration == 0)
+    {
+      std::cerr << "--guilds, --members, --channels, --rate and --duration must be above zero." << std::endl;
+      return false;
+    }
+
+    if (Settings.messages + Settings.presences + Settings.joins == 0 || Settings.step <= 1)
+    {
+      std::cerr << "The event mix needs at least one weight above zero, and --step must be above 1." << std::endl;
+      return false;
+    }
+
+    return true;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  if (!parse_options(argc, argv))
+  {
+    return 1;
+  }
+
+  //  Keep logging from skewing the numbers.
+  el::Loggers::reconfigureAllLoggers(el::ConfigurationType::Enabled, "false");
+
+  std::cout << "Loading " << Settings.guilds << " guilds of " << Settings.members << " members, "
+            << Settings.duration << "s per step." << std::endl << std::endl;
+
+  print_header();
+
+  std::mt19937 rng(42);
+  std::vector<StepResult> results;
+
+  for (double rate = Settings.rate; rate <= Settings.max_rate; rate *= Settings.step)
+  {
+    results.push_back(run_step(rate, rng));
+    print_step(results.back());
+
+    if (!results.back().kept_up)
+    {
+      break;
+    }
+  }
+
+  auto sustained = std::find_if(results.rbegin(), results.rend(), [](const StepResult& result) { return result.kept_up; });
+
+  std::cout << std::endl;
+
+  if (sustained == results.rend())
+  {
+    std::cout << "Could not keep up with the first step of " << Settings.rate << " events/s. Try a lower --rate." << std::endl;
+    return 0;
+  }
+
+  std::cout << std::fixed << std::setprecision(0) << "Highest sustained rate: " << sustained->achieved << " events/s"
+            << std::setprecision(2) << " (slowest p99 " << sustained->worst_p99 << " ms)." << std::endl;
+
+  if (sustained == results.rbegin())
+  {
+    std::cout << "Every step kept up. Raise --max-rate to find where the bot saturates." << std::endl;
+  }
+  else
+  {
+    std::cout << std::setprecision(0) << "Saturates between " << sustained->offered << " and " << results.back().offered << " events/s." << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,1065 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "../fixtures.h"
+
+//  A local stand in for Discord's REST API and gateway, for load testing without a connection.
+//
+//    discord_mock [--port 8080] [--guilds 10] [--members 100] [--channels 10]
+//                 [--heartbeat-interval 41250] [--bucket-limit 5] [--bucket-window 5000]
+//                 [--global-limit 50] [--reconnect-after 0] [--event-rate 0] [--no-compress]
+//
+//  Point a bot at it with the "api_url" setting set to http://127.0.0.1:8080/api/v6. The gateway URL
+//  comes from GET /gateway like it does from Discord, or can be set with "gateway_url".
+//
+//  REST requests are rate limited per route like Discord does, with the same headers and 429 bodies,
+//  and successful requests echo back what was sent. The gateway sends HELLO, answers Identify with
+//  READY and a GUILD_CREATE for every guild, and supports heartbeats, Resume and member requests.
+//  --reconnect-after makes it ask every connection to reconnect on an interval, and --event-rate sends
+//  that many MESSAGE_CREATE events per second on each connection.
+
+namespace
+{
+  using nlohmann::json;
+
+  struct Options
+  {
+    uint16_t port = 8080;
+    uint32_t guilds = 10;
+    uint32_t members = 100;
+    uint32_t channels = 10;
+    uint32_t heartbeat_interval = 41250;
+    uint32_t bucket_limit = 5;          //  Requests allowed per route in each window.
+    uint32_t bucket_window = 5000;      //  Length of a route's window in milliseconds.
+    uint32_t global_limit = 50;         //  Requests allowed per second across every route. Zero turns it off.
+    uint32_t reconnect_after = 0;       //  Seconds before asking a connection to reconnect. Zero never asks.
+    uint32_t event_rate = 0;            //  MESSAGE_CREATE events per second on each connection.
+    bool compress = true;               //  Compress large payloads for clients that ask for it.
+  };
+
+  Options Settings;
+
+  std::atomic<uint64_t> Requests(0);
+  std::atomic<uint64_t> RateLimited(0);
+  std::atomic<uint64_t> Connections(0);
+  std::atomic<uint64_t> Events(0);
+
+  //  Guilds, channels and users come from the shared bench fixtures, so their ids are the same
+  //  across reconnects and match the ones the load test generates.
+  const char* JoinedAt = "2017-03-22T18:40:57.185000+00:00";
+
+  uint64_t next_id()
+  {
+    static std::atomic<uint64_t> increment(0);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+    //  Discord's epoch is the first second of 2015.
+    return (static_cast<uint64_t>(ms - 1420070400000) << 22) | (increment++ & 0xFFF);
+  }
+
+  json make_guild(uint32_t index, uint32_t large_threshold)
+  {
+    //  Large guilds only send the members that are online. The first members stand in for them.
+    auto large = Settings.members > large_threshold;
+    auto sent = large ? std::min(Settings.members, large_threshold) : Settings.members;
+
+    auto guild = Fixtures::make_guild(sent, Settings.channels, index);
+    guild["large"] = large;
+    guild["member_count"] = Settings.members;
+    return guild;
+  }
+
+  bool write_all(int fd, const std::string& data)
+  {
+    size_t sent = 0;
+
+    while (sent < data.size())
+    {
+      auto written = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+
+      if (written <= 0)
+      {
+        return false;
+      }
+
+      sent += static_cast<size_t>(written);
+    }
+
+    return true;
+  }
+
+  /** Buffered reads from a socket. HTTP requests and websocket frames share one connection, so
+      anything read past the end of the handshake has to stay available for the frames.
+   */
+  class Reader
+  {
+    int m_fd;
+    std::string m_buffer;
+    size_t m_position = 0;
+
+    bool fill()
+    {
+      char chunk[16384];
+      auto received = ::recv(m_fd, chunk, sizeof(chunk), 0);
+
+      if (received <= 0)
+      {
+        return false;
+      }
+
+      m_buffer.erase(0, m_position);
+      m_position = 0;
+      m_buffer.append(chunk, static_cast<size_t>(received));
+
+      return true;
+    }
+  public:
+    explicit Reader(int fd) : m_fd(fd) {}
+
+    bool read_line(std::string& line)
+    {
+      for (;;)
+      {
+        auto end = m_buffer.find("\r\n", m_position);
+
+        if (end != std::string::npos)
+        {
+          line = m_buffer.substr(m_position, end - m_position);
+          m_position = end + 2;
+          return true;
+        }
+
+        if (!fill())
+        {
+          return false;
+        }
+      }
+    }
+
+    bool read(std::string& data, size_t size)
+    {
+      while (m_buffer.size() - m_position < size)
+      {
+        if (!fill())
+        {
+          return false;
+        }
+      }
+
+      data = m_buffer.substr(m_position, size);
+      m_position += size;
+
+      return true;
+    }
+  };
+
+  struct HttpRequest
+  {
+    std::string method;
+    std::string path;
+    std::map<std::string, std::string> headers;   //  Names are lower case.
+    std::string body;
+  };
+
+  bool read_request(Reader& reader, HttpRequest& request)
+  {
+    std::string line;
+
+    if (!reader.read_line(line))
+    {
+      return false;
+    }
+
+    std::string target;
+    std::istringstream start(line);
+    start >> request.method >> target;
+
+    request.path = target.substr(0, target.find('?'));
+    request.headers.clear();
+    request.body.clear();
+
+    for (;;)
+    {
+      if (!reader.read_line(line))
+      {
+        return false;
+      }
+
+      if (line.empty())
+      {
+        break;
+      }
+
+      auto colon = line.find(':');
+
+      if (colon == std::string::npos)
+      {
+        continue;
+      }
+
+      auto name = line.substr(0, colon);
+      auto value = line.find_first_not_of(' ', colon + 1);
+
+      std::transform(std::begin(name), std::end(name), std::begin(name), ::tolower);
+      request.headers[name] = value == std::string::npos ? "" : line.substr(value);
+    }
+
+    auto length = request.headers.find("content-length");
+
+    return length == std::end(request.headers) || reader.read(request.body, std::stoul(length->second));
+  }
+
+  bool write_response(int fd, int status, const std::string& reason, const std::vector<std::pair<std::string, std::string>>& headers, const std::string& body)
+  {
+    std::ostringstream response;
+    response << "HTTP/1.1 " << status << " " << reason << "\r\n";
+
+    for (auto& header : headers)
+    {
+      response << header.first << ": " << header.second << "\r\n";
+    }
+
+    if (!body.empty())
+    {
+      response << "Content-Type: application/json\r\n";
+    }
+
+    response << "Content-Length: " << body.size() << "\r\n\r\n" << body;
+
+    return write_all(fd, response.str());
+  }
+
+  /** Per route and global rate limits that behave like Discord's. */
+  class RateLimiter
+  {
+    struct Window
+    {
+      uint32_t used = 0;
+      std::chrono::system_clock::time_point reset;
+    };
+
+    std::map<std::string, Window> m_buckets;
+    Window m_global;
+    std::mutex m_mutex;
+  public:
+    struct Result
+    {
+      bool limited = false;
+      bool global = false;
+      uint32_t remaining = 0;
+      int64_t reset = 0;          //  Epoch seconds, as Discord sends it.
+      int64_t retry_after = 0;    //  Milliseconds.
+    };
+
+    Result take(const std::string& bucket)
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+
+      auto now = std::chrono::system_clock::now();
+      Result result;
+
+      if (Settings.global_limit)
+      {
+        if (now >= m_global.reset)
+        {
+          m_global.used = 0;
+          m_global.reset = now + std::chrono::seconds(1);
+        }
+
+        if (m_global.used >= Settings.global_limit)
+        {
+          result.limited = true;
+          result.global = true;
+          result.retry_after = std::chrono::duration_cast<std::chrono::milliseconds>(m_global.reset - now).count() + 1;
+          return result;
+        }
+
+        m_global.used++;
+      }
+
+      auto& window = m_buckets[bucket];
+
+      if (now >= window.reset)
+      {
+        window.used = 0;
+        window.reset = now + std::chrono::milliseconds(Settings.bucket_window);
+      }
+
+      //  Round up, so a client that sleeps until the reset never wakes before it.
+      auto reset_ms = std::chrono::duration_cast<std::chrono::milliseconds>(window.reset.time_since_epoch()).count();
+      result.reset = (reset_ms + 999) / 1000;
+
+      if (window.used >= Settings.bucket_limit)
+      {
+        result.limited = true;
+        result.retry_after = std::chrono::duration_cast<std::chrono::milliseconds>(window.reset - now).count() + 1;
+        return result;
+      }
+
+      window.used++;
+      result.remaining = Settings.bucket_limit - window.used;
+
+      return result;
+    }
+  };
+
+  RateLimiter Limits;
+
+  //  Routes share a bucket when they only differ by ids, except for the channel, guild or webhook id.
+  std::string bucket_for(const HttpRequest& request, const std::string& endpoint)
+  {
+    std::istringstream parts(endpoint);
+    std::string part;
+    std::string previous;
+    std::string bucket = request.method;
+
+    while (std::getline(parts, part, '/'))
+    {
+      if (part.empty())
+      {
+        continue;
+      }
+
+      auto id = std::all_of(std::begin(part), std::end(part), ::isdigit);
+      auto major = previous == "channels" || previous == "guilds" || previous == "webhooks";
+
+      bucket += "/" + (id && !major ? std::string("{id}") : part);
+      previous = part;
+    }
+
+    return bucket;
+  }
+
+  json make_response(const HttpRequest& request, const std::string& endpoint)
+  {
+    json body = json::object();
+
+    if (!request.body.empty())
+    {
+      try
+      {
+        body = json::parse(request.body);
+      }
+      catch (const std::exception&)
+      {
+      }
+    }
+
+    auto last = endpoint.substr(endpoint.find_last_of('/') + 1);
+    auto last_is_id = !last.empty() && std::all_of(std::begin(last), std::end(last), ::isdigit);
+
+    if (request.method == "GET")
+    {
+      //  Collections get an empty list, single objects just their id.
+      return last_is_id ? json({ { "id", last } }) : json::array();
+    }
+
+    if (!body.is_object())
+    {
+      body = json::object();
+    }
+
+    if (!body.count("id"))
+    {
+      body["id"] = last_is_id && request.method == "PATCH" ? last : std::to_string(next_id());
+    }
+
+    //  Sent messages come back as full message objects.
+    if (request.method == "POST" && last == "messages")
+    {
+      auto channel = endpoint.substr(0, endpoint.find_last_of('/'));
+
+      body["channel_id"] = channel.substr(channel.find_last_of('/') + 1);
+      body["author"] = { { "id", std::to_string(Fixtures::BotId) }, { "username", "mock" }, { "discriminator", "0000" }, { "avatar", nullptr }, { "bot", true } };
+      body["timestamp"] = JoinedAt;
+      body["edited_timestamp"] = nullptr;
+      body["tts"] = false;
+      body["mention_everyone"] = false;
+      body["mentions"] = json::array();
+      body["mention_roles"] = json::array();
+      body["attachments"] = json::array();
+      body["embeds"] = json::array();
+      body["pinned"] = false;
+      body["type"] = 0;
+    }
+
+    return body;
+  }
+
+  bool handle_rest(int fd, const HttpRequest& request)
+  {
+    Requests++;
+
+    //  Strip the "/api/v6" prefix.
+    auto endpoint = request.path;
+
+    if (endpoint.compare(0, 6, "/api/v") == 0)
+    {
+      auto slash = endpoint.find('/', 6);
+      endpoint = slash == std::string::npos ? "/" : endpoint.substr(slash);
+    }
+
+    auto connection = request.headers.find("connection");
+    auto keep_alive = connection == std::end(request.headers) || connection->second != "close";
+
+    if (endpoint == "/gateway" || endpoint == "/gateway/bot")
+    {
+      auto host = request.headers.find("host");
+      json body = { { "url", "ws://" + (host == std::end(request.headers) ? "127.0.0.1:" + std::to_string(Settings.port) : host->second) } };
+
+      return write_response(fd, 200, "OK", {}, body.dump()) && keep_alive;
+    }
+
+    auto limit = Limits.take(bucket_for(request, endpoint));
+
+    if (limit.limited)
+    {
+      RateLimited++;
+
+      json body = { { "message", "You are being rate limited." }, { "retry_after", limit.retry_after }, { "global", limit.global } };
+      std::vector<std::pair<std::string, std::string>> headers = { { "Retry-After", std::to_string(limit.retry_after) } };
+
+      if (limit.global)
+      {
+        headers.emplace_back("X-RateLimit-Global", "true");
+      }
+      else
+      {
+        headers.emplace_back("X-RateLimit-Limit", std::to_string(Settings.bucket_limit));
+        headers.emplace_back("X-RateLimit-Remaining", "0");
+        headers.emplace_back("X-RateLimit-Reset", std::to_string(limit.reset));
+      }
+
+      return write_response(fd, 429, "Too Many Requests", headers, body.dump()) && keep_alive;
+    }
+
+    std::vector<std::pair<std::string, std::string>> headers =
+    {
+      { "X-RateLimit-Limit", std::to_string(Settings.bucket_limit) },
+      { "X-RateLimit-Remaining", std::to_string(limit.remaining) },
+      { "X-RateLimit-Reset", std::to_string(limit.reset) }
+    };
+
+    if (request.method == "DELETE" || request.method == "PUT")
+    {
+      return write_response(fd, 204, "No Content", headers, "") && keep_alive;
+    }
+
+    return write_response(fd, 200, "OK", headers, make_response(request, endpoint).dump()) && keep_alive;
+  }
+
+  std::string accept_key(const std::string& key)
+  {
+    auto text = key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    unsigned char encoded[64];
+
+    SHA1(reinterpret_cast<const unsigned char*>(text.data()), text.size(), digest);
+    auto length = EVP_EncodeBlock(encoded, digest, SHA_DIGEST_LENGTH);
+
+    return std::string(reinterpret_cast<char*>(encoded), static_cast<size_t>(length));
+  }
+
+  std::string compress_payload(const std::string& text)
+  {
+    auto size = compressBound(static_cast<uLong>(text.size()));
+    std::string compressed(size, '\0');
+
+    compress(reinterpret_cast<Bytef*>(&compressed[0]), &size, reinterpret_cast<const Bytef*>(text.data()), static_cast<uLong>(text.size()));
+    compressed.resize(size);
+
+    return compressed;
+  }
+
+  //  Sessions that can be resumed, with the last sequence number sent on them.
+  std::map<std::string, uint64_t> Sessions;
+  std::mutex SessionsMutex;
+
+  class GatewaySession
+  {
+    enum Opcode
+    {
+      Dispatch = 0,
+      Heartbeat = 1,
+      Identify = 2,
+      Resume = 6,
+      Reconnect = 7,
+      RequestMembers = 8,
+      InvalidSession = 9,
+      Hello = 10,
+      HeartbeatAck = 11
+    };
+
+    int m_fd;
+    Reader& m_reader;
+    std::mutex m_write_mutex;
+    uint64_t m_sequence = 0;
+    std::string m_session_id;
+    bool m_compress = false;
+    uint32_t m_large_threshold = 50;
+
+    bool m_open = true;
+    std::mutex m_open_mutex;
+    std::condition_variable m_closed;
+    std::vector<std::thread> m_threads;
+
+    bool send_frame(uint8_t opcode, const std::string& payload)
+    {
+      std::string frame(1, static_cast<char>(0x80 | opcode));
+
+      if (payload.size() < 126)
+      {
+        frame.push_back(static_cast<char>(payload.size()));
+      }
+      else if (payload.size() <= 0xFFFF)
+      {
+        frame.push_back(126);
+        frame.push_back(static_cast<char>(payload.size() >> 8));
+        frame.push_back(static_cast<char>(payload.size() & 0xFF));
+      }
+      else
+      {
+        frame.push_back(127);
+
+        for (int i = 7; i >= 0; --i)
+        {
+          frame.push_back(static_cast<char>((static_cast<uint64_t>(payload.size()) >> (i * 8)) & 0xFF));
+        }
+      }
+
+      return write_all(m_fd, frame + payload);
+    }
+
+    bool read_frame(uint8_t& opcode, std::string& payload)
+    {
+      payload.clear();
+
+      for (;;)
+      {
+        std::string header;
+
+        if (!m_reader.read(header, 2))
+        {
+          return false;
+        }
+
+        auto fin = (header[0] & 0x80) != 0;
+        uint8_t op = header[0] & 0x0F;
+        auto masked = (header[1] & 0x80) != 0;
+        uint64_t length = header[1] & 0x7F;
+
+        if (length >= 126)
+        {
+          std::string extended;
+
+          if (!m_reader.read(extended, length == 126 ? 2 : 8))
+          {
+            return false;
+          }
+
+          length = 0;
+
+          for (auto byte : extended)
+          {
+            length = (length << 8) | static_cast<uint8_t>(byte);
+          }
+        }
+
+        std::string mask;
+        std::string data;
+
+        if ((masked && !m_reader.read(mask, 4)) || !m_reader.read(data, length))
+        {
+          return false;
+        }
+
+        if (masked)
+        {
+          for (size_t i = 0; i < data.size(); ++i)
+          {
+            data[i] ^= mask[i % 4];
+          }
+        }
+
+        //  Control frames are never fragmented, so they can be handed back on their own.
+        if (op >= 0x8)
+        {
+          opcode = op;
+          payload = data;
+          return true;
+        }
+
+        if (op != 0)
+        {
+          opcode = op;
+        }
+
+        payload += data;
+
+        if (fin)
+        {
+          return true;
+        }
+      }
+    }
+
+    bool send(Opcode op, json data, const std::string& event = "")
+    {
+      std::lock_guard<std::mutex> lock(m_write_mutex);
+
+      json packet = { { "op", op }, { "d", data }, { "s", nullptr }, { "t", nullptr } };
+
+      if (op == Dispatch)
+      {
+        packet["s"] = ++m_sequence;
+        packet["t"] = event;
+      }
+
+      auto text = packet.dump();
+
+      //  Discord compresses large payloads like READY and GUILD_CREATE for clients that ask for it.
+      if (m_compress && text.size() > 4096)
+      {
+        return send_frame(0x2, compress_payload(text));
+      }
+
+      return send_frame(0x1, text);
+    }
+
+    //  Wait for a while, returning early with false if the connection closes.
+    bool wait(std::chrono::steady_clock::duration duration)
+    {
+      std::unique_lock<std::mutex> lock(m_open_mutex);
+      return !m_closed.wait_for(lock, duration, [this]() { return !m_open; });
+    }
+
+    void start_background()
+    {
+      if (Settings.event_rate)
+      {
+        m_threads.emplace_back([this]()
+        {
+          std::mt19937 rng(std::random_device{}());
+          auto period = std::chrono::nanoseconds(1000000000ull / Settings.event_rate);
+
+          while (wait(period))
+          {
+            uint64_t guild = rng() % std::max(Settings.guilds, 1u);
+            uint64_t channel = Fixtures::ChannelBase + guild * Settings.channels + rng() % std::max(Settings.channels, 1u);
+            auto author = rng() % std::max(Settings.members, 1u);
+
+            //  Real ids, so anything that reads the time from a message id sees it as new.
+            auto message = Fixtures::make_message(0, channel, Fixtures::GuildId + guild);
+            message["id"] = std::to_string(next_id());
+            message["author"] = Fixtures::make_user(author);
+            message["content"] = "Message " + std::to_string(Events.load());
+
+            if (!send(Dispatch, message, "MESSAGE_CREATE"))
+            {
+              break;
+            }
+
+            Events++;
+          }
+        });
+      }
+
+      if (Settings.reconnect_after)
+      {
+        m_threads.emplace_back([this]()
+        {
+          if (wait(std::chrono::seconds(Settings.reconnect_after)))
+          {
+            send(Reconnect, nullptr);
+          }
+        });
+      }
+    }
+
+    void identify(const json& data)
+    {
+      m_compress = Settings.compress && data.count("compress") && data["compress"].get<bool>();
+
+      if (data.count("large_threshold"))
+      {
+        m_large_threshold = data["large_threshold"].get<uint32_t>();
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(SessionsMutex);
+
+        std::ostringstream session_id;
+        session_id << std::hex << next_id();
+        m_session_id = session_id.str();
+        Sessions[m_session_id] = 0;
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        m_sequence = 0;
+      }
+
+      auto guilds = json::array();
+
+      for (uint32_t g = 0; g < Settings.guilds; ++g)
+      {
+        guilds.push_back({ { "id", std::to_string(Fixtures::GuildId + g) }, { "unavailable", true } });
+      }
+
+      send(Dispatch,
+      {
+        { "v", 6 },
+        { "user", { { "id", std::to_string(Fixtures::BotId) }, { "username", "mock" }, { "discriminator", "0000" }, { "avatar", nullptr }, { "bot", true } } },
+        { "session_id", m_session_id },
+        { "private_channels", json::array() },
+        { "guilds", guilds },
+        { "_trace", { "discord-mock" } }
+      }, "READY");
+
+      for (uint32_t g = 0; g < Settings.guilds; ++g)
+      {
+        send(Dispatch, make_guild(g, m_large_threshold), "GUILD_CREATE");
+      }
+
+      start_background();
+    }
+
+    void resume(const json& data)
+    {
+      auto session_id = data["session_id"].get<std::string>();
+      bool known;
+
+      {
+        std::lock_guard<std::mutex> lock(SessionsMutex);
+        known = Sessions.count(session_id) != 0;
+      }
+
+      if (!known)
+      {
+        send(InvalidSession, false);
+        return;
+      }
+
+      m_session_id = session_id;
+
+      {
+        //  Nothing was missed, so carry on from where the client left off.
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        m_sequence = data["seq"].get<uint64_t>();
+      }
+
+      send(Dispatch, { { "_trace", { "discord-mock" } } }, "RESUMED");
+      start_background();
+    }
+
+    void request_members(const json& data)
+    {
+      auto guild_id = data["guild_id"];
+      auto members = json::array();
+
+      if (data.count("user_ids") && data["user_ids"].is_array())
+      {
+        for (auto& id : data["user_ids"])
+        {
+          auto index = std::stoull(id.get<std::string>()) - Fixtures::UserBase;
+
+          if (index < Settings.members)
+          {
+            members.push_back(Fixtures::make_member(index));
+          }
+        }
+      }
+      else
+      {
+        auto query = data.count("query") ? data["query"].get<std::string>() : "";
+        auto limit = data.count("limit") ? data["limit"].get<uint32_t>() : 0;
+
+        for (uint32_t m = 0; m < Settings.members && (limit == 0 || members.size() < limit); ++m)
+        {
+          //  Usernames are the ones Fixtures::make_user gives.
+          if (("member" + std::to_string(m)).compare(0, query.size(), query) == 0)
+          {
+            members.push_back(Fixtures::make_member(m));
+          }
+        }
+      }
+
+      //  Discord sends at most 1000 members in each chunk.
+      auto chunk_count = std::max<size_t>((members.size() + 999) / 1000, 1);
+
+      for (size_t chunk = 0; chunk < chunk_count; ++chunk)
+      {
+        auto first = members.begin() + std::min(chunk * 1000, members.size());
+        auto last = members.begin() + std::min((chunk + 1) * 1000, members.size());
+
+        json payload =
+        {
+          { "guild_id", guild_id },
+          { "members", json(std::vector<json>(first, last)) },
+          { "chunk_index", chunk },
+          { "chunk_count", chunk_count }
+        };
+
+        if (data.count("nonce"))
+        {
+          payload["nonce"] = data["nonce"];
+        }
+
+        send(Dispatch, payload, "GUILD_MEMBERS_CHUNK");
+      }
+    }
+  public:
+    GatewaySession(int fd, Reader& reader) : m_fd(fd), m_reader(reader) {}
+
+    ~GatewaySession()
+    {
+      {
+        std::lock_guard<std::mutex> lock(m_open_mutex);
+        m_open = false;
+      }
+
+      m_closed.notify_all();
+
+      for (auto& thread : m_threads)
+      {
+        thread.join();
+      }
+
+      if (!m_session_id.empty())
+      {
+        std::lock_guard<std::mutex> lock(SessionsMutex);
+        Sessions[m_session_id] = m_sequence;
+      }
+    }
+
+    void run()
+    {
+      send(Hello, { { "heartbeat_interval", Settings.heartbeat_interval }, { "_trace", { "discord-mock" } } });
+
+      uint8_t opcode;
+      std::string payload;
+
+      while (read_frame(opcode, payload))
+      {
+        if (opcode == 0x8)
+        {
+          //  Echo the close code back, then the connection is done.
+          std::lock_guard<std::mutex> lock(m_write_mutex);
+          send_frame(0x8, payload.substr(0, 2));
+          break;
+        }
+
+        if (opcode == 0x9)
+        {
+          std::lock_guard<std::mutex> lock(m_write_mutex);
+          send_frame(0xA, payload);
+          continue;
+        }
+
+        if (opcode != 0x1 && opcode != 0x2)
+        {
+          continue;
+        }
+
+        json packet;
+
+        try
+        {
+          packet = json::parse(payload);
+        }
+        catch (const std::exception&)
+        {
+          //  Discord closes with 4002 when it can't decode a payload.
+          std::lock_guard<std::mutex> lock(m_write_mutex);
+          send_frame(0x8, std::string("\x0F\xA2", 2) + "Decode error");
+          break;
+        }
+
+        switch (packet["op"].get<int>())
+        {
+        case Heartbeat:
+          send(HeartbeatAck, nullptr);
+          break;
+        case Identify:
+          identify(packet["d"]);
+          break;
+        case Resume:
+          resume(packet["d"]);
+          break;
+        case RequestMembers:
+          request_members(packet["d"]);
+          break;
+        default:
+          break;
+        }
+      }
+    }
+  };
+
+  void handle_connection(int fd)
+  {
+    Reader reader(fd);
+    HttpRequest request;
+
+    while (read_request(reader, request))
+    {
+      auto upgrade = request.headers.find("upgrade");
+
+      if (upgrade != std::end(request.headers) && (upgrade->second == "websocket" || upgrade->second == "WebSocket"))
+      {
+        auto key = request.headers.find("sec-websocket-key");
+
+        if (key == std::end(request.headers))
+        {
+          write_response(fd, 400, "Bad Request", {}, "");
+          break;
+        }
+
+        auto accepted = write_response(fd, 101, "Switching Protocols",
+        {
+          { "Upgrade", "websocket" },
+          { "Connection", "Upgrade" },
+          { "Sec-WebSocket-Accept", accept_key(key->second) }
+        }, "");
+
+        if (accepted)
+        {
+          Connections++;
+          GatewaySession(fd, reader).run();
+          Connections--;
+        }
+
+        break;
+      }
+
+      if (!handle_rest(fd, request))
+      {
+        break;
+      }
+    }
+
+    close(fd);
+  }
+
+  bool parse_options(int argc, char* argv[])
+  {
+    std::map<std::string, uint32_t*> numbers =
+    {
+      { "--guilds", &Settings.guilds },
+      { "--members", &Settings.members },
+      { "--channels", &Settings.channels },
+      { "--heartbeat-interval", &Settings.heartbeat_interval },
+      { "--bucket-limit", &Settings.bucket_limit },
+      { "--bucket-window", &Settings.bucket_window },
+      { "--global-limit", &Settings.global_limit },
+      { "--reconnect-after", &Settings.reconnect_after },
+      { "--event-rate", &Settings.event_rate }
+    };
+
+    for (int i = 1; i < argc; ++i)
+    {
+      std::string option = argv[i];
+
+      if (option == "--no-compress")
+      {
+        Settings.compress = false;
+      }
+      else if (option == "--port" && i + 1 < argc)
+      {
+        Settings.port = static_cast<uint16_t>(std::stoul(argv[++i]));
+      }
+      else if (numbers.count(option) && i + 1 < argc)
+      {
+        *numbers[option] = static_cast<uint32_t>(std::stoul(argv[++i]));
+      }
+      else
+      {
+        std::cerr << "Unknown option " << option << std::endl;
+        return false;
+      }
+    }
+
+    return true;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  if (!parse_options(argc, argv))
+  {
+    return 1;
+  }
+
+  auto listener = socket(AF_INET, SOCK_STREAM, 0);
+  int enable = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(Settings.port);
+
+  if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 128) != 0)
+  {
+    std::cerr << "Could not listen on port " << Settings.port << ": " << strerror(errno) << std::endl;
+    return 1;
+  }
+
+  std::cout << "Mock Discord listening on http://127.0.0.1:" << Settings.port << "/api/v6 with "
+            << Settings.guilds << " guilds of " << Settings.members << " members." << std::endl;
+
+  std::thread([]()
+  {
+    uint64_t last_requests = 0;
+    uint64_t last_events = 0;
+
+    for (;;)
+    {
+      std::this_thread::sleep_for(std::chrono::seconds(5));
+
+      uint64_t requests = Requests;
+      uint64_t events = Events;
+
+      std::cout << "requests/s: " << (requests - last_requests) / 5 << ", rate limited: " << RateLimited
+                << ", connections: " << Connections << ", events/s: " << (events - last_events) / 5 << std::endl;
+
+      last_requests = requests;
+      last_events = events;
+    }
+  }).detach();
+
+  for (;;)
+  {
+    auto client = accept(listener, nullptr, nullptr);
+
+    if (client < 0)
+    {
+      continue;
+    }
+
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    std::thread(handle_connection, client).detach();
+  }
+}
@@ -0,0 +1,62 @@
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sys/resource.h>
+
+#include "bot.h"
+#include "gateway.h"
+
+//  Plays a gateway recording through a bot offline and reports how fast it was handled.
+//
+//    libdiscord_replay <recording> [--real-time]
+//
+//  Record a session by setting "gateway_recording" in a bot's settings. By default frames are fed as
+//  fast as possible to measure throughput. --real-time keeps the recorded gaps to measure latency under
+//  the original load.
+int main(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: " << argv[0] << " <recording> [--real-time]" << std::endl;
+    return 1;
+  }
+
+  bool real_time = argc > 2 && strcmp(argv[2], "--real-time") == 0;
+
+  //  Keep logging from skewing the numbers.
+  el::Loggers::reconfigureAllLoggers(el::ConfigurationType::Enabled, "false");
+
+  auto bot = Discord::Bot::create(std::string("replay"));
+
+  auto start = std::chrono::steady_clock::now();
+  auto frames = bot->replay_gateway(argv[1], real_time);
+  auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  if (frames == 0)
+  {
+    std::cerr << "No frames were replayed from " << argv[1] << "." << std::endl;
+    return 1;
+  }
+
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "Frames:        " << frames << std::endl;
+  std::cout << "Elapsed:       " << elapsed * 1000 << " ms" << std::endl;
+  std::cout << "Throughput:    " << frames / elapsed << " frames/s" << std::endl;
+  std::cout << "Peak RSS:      " << usage.ru_maxrss / 1024.0 << " MB" << std::endl;
+  std::cout << std::endl;
+
+  std::cout << std::left << std::setw(32) << "Event" << std::right << std::setw(10) << "Count"
+            << std::setw(12) << "Mean ms" << std::setw(12) << "p50 ms" << std::setw(12) << "p99 ms" << std::endl;
+
+  for (auto& event : bot->event_stats())
+  {
+    std::cout << std::left << std::setw(32) << event.name << std::right << std::setw(10) << event.count
+              << std::setw(12) << event.mean_ms << std::setw(12) << event.p50_ms << std::setw(12) << event.p99_ms << std::endl;
+  }
+
+  return 0;
+}
@@ -75,12 +75,14 @@ namespace Discord
       Snowflake m_major;
       std::string m_key;
       std::string m_endpoint;
+      std::string m_route;    //  The endpoint with ids replaced, such as "/channels/{id}/messages".
     public:
       APICall() {};
       APICall(Snowflake major) : m_major(major) {};
       APICall& operator<<(const Snowflake& id)
       {
         m_endpoint += "/" + id.to_string();
+        m_route += "/{id}";
         m_key += "id";
 
         return *this;
@@ -89,6 +91,7 @@ namespace Discord
       APICall& operator<<(const std::string& value)
       {
         m_endpoint += "/" + value;
+        m_route += "/" + value;
         m_key += value;
         return *this;
       }
@@ -98,6 +101,11 @@ namespace Discord
         return m_endpoint;
       }
 
+      const std::string& route() const
+      {
+        return m_route;
+      }
+
       size_t hash() const
       {
         return std::hash<std::string>()(m_key + m_major.to_string());
@@ -105,6 +113,13 @@ namespace Discord
     };
 
     void set_token(std::string token);
+
+    /** Change the URL that every API request is sent to. Useful for testing against a local server.
+
+        @param url The base URL, including the API version, such as "http://127.0.0.1:8080/api/v6".
+     */
+    void set_base_url(std::string url);
+
     std::string get_wss_url();
     nlohmann::json request(APICall& key, RequestType type, nlohmann::json data = {});
   }
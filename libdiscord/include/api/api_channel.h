@@ -9,6 +9,7 @@ namespace Discord
   class Emoji;
   class Invite;
   class Message;
+  class MessageCache;
   class Overwrite;
   class User;
 
@@ -28,6 +29,18 @@ namespace Discord
        */
       void remove_cache(std::shared_ptr<Discord::Channel> channel);
 
+      /** Get the amount of channels in the cache.
+
+          @return The amount of cached channels.
+       */
+      size_t cache_size();
+
+      /** Get the cache of recent messages in each channel.
+
+          @return The recent message cache.
+       */
+      MessageCache& message_cache();
+
       /** Get a channel from either the cache, or the API if it's not already cached.
        
           @param channel_id The id of the channel to retrieve.
@@ -73,7 +86,7 @@ namespace Discord
        */
       std::vector<std::shared_ptr<Message>> get_messages(Snowflake channel_id, int32_t limit = 50, SearchCriteria method = SearchCriteria::None, Snowflake pivot = 0);
 
-      /** Get a single message from a channel.
+      /** Get a single message from a channel. Recently seen messages are returned from the message cache.
        
           @param channel_id The channel to get the message from.
           @param message_id The message to get.
@@ -82,11 +95,15 @@ namespace Discord
       std::shared_ptr<Message> get_message(Snowflake channel_id, Snowflake message_id);
 
       /** Creates a message and sends it to the channel.
+
+          Content longer than 2000 characters is split on line or word boundaries and
+          sent as several messages in order, with any embed attached to the last one.
        
           @param channel_id The channel to send the message to.
           @param content The content of the message.
           @param tts Whether or not this message should be text-to-speech.
-          @return The message that was sent.
+          @param embed An optional embed to send with the message.
+          @return The message that was sent, or the last part if the content was split.
        */
       std::shared_ptr<Message> create_message(Snowflake channel_id, std::string content, bool tts = false, std::shared_ptr<Embed> embed = nullptr);
 
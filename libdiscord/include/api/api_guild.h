@@ -8,6 +8,7 @@ namespace Discord
   class Channel;
   class Guild;
   class GuildEmbed;
+  struct GuildMemory;
   class Integration;
   class Invite;
   class Member;
@@ -21,7 +22,7 @@ namespace Discord
   {
     namespace Guild
     {
-      /** Updates the values of a Guild object in the cache.
+      /** Updates the values of a Guild object in the cache, and adds its channels to the channel cache.
          
          @param guild A shared pointer to the guild to update.
        */
@@ -39,6 +40,19 @@ namespace Discord
       */
       void remove_cache(std::shared_ptr<Discord::Guild> guild);
 
+      /** Get the amount of guilds in the cache.
+
+          @return The amount of cached guilds.
+      */
+      size_t cache_size();
+
+      /** Get the approximate memory held by every cached guild together. Each guild keeps its own
+          figures up to date, so this only visits the guilds and not their members.
+
+          @return The memory held by all cached guilds.
+      */
+      Discord::GuildMemory cache_memory();
+
       /** Sets a Guild's unavailable flag.
 
           @param guild_id A Snowflake set to the guild's id.
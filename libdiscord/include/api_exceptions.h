@@ -109,4 +109,21 @@ namespace Discord
       return m_msg.c_str();
     }
   };
+
+  /** Used when a handler's CancellationToken was cancelled, such as by the handler watchdog. Thrown
+      by REST calls the handler makes after that point so it stops instead of holding a rate limit bucket.
+   */
+  class CancelledException : public DiscordException
+  {
+  public:
+    explicit CancelledException(const char* message) : DiscordException(message) {}
+
+    explicit CancelledException(const std::string& message) : DiscordException(message) {}
+
+    virtual ~CancelledException() throw () {}
+
+    virtual const char* what() const throw () override {
+      return m_msg.c_str();
+    }
+  };
 }
\ No newline at end of file
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "common.h"
+
+namespace Discord
+{
+  class Guild;
+  class Message;
+
+  /** A single message as stored in an archive. */
+  struct ArchivedMessage
+  {
+    Snowflake id;
+    Snowflake author_id;
+    std::string content;
+  };
+
+  /** Statistics from an archive run. */
+  struct ArchiveStats
+  {
+    size_t channels = 0;
+    size_t messages = 0;
+    size_t bytes = 0;
+    double seconds = 0;
+
+    /** Get the throughput of the archive run.
+
+        @return The amount of messages archived per second.
+     */
+    double messages_per_second() const;
+  };
+
+  /** Archives the message history of guilds into a compact binary format on disk.
+
+      Every channel gets two append-only files in the archive directory:
+
+      - <channel_id>.log holds one record per message in ascending id order:
+        id (u64), author id (u64), content length (u32), content bytes.
+      - <channel_id>.idx holds one entry per message: id (u64), offset into the log (u64).
+
+      All integers are little endian. Archiving a channel again only requests messages
+      newer than the last id in its index, so interrupted runs can simply be restarted.
+      Before a channel is archived again, whatever an interrupted run left half written is
+      trimmed from both files and any complete records missing from the index are added.
+   */
+  class Archiver
+  {
+    std::string m_directory;
+    size_t m_concurrency;
+
+    std::string log_path(Snowflake channel_id) const;
+    std::string index_path(Snowflake channel_id) const;
+
+    void repair(Snowflake channel_id) const;
+  public:
+    /** Create an archiver that writes into a directory. The directory must already exist.
+
+        @param directory The directory to write archive files into.
+        @param concurrency The most channels archived at the same time.
+     */
+    explicit Archiver(std::string directory, size_t concurrency = 8);
+
+    /** Archive every text channel in a guild. Up to the archiver's concurrency of channels are
+        archived at once since each has its own rate limit bucket.
+
+        @param guild The guild to archive.
+        @return Statistics about the messages that were archived.
+     */
+    ArchiveStats archive(std::shared_ptr<Guild> guild) const;
+
+    /** Archive a single channel, starting after the last message already archived.
+
+        @param channel_id The channel to archive.
+        @return Statistics about the messages that were archived.
+     */
+    ArchiveStats archive_channel(Snowflake channel_id) const;
+
+    /** Get the id of the newest message archived for a channel.
+
+        @param channel_id The channel to look up.
+        @return The newest archived message id, or 0 if nothing was archived yet.
+     */
+    Snowflake last_archived(Snowflake channel_id) const;
+
+    /** Read archived messages back from disk. The index is used to seek past older messages.
+
+        @param channel_id The channel whose archive to read.
+        @param after Only messages with an id greater than this are returned.
+        @return The archived messages in ascending id order.
+     */
+    std::vector<ArchivedMessage> load(Snowflake channel_id, Snowflake after = 0) const;
+  };
+}
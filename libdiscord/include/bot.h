@@ -9,14 +9,44 @@ namespace Discord
 {
   class Channel;
   class Emoji;
+  struct EventStats;
   class Gateway;
   class Guild;
+  class HandlerWatchdog;
+  class Member;
   class MessageEvent;
   class MessageDeletedEvent;
+  class MessageStore;
   class PresenceUpdate;
+  struct RecordedFrame;
   class TypingEvent;
   class User;
 
+  /** Groups of gateway events a bot can subscribe to. Combine them with | and pass them to Bot::set_intents. */
+  namespace Intents
+  {
+    enum : uint32_t
+    {
+      Guilds                 = 1 << 0,   //  Guild, role and channel changes.
+      GuildMembers           = 1 << 1,   //  Members joining, leaving or changing. Must be enabled for the bot.
+      GuildBans              = 1 << 2,
+      GuildEmojis            = 1 << 3,
+      GuildIntegrations      = 1 << 4,
+      GuildWebhooks          = 1 << 5,
+      GuildInvites           = 1 << 6,
+      GuildVoiceStates       = 1 << 7,
+      GuildPresences         = 1 << 8,   //  Presence updates. Must be enabled for the bot.
+      GuildMessages          = 1 << 9,
+      GuildMessageReactions  = 1 << 10,
+      GuildMessageTyping     = 1 << 11,
+      DirectMessages         = 1 << 12,
+      DirectMessageReactions = 1 << 13,
+      DirectMessageTyping    = 1 << 14,
+
+      All = (1 << 15) - 1
+    };
+  }
+
   class Bot
   {
     Snowflake m_client_id;
@@ -25,6 +55,17 @@ namespace Discord
     std::shared_ptr<User> m_self;
 
     std::shared_ptr<Gateway> m_gateway;
+    std::shared_ptr<MessageStore> m_message_store;
+
+    std::string m_snapshot_path;
+    std::chrono::seconds m_snapshot_interval;
+    std::chrono::steady_clock::time_point m_last_snapshot;
+    std::future<void> m_snapshot_task;
+    bool m_restored_snapshot;
+    bool m_fully_ready;
+
+    std::string m_trace_path;
+    std::shared_ptr<HandlerWatchdog> m_watchdog;
 
     std::vector<std::shared_ptr<Guild>> m_guilds;
     std::vector<std::shared_ptr<Channel>> m_private_channels;
@@ -41,12 +82,16 @@ namespace Discord
     std::function<void(Emoji)> m_on_emoji_updated;
     std::function<void(TypingEvent)> m_on_typing;
     std::function<void(PresenceUpdate)> m_on_presence;
+    std::function<void()> m_on_ready;
 
     std::map<std::string, std::function<void(MessageEvent)>> m_commands;
 
     void update_emojis(nlohmann::json data);
+    void restore_cache_snapshot();
+    void start_cache_snapshot();
   public:
     explicit Bot();
+    ~Bot();
 
     /** Used to create a Bot. Should be used over constructor.
     
@@ -86,7 +131,7 @@ namespace Discord
 
     /** Get the Bot's user profile.
      
-        @return The Bot's user profile.
+        @return The Bot's user profile, or nullptr before the gateway has connected.
      */
     std::shared_ptr<User> profile() const;
 
@@ -98,7 +143,7 @@ namespace Discord
 
     /** Get the Bot's invite url.
      
-        @return The Bot's invite url.
+        @return The Bot's invite url, or an empty string before the gateway has connected.
      */
     std::string invite_url() const;
 
@@ -108,9 +153,166 @@ namespace Discord
      */
     std::vector<std::shared_ptr<Guild>> guilds() const;
 
+    /** Get the gateway's latency, measured from the last heartbeat to its ACK.
+
+        @return The gateway latency, or zero if no heartbeat was ACKed yet.
+     */
+    std::chrono::microseconds latency() const;
+
+    /** Get how long each type of gateway event took from arriving to being handled.
+
+        @return The statistics of each event type that has been received.
+     */
+    std::vector<EventStats> event_stats() const;
+
+    /** Record every frame from the gateway to a file, which can be played back later with
+        replay_gateway. Can also be set with the "gateway_recording" setting.
+
+        @param path The file to record to. An empty path stops recording.
+     */
+    void set_gateway_recording(std::string path);
+
+    /** Play back a gateway recording through the bot as if it was connected. Only dispatched events
+        are replayed. Used to measure event handling offline, so the bot should not be running.
+
+        @param path The recording made with set_gateway_recording.
+        @param real_time Whether to keep the original time between frames, or replay as fast as possible.
+        @return The amount of frames replayed, once every one has been handled.
+     */
+    size_t replay_gateway(std::string path, bool real_time = false);
+
+    /** Play back frames through the bot as if they came from the gateway, such as frames made up by
+        a load generator rather than recorded.
+
+        @param frames The frames to play back. Each frame's offset is when to send it.
+        @param real_time Whether to send each frame at its offset, or send them as fast as possible.
+        @return The amount of frames replayed, once every one has been handled.
+     */
+    size_t replay_gateway(const std::vector<RecordedFrame>& frames, bool real_time = false);
+
+    /** Request specific members of a guild from the gateway. Useful for large guilds, which
+        only send online members when connecting. The threshold for a large guild can be set
+        with the "large_threshold" setting.
+
+        @code
+        auto members = bot->request_members(guild->id(), { user_id }).get();
+        @endcode
+
+        @param guild_id The guild to request members from.
+        @param user_ids The ids of the members to request.
+        @return A future holding the members that were found once they are loaded into the guild. It
+                holds a DiscordException if the members don't arrive in time or the connection closes.
+     */
+    std::future<std::vector<std::shared_ptr<Member>>> request_members(Snowflake guild_id, std::vector<Snowflake> user_ids) const;
+
+    /** Request members of a guild whose username starts with a string.
+
+        @param guild_id The guild to request members from.
+        @param query The prefix that usernames must start with.
+        @param limit The maximum amount of members to return.
+        @return A future holding the members that were found once they are loaded into the guild.
+     */
+    std::future<std::vector<std::shared_ptr<Member>>> request_members(Snowflake guild_id, std::string query, uint32_t limit) const;
+
+    /** Choose which groups of events the bot receives. Can also be set with the "intents" setting.
+
+        The intents are sent when identifying so Discord doesn't send the other events at all, and
+        any that still arrive are dropped before they are parsed. Guild events are always requested,
+        since the guild cache depends on them.
+
+        @code
+        bot->set_intents(Discord::Intents::Guilds | Discord::Intents::GuildMessages | Discord::Intents::DirectMessages);
+        @endcode
+
+        @param intents The Intents to subscribe to. Intents::All, the default, receives every event.
+     */
+    void set_intents(uint32_t intents);
+
+    /** Collect metrics about the gateway, REST calls and caches, and export them in the Prometheus
+        text format. Can also be set with the "metrics" setting, such as
+        `{ "file": "metrics.prom", "interval": 15, "port": 9100 }`. The metrics can also be read at
+        any time with Metrics::prometheus.
+
+        @param file A file to write the metrics to on an interval, or empty to not write a file.
+        @param interval The time between writes to the file.
+        @param port A loopback port to serve the metrics on at /metrics, or zero to not serve them.
+     */
+    void enable_metrics(std::string file = "", std::chrono::seconds interval = std::chrono::seconds(15), uint16_t port = 0);
+
+    /** Trace a sample of gateway frames from arrival through their event handlers and the REST calls
+        those handlers make. Can also be set with the "trace" setting, such as
+        `{ "sample_rate": 0.01, "file": "trace.json" }`. The trace can be written at any time with
+        Trace::write_chrome_trace.
+
+        @param sample_rate The fraction of frames to trace, from 0 to 1.
+        @param file A file to write the trace to in the Chrome trace format when the bot is destroyed,
+                    or empty to not write one.
+     */
+    void enable_tracing(double sample_rate, std::string file = "");
+
+    /** Flag command and message handlers that run longer than a budget. A flagged handler is logged
+        with its name, guild and how long it has run, and counted in the discord_handler_slow_total
+        metric. Can also be set with the "handler_budget" setting, such as
+        `{ "budget_ms": 5000, "cancel": true }`.
+
+        With cancelling on, the handler's MessageEvent::cancellation token is also cancelled. The
+        handler can check MessageEvent::cancelled between steps, and any REST call it makes from
+        then on throws a CancelledException. How long each handler takes is recorded in the
+        discord_handler_ms metric whether or not a budget is set.
+
+        Should be set before the bot is run.
+
+        @param budget How long a handler may run before it is flagged. Zero stops watching handlers.
+        @param cancel Whether to cancel handlers that are flagged.
+     */
+    void set_handler_budget(std::chrono::milliseconds budget, bool cancel = false);
+
+    /** Keep a local store of every message the bot sees. Can also be enabled with the
+        "message_store" setting, which is the directory to keep the store in.
+
+        @param store The store to keep messages in, or nullptr to stop storing messages.
+     */
+    void set_message_store(std::shared_ptr<MessageStore> store);
+
+    /** Get the local message store.
+
+        @return The message store, or nullptr if messages are not being stored.
+     */
+    std::shared_ptr<MessageStore> message_store() const;
+
+    /** Keep a snapshot of the guild caches so a restarted bot can serve lookups right away instead of
+        waiting for every guild to arrive again. Can also be set with the "cache_snapshot" setting,
+        and "cache_snapshot_interval" sets the seconds between snapshots.
+
+        Any existing snapshot is loaded right away. Guilds from it are updated as GUILD_CREATE
+        arrives, and guilds the bot is no longer in are dropped once READY is received.
+
+        @param path The snapshot file. An empty path stops taking snapshots.
+        @param interval How often to write a snapshot while running.
+     */
+    void set_cache_snapshot(std::string path, std::chrono::seconds interval = std::chrono::seconds(600));
+
+    /** Write a snapshot of the guild caches now. Does nothing if no snapshot file is set.
+        A snapshot is also written when all guilds have loaded and when the bot is destroyed. Periodic
+        snapshots are written on a background thread, and this waits for one that is still running.
+     */
+    void save_cache_snapshot();
+
+    /** Check if guilds were restored from a cache snapshot when the snapshot was set.
+
+        @return Whether the guild caches started out filled from a snapshot.
+     */
+    bool restored_cache_snapshot() const;
+
     /** Called by the Gateway when an event occurs. Should not be called manually. */
     void handle_dispatch(std::string event_name, nlohmann::json data);
 
+    /** Called by the Gateway with a guild from GUILD_CREATE that was already decoded. Should not be called manually. */
+    void handle_guild_create(std::shared_ptr<Guild> guild);
+
+    /** Called by the Gateway once every guild from READY has arrived. Should not be called manually. */
+    void handle_ready();
+
     /** Assign a callback for when a message is received. There may only be one callback at a time.
     
         @code
@@ -179,6 +381,13 @@ namespace Discord
      */
     void on_presence(std::function<void(PresenceUpdate)> callback);
 
+    /** Assign a callback that is called once the bot is connected and every guild it is in has
+        been loaded. Unlike READY, the guild list is complete by the time this is called.
+
+        @param callback The callback to call when the bot is fully ready.
+     */
+    void on_ready(std::function<void()> callback);
+
     /** Add a command to the bot. Requires the bot have a prefix.
      
         @param command The command name without the prefix.
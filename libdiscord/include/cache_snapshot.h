@@ -0,0 +1,114 @@
+#pragma once
+
+#include <chrono>
+
+#include "common.h"
+
+namespace Discord
+{
+  class Guild;
+
+  /** A binary snapshot of the guild caches, used to start with warm caches after a restart.
+
+      The file starts with a header: magic "LDCS", version (u32), creation time in milliseconds since
+      the epoch (u64) and guild count (u32). An index follows with guild id (u64), offset (u64) and
+      length (u32) for each guild, then each guild with its channels, members, roles and emojis
+      encoded as MessagePack. Everything is little-endian.
+
+      Snapshots are memory mapped when loaded, and a guild is only decoded when it is asked for.
+   */
+  class CacheSnapshot
+  {
+    struct Entry
+    {
+      Snowflake guild_id;
+      uint64_t offset;
+      uint32_t length;
+    };
+
+    std::string m_path;
+    std::vector<Entry> m_entries;
+    std::chrono::system_clock::time_point m_created;
+
+#ifdef _WIN32
+    void* m_file;
+    void* m_mapping;
+#else
+    int m_fd;
+#endif
+    const char* m_view;
+    uint64_t m_size;
+
+    bool map();
+    void unmap();
+    std::shared_ptr<Guild> decode(const Entry& entry) const;
+  public:
+    /** Open a snapshot. A missing or invalid file gives an empty snapshot.
+
+        @param path The snapshot file to open.
+     */
+    explicit CacheSnapshot(std::string path);
+    ~CacheSnapshot();
+
+    CacheSnapshot(const CacheSnapshot&) = delete;
+    CacheSnapshot& operator=(const CacheSnapshot&) = delete;
+
+    /** Write a snapshot of guilds. The file is replaced only once the new snapshot is complete.
+
+        Guilds are encoded on several threads, so they must not be changed while this runs.
+
+        @param path The snapshot file to write.
+        @param guilds The guilds to write.
+        @return The size of the snapshot in bytes.
+     */
+    static uint64_t save(std::string path, const std::vector<std::shared_ptr<Guild>>& guilds);
+
+    /** Write a snapshot of guilds that were already copied with copy(). Unlike the other overload
+        this doesn't touch the live guilds, so it can run on a background thread.
+
+        @param path The snapshot file to write.
+        @param guilds The JSON of the guilds to write.
+        @return The size of the snapshot in bytes.
+     */
+    static uint64_t save(std::string path, const std::vector<nlohmann::json>& guilds);
+
+    /** Copy guilds into JSON so they can be written later while the guilds keep changing.
+
+        @param guilds The guilds to copy.
+        @return The JSON of each guild, in the same order.
+     */
+    static std::vector<nlohmann::json> copy(const std::vector<std::shared_ptr<Guild>>& guilds);
+
+    /** Get the amount of guilds in the snapshot.
+
+        @return The amount of guilds.
+     */
+    size_t size() const;
+
+    /** Get when the snapshot was written.
+
+        @return The time the snapshot was written.
+     */
+    std::chrono::system_clock::time_point created() const;
+
+    /** Get the ids of every guild in the snapshot.
+
+        @return The guild ids.
+     */
+    std::vector<Snowflake> guild_ids() const;
+
+    /** Decode one guild from the snapshot. Its channels are added to the channel cache.
+
+        @param guild_id The guild to decode.
+        @return The guild, or nullptr if it is not in the snapshot.
+     */
+    std::shared_ptr<Guild> guild(Snowflake guild_id) const;
+
+    /** Decode every guild in the snapshot, spread across threads. Their channels are added to the
+        channel cache.
+
+        @return The guilds in the snapshot.
+     */
+    std::vector<std::shared_ptr<Guild>> guilds() const;
+  };
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+
+#include "common.h"
+
+namespace Discord
+{
+  /** Lets a long running event handler find out that it should stop.
+
+      The bot gives each message handler a token through MessageEvent::cancellation. The handler
+      watchdog cancels it when the handler runs past its budget. A handler doing long work can check
+      cancelled() between steps, and REST calls made from a cancelled handler throw a
+      CancelledException instead of waiting on a rate limit.
+
+      Copies share the same state, so cancelling any copy cancels them all. A default constructed
+      token can never be cancelled.
+   */
+  class CancellationToken
+  {
+    std::shared_ptr<std::atomic<bool>> m_cancelled;
+  public:
+    CancellationToken() {};
+
+    /** Create a token that can be cancelled.
+
+        @return A new token.
+     */
+    static CancellationToken create();
+
+    /** Ask the work holding this token to stop. Does nothing for a token that can't be cancelled. */
+    void cancel() const;
+
+    /** Check if the token can be cancelled at all.
+
+        @return Whether the token was made with create.
+     */
+    bool can_cancel() const;
+
+    /** Check if the token was cancelled.
+
+        @return Whether the work should stop.
+     */
+    bool cancelled() const;
+
+    /** Throw a CancelledException if the token was cancelled. */
+    void throw_if_cancelled() const;
+
+    /** Get the token of the handler running on the current thread.
+
+        @return The current token, or a token that can't be cancelled outside of a handler.
+     */
+    static const CancellationToken& current();
+  };
+
+  /** Makes a token current on this thread until the scope ends. */
+  class CancellationScope
+  {
+    CancellationToken m_previous;
+  public:
+    explicit CancellationScope(const CancellationToken& token);
+    ~CancellationScope();
+
+    CancellationScope(const CancellationScope&) = delete;
+    CancellationScope& operator=(const CancellationScope&) = delete;
+  };
+}
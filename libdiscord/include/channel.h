@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common.h"
+#include "history.h"
 #include "identifiable.h"
 #include "permission.h"
 
@@ -175,6 +176,12 @@ namespace Discord
     */
     uint32_t user_limit() const;
 
+    /** Get the permission overwrites of this channel.
+
+        @return The channel's permission overwrites.
+    */
+    std::vector<Overwrite> permission_overwrites() const;
+
     /** Set the name of this channel.
      
         NOTE: This has no outside effect unless done within a modify callback.
@@ -263,6 +270,25 @@ namespace Discord
      */
     std::shared_ptr<Message> get_message(Snowflake message_id) const;
 
+    /** Get a lazily loaded range over this channel's messages, from newest to oldest.
+
+        Pages are only requested as the range is iterated, with the next page loaded in the background.
+
+        @code
+        //  Read everything posted since the last message we handled.
+        for (auto& message : channel->history(0, [last_id](std::shared_ptr<Message> msg) { return msg->id() == last_id; }))
+        {
+          //  Handle message
+        }
+        @endcode
+
+        @param limit The maximum amount of messages to return. If zero, reads the entire history.
+        @param until Iteration stops at the first message this returns true for.
+        @param before Only return messages older than this message id. If zero, starts at the newest message.
+        @return A range of messages in this channel.
+     */
+    MessageHistory history(size_t limit = 0, std::function<bool(std::shared_ptr<Message>)> until = nullptr, Snowflake before = 0) const;
+
     /** Send a message to a channel.
      
         @param content The message to send
@@ -432,4 +458,17 @@ namespace Discord
   {
     channel = Channel(json);
   }
+
+  inline void to_json(nlohmann::json& json, const Channel& channel)
+  {
+    json["id"] = channel.id();
+    json["guild_id"] = channel.guild_id();
+    json["name"] = channel.name();
+    json["type"] = channel.type();
+    json["position"] = channel.position();
+    json["permission_overwrites"] = channel.permission_overwrites();
+    json["topic"] = channel.topic();
+    json["bitrate"] = channel.bitrate();
+    json["user_limit"] = channel.user_limit();
+  }
 }
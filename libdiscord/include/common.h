@@ -31,6 +31,47 @@ namespace Discord
   */
   void write_json_file(std::string file, nlohmann::json json, bool pretty = false);
 
+  /** Count the amount of code points in a UTF-8 string.
+
+      @param str The UTF-8 string to measure.
+      @return The amount of code points in the string.
+   */
+  size_t utf8_length(const std::string& str);
+
+  /** Split content into pieces that each fit within a maximum amount of code points.
+
+      Splits are made on newlines where possible, then on whitespace. Code blocks that
+      span a split are closed at the end of one piece and reopened at the start of the next.
+
+      @param content The UTF-8 content to split.
+      @param max_length The maximum amount of code points in each piece.
+      @return The pieces in the order they should be sent.
+   */
+  std::vector<std::string> split_message(const std::string& content, size_t max_length);
+
+  /** Decompress a zlib stream, such as a compressed gateway payload.
+
+      @param compressed The compressed bytes.
+      @return The decompressed data. Errors are logged and whatever was decompressed is returned.
+   */
+  std::string zlib_inflate(const std::string& compressed);
+
+  /** Append an unsigned integer in little-endian byte order, as the binary file formats store them.
+
+      @param out The buffer to append to.
+      @param value The value to write.
+      @param size How many bytes of the value to write.
+   */
+  void write_le(std::string& out, uint64_t value, size_t size);
+
+  /** Read an unsigned little-endian integer.
+
+      @param data The bytes to read from.
+      @param size How many bytes the integer takes up.
+      @return The value that was read.
+   */
+  uint64_t read_le(const char* data, size_t size);
+
   /** Set a variable from a json payload, or give it a default value if the key doesn't exist.
    
       @param var The variable to assign the value to.
@@ -38,9 +79,27 @@ namespace Discord
       @param data The JSON payload to look in.
    */
   template <typename T, typename U>
-  void set_from_json(T& var, U key, nlohmann::json data)
+  void set_from_json(T& var, U key, const nlohmann::json& data)
   {
-    var = (!data.count(key) || data[key].is_null()) ? T() : data[key].template get<T>();
+    auto itr = data.find(key);
+    var = (itr == data.end() || itr->is_null()) ? T() : itr->template get<T>();
+  }
+
+  /** Set a variable from a json payload only if the key exists, otherwise leave it unchanged.
+
+      @param var The variable to assign the value to.
+      @param key The key to grab the new value from.
+      @param data The JSON payload to look in.
+   */
+  template <typename T, typename U>
+  void update_from_json(T& var, U key, const nlohmann::json& data)
+  {
+    auto itr = data.find(key);
+
+    if (itr != data.end())
+    {
+      var = itr->is_null() ? T() : itr->template get<T>();
+    }
   }
 
   /** Allows loading of JSON data into a shared_ptr's underlying type.
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "api_exceptions.h"
+#include "archiver.h"
 #include "bot.h"
 #include "channel.h"
 #include "embed.h"
@@ -8,8 +9,10 @@
 #include "events.h"
 #include "event/event_message.h"
 #include "guild.h"
+#include "history.h"
 #include "member.h"
 #include "message.h"
+#include "message_store.h"
 #include "role.h"
 #include "user.h"
 #include "voice.h"
\ No newline at end of file
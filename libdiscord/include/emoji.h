@@ -40,6 +40,13 @@ namespace Discord
     emoji = Emoji(json);
   }
 
+  inline void to_json(nlohmann::json& json, const Emoji& emoji)
+  {
+    json["id"] = emoji.id();
+    json["name"] = emoji.name();
+    json["roles"] = emoji.roles();
+  }
+
   /** Represents a reaction to a message. */
   class Reaction
   {
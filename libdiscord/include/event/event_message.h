@@ -1,5 +1,6 @@
 #pragma once
 
+#include "cancellation.h"
 #include "common.h"
 #include "identifiable.h"
 
@@ -15,9 +16,11 @@ namespace Discord
   {
     std::stringstream m_stream;
     std::shared_ptr<Message> m_message;
+    std::shared_ptr<Message> m_previous;
+    CancellationToken m_cancellation;
   public:
     explicit MessageEvent(nlohmann::json data);
-    explicit MessageEvent(std::shared_ptr<Message> msg) : m_message(msg) {};
+    explicit MessageEvent(std::shared_ptr<Message> msg, std::shared_ptr<Message> previous = nullptr) : m_message(msg), m_previous(previous) {};
     MessageEvent(const MessageEvent& other);
 
     ~MessageEvent() {
@@ -25,7 +28,16 @@ namespace Discord
       
       if (!str.empty())
       {
-        respond(m_stream.str());
+        //  Throwing out of a destructor would end the program, such as when a cancelled handler
+        //  still has a response buffered.
+        try
+        {
+          respond(m_stream.str());
+        }
+        catch (const std::exception& e)
+        {
+          LOG(ERROR) << "Could not send a buffered response: " << e.what();
+        }
       }
     }
   
@@ -72,6 +84,13 @@ namespace Discord
      */
     std::shared_ptr<Message> message() const;
 
+    /** Get the message as it was before it was edited. Only available for edit events
+        when the message was recent enough to still be in the message cache.
+
+        @return The message before the edit, or nullptr if it is not known.
+     */
+    std::shared_ptr<Message> previous() const;
+
     /** Whether or not this message was sent from a bot.
      
         @return true if this message was sent from a bot.
@@ -83,14 +102,41 @@ namespace Discord
         @return The message that was sent.
      */
     std::shared_ptr<Message> respond(std::string content, bool tts = false) const;
+
+    /** Get the token that tells the handler to stop, such as when it runs past the budget set
+        with Bot::set_handler_budget.
+
+        @return The handler's cancellation token.
+     */
+    const CancellationToken& cancellation() const;
+
+    /** Check if the handler was asked to stop. Long running handlers should check this between steps.
+
+        @return Whether the handler should stop.
+     */
+    bool cancelled() const;
+
+    /** Set the token that tells the handler to stop. Called by the bot before running a handler.
+
+        @param token The handler's cancellation token.
+     */
+    void set_cancellation(CancellationToken token);
   };
 
   class MessageDeletedEvent : public Identifiable
   {
     Snowflake m_channel_id;
+    std::shared_ptr<Message> m_message;
   public:
-    explicit MessageDeletedEvent(Snowflake id, Snowflake channel_id);
-    explicit MessageDeletedEvent(nlohmann::json data);
+    explicit MessageDeletedEvent(Snowflake id, Snowflake channel_id, std::shared_ptr<Message> message = nullptr);
+    explicit MessageDeletedEvent(nlohmann::json data, std::shared_ptr<Message> message = nullptr);
+
+    /** Get the message that was deleted. Only available when the message was recent
+        enough to still be in the message cache, or is kept in the bot's message store.
+
+        @return The deleted message, or nullptr if it is not known.
+     */
+    std::shared_ptr<Message> message() const;
 
     /** Get the channel this message was deleted from.
 
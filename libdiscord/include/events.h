@@ -70,6 +70,24 @@ namespace Discord
         @return A shared pointer to the user.
       */
     std::shared_ptr<User> user() const;
+
+    /** Get the ids of the roles the user has.
+
+        @return A list of role ids.
+     */
+    std::vector<Snowflake> roles() const;
+
+    /** Get the game the user is playing.
+
+        @return The user's game.
+     */
+    Game game() const;
+
+    /** Get the user's status, such as "online" or "idle".
+
+        @return The user's status.
+     */
+    std::string status() const;
   };
 
   inline void from_json(const nlohmann::json& json, PresenceUpdate& presence)
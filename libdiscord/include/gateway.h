@@ -1,18 +1,64 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
 #include <cpprest/ws_client.h>
+#include <deque>
+#include <future>
+#include <random>
+#include <set>
 #include <thread>
 
 #include "common.h"
+#include "histogram.h"
+#include "metrics.h"
+#include "spsc_ring.h"
+#include "trace.h"
 
 namespace Discord
 {
   class Bot;
+  class GatewayRecorder;
+  class Guild;
+  class Member;
+  struct RecordedFrame;
+
+  /** Statistics for one stage of the gateway's receive pipeline. */
+  struct PipelineStage
+  {
+    std::string name;
+    size_t depth;         //  Messages waiting for this stage right now.
+    size_t max_depth;     //  The most messages that have waited for this stage at once.
+    uint64_t messages;    //  Messages that have passed through this stage.
+    double mean_ms;       //  Time from entering the stage's queue to leaving the stage.
+    double p50_ms;
+    double p99_ms;
+  };
+
+  /** Statistics for the handling of one type of gateway event. */
+  struct EventStats
+  {
+    std::string name;
+    uint64_t count;
+    double mean_ms;       //  Time from the frame arriving to the end of its dispatch.
+    double p50_ms;
+    double p99_ms;
+  };
 
   class Gateway
   {
     //  Constants
-    static const uint8_t LARGE_SERVER;
+    static const uint32_t LARGE_SERVER;
+    static const size_t MAX_MEMBER_REQUEST_IDS;
+    static const uint32_t MEMBER_REQUEST_TIMEOUT;
+    static const size_t MAX_DECODERS;
+    static const size_t RECEIVE_QUEUE_SIZE;
+    static const uint32_t HELLO_TIMEOUT;
+    static const uint32_t RECONNECT_BASE_DELAY;
+    static const uint32_t RECONNECT_MAX_DELAY;
+    static const int64_t SESSION_MAX_AGE;
+    static const size_t SEND_LIMIT;
+    static const uint32_t SEND_WINDOW;
     static const utility::string_t VERSION;
     static const utility::string_t ENCODING;
 
@@ -25,13 +71,157 @@ namespace Discord
     //  Heartbeat variables
     std::thread m_heartbeat_thread;
     uint32_t m_heartbeat_interval;
-    bool m_recieved_ack;
+    std::atomic<bool> m_recieved_ack;
+    bool m_heartbeat_running;
+    std::mutex m_heartbeat_mutex;
+    std::condition_variable m_heartbeat_wakeup;
+    std::chrono::steady_clock::time_point m_heartbeat_sent;
+    std::atomic<int64_t> m_latency_us;
+    Histogram m_latency_histogram;
 
     //  Session variables
     uint32_t m_last_seq;
     std::string m_session_id;
-    volatile bool m_connected;
+    std::mutex m_session_mutex;       //  Guards m_last_seq and m_session_id, which several threads use.
+    std::atomic<bool> m_connected;
     bool m_use_resume;
+    std::string m_session_file;
+    std::mutex m_session_file_mutex;
+
+    //  Reconnect variables
+    enum class Action
+    {
+      None,
+      Connect,
+      Reidentify,
+      Stop
+    };
+
+    Action m_action;
+    bool m_stopped;
+    std::mutex m_state_mutex;
+    std::condition_variable m_state_changed;
+    std::thread m_reconnect_thread;
+    std::atomic<uint64_t> m_connection_id;  //  Callbacks from older connections are ignored.
+    uint32_t m_reconnect_attempts;
+    bool m_reconnecting;
+    std::chrono::steady_clock::time_point m_disconnect_time;
+    std::atomic<int64_t> m_time_to_resume_ms;
+    std::mt19937 m_rng;
+
+    //  Member variables
+    uint32_t m_large_threshold;
+
+    //  Event filter variables
+    std::atomic<uint32_t> m_intents;
+    std::atomic<uint64_t> m_filtered_events;
+
+    struct MemberRequest
+    {
+      std::promise<std::vector<std::shared_ptr<Member>>> promise;
+      std::vector<std::shared_ptr<Member>> members;
+      std::set<Snowflake> user_ids;   //  Empty for query requests, which take every member sent.
+      size_t outstanding;             //  Packets whose last chunk hasn't arrived.
+      size_t unsent = 0;              //  Packets still waiting in the send queue.
+      bool finished = false;
+
+      //  Set once every packet is sent and moved forward as chunks arrive, so queued requests don't expire.
+      std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    };
+
+    //  Requests waiting for GUILD_MEMBERS_CHUNK, keyed by the nonce sent with them. Requests for ids
+    //  in the same guild can share a packet, and so a nonce.
+    std::map<std::string, std::vector<std::shared_ptr<MemberRequest>>> m_member_requests;
+    std::mutex m_member_request_mutex;
+    uint64_t m_next_nonce;
+
+    //  Startup variables
+    struct Timings
+    {
+      double inflate_ms = 0;
+      double parse_ms = 0;
+      double decode_ms = 0;
+      double process_ms = 0;
+    };
+
+    struct Frame
+    {
+      nlohmann::json payload;
+      std::shared_ptr<Guild> guild;   //  Decoded ahead of time for GUILD_CREATE while loading guilds.
+      bool valid = false;             //  Parsed to an object with an opcode.
+      bool filtered = false;          //  Dropped before parsing. Only the sequence number is kept.
+      uint8_t op = 0;
+      uint32_t sequence = 0;
+      Timings timings;
+    };
+
+    //  Receive variables
+    struct Message
+    {
+      std::string data;
+      bool compressed = false;
+      std::future<Frame> frame;   //  Set by the parse stage. Only ready later if it is decoded on a worker.
+      Timings timings;
+      std::chrono::steady_clock::time_point received;
+      std::chrono::steady_clock::time_point queued;
+      std::chrono::steady_clock::time_point dequeued;   //  Only set for traced messages.
+      uint64_t trace = 0;                               //  The Trace id, or zero if not sampled.
+    };
+
+    //  Messages flow from the socket through inflate, parse and dispatch, each on its own thread.
+    struct Stage
+    {
+      std::string name;
+      SpscRing<Message> queue;
+      Histogram latency;
+      std::atomic<size_t> max_depth;
+      std::thread thread;
+
+      explicit Stage(std::string name);
+      void enqueue(Message message);
+      void record(const Message& message);
+    };
+
+    Stage m_inflate_stage;
+    Stage m_parse_stage;
+    Stage m_dispatch_stage;
+    Histogram m_receive_latency;
+
+    //  Receive latency of each dispatch event type.
+    std::map<std::string, Histogram> m_event_latency;
+    mutable std::mutex m_event_latency_mutex;
+
+    //  Registry metrics for each dispatch event type, so the registry isn't searched per event. Only
+    //  used by the dispatch stage.
+    struct EventMetrics
+    {
+      Counter* received;
+      Histogram* handler;
+    };
+
+    std::map<std::string, EventMetrics> m_event_metrics;
+
+    //  Frames that entered the pipeline and frames that have been fully handled.
+    std::atomic<uint64_t> m_received_messages;
+    std::atomic<uint64_t> m_finished_messages;
+
+    //  Recording and replay variables
+    std::shared_ptr<GatewayRecorder> m_recorder;
+    std::mutex m_recorder_mutex;
+    std::atomic<bool> m_replaying;
+
+    //  While guilds are loading, payloads are parsed on workers and dispatched in order.
+    std::mutex m_decoder_mutex;
+    std::condition_variable m_decoder_available;
+    size_t m_active_decoders;
+
+    //  Guilds listed in READY that have not had their GUILD_CREATE yet.
+    std::set<Snowflake> m_loading_guilds;
+    std::atomic<bool> m_loading;
+    std::chrono::steady_clock::time_point m_connect_time;
+    std::chrono::steady_clock::time_point m_ready_time;
+    Timings m_loading_timings;
+    size_t m_loaded_guilds;
 
     //  Owning bot
     std::weak_ptr<Bot> m_bot;
@@ -53,17 +243,70 @@ namespace Discord
       Heartbeat_ACK
     };
 
+    //  Outbound variables
+    enum Priority : uint8_t
+    {
+      Critical = 0, //  Heartbeats, Identify and Resume
+      Normal,
+      Bulk,         //  Member requests
+      PriorityCount
+    };
+
+    struct Packet
+    {
+      Opcode op;
+      nlohmann::json data;
+    };
+
+    //  Every packet is written by one thread, which keeps within the gateway's send limit.
+    std::deque<Packet> m_send_queues[PriorityCount];
+    std::deque<std::chrono::steady_clock::time_point> m_sent_times;
+    std::mutex m_send_mutex;
+    std::condition_variable m_send_ready;
+    std::thread m_send_thread;
+    bool m_send_stopped;
+
     //  Private methods
-    void connect();
+    void reconnect_loop();
+    bool open_connection();
+    void abandon_connection();
+    void on_close(web::websockets::client::websocket_close_status status, const utility::string_t& reason, const std::error_code& code);
+    void session_established(bool resumed);
+    void load_session();
+    void save_session();
+    void set_sequence(uint32_t sequence);
     void on_message(web::websockets::client::websocket_incoming_message);
-    void handle_dispatch_event(std::string event_name, nlohmann::json data);
+    void inflate_loop();
+    void parse_loop();
+    void dispatch_loop();
+    Frame parse_frame(const std::string& text, uint64_t trace = 0) const;
+    bool is_filtered(const std::string& text, uint32_t& sequence);
+    static utility::string_t url_query();
+    void receive(Message message);
+    void start_pipeline();
+    void dispatch_message(Message& message);
+    void process_frame(Frame& frame);
+    void handle_heartbeat_ack();
+    void handle_dispatch_event(std::string event_name, nlohmann::json data, std::shared_ptr<Guild> guild = nullptr);
+    void guild_loaded(Snowflake guild_id);
     void send(Opcode op, nlohmann::json packet);
+    void send_loop();
+    void write_packet(const Packet& packet);
+    size_t reserved_sends() const;
+    void start_heartbeat();
+    void stop_heartbeat();
+    void heartbeat_loop();
     void send_heartbeat();
+    void reconnect(const utility::string_t& reason);
     void send_identify();
     void send_resume();
+    void handle_members_chunk(nlohmann::json data);
+    void member_request_sent(const std::string& nonce);
+    void fail_member_requests(std::chrono::steady_clock::time_point cutoff, const std::string& reason);
   public:
     Gateway();
     explicit Gateway(std::string token);
+    ~Gateway();
 
     /** Sets the bot that this gateway will call for events.
      
@@ -71,7 +314,118 @@ namespace Discord
      */
     void set_bot(std::weak_ptr<Bot> bot);
 
-    /** Start a gateway connection. */
+    /** Sets the gateway URL to connect to, instead of asking the API for it. Useful for connecting
+        to a local test server.
+
+        @param url The gateway URL, such as "ws://127.0.0.1:8080". An empty URL asks the API again.
+     */
+    void set_url(std::string url);
+
+    /** Keep the session in a file so that a restarted process can resume it instead of identifying
+        again. The file is written when a session starts, with every heartbeat and on shutdown.
+
+        A resumed session only replays the events that were missed, so guilds are not sent again.
+        The saved session is only resumed when the bot restored its guilds from a cache snapshot,
+        since it would otherwise have none. A URL set with set_url is used over the saved one.
+
+        @param path The file to keep the session in. An empty path turns this off.
+     */
+    void set_session_file(std::string path);
+
+    /** Sets the member count at which guilds stop sending offline members on connect.
+        Members of those guilds can be loaded as needed with request_members.
+
+        @param threshold The large guild threshold. Must be between 50 and 250.
+     */
+    void set_large_threshold(uint32_t threshold);
+
+    /** Sets which groups of events to receive. Dispatches outside of them are dropped before being
+        parsed, and the intents are sent with Identify so Discord can skip sending them.
+
+        @param intents The Intents to subscribe to. Intents::All receives everything, and doesn't
+                       send any intents so Discord uses its defaults.
+     */
+    void set_intents(uint32_t intents);
+
+    /** Get the amount of events dropped by the intents filter.
+
+        @return The amount of events that were not parsed because nothing subscribed to them.
+     */
+    uint64_t filtered_events() const;
+
+    /** Request specific members of a guild.
+
+        The future is resolved once every GUILD_MEMBERS_CHUNK for the request has arrived and the
+        members are in the guild's member list. Ids that are not members are left out of the result.
+        It holds a DiscordException instead if no chunk arrives within MEMBER_REQUEST_TIMEOUT of the
+        request being sent, or if the connection closes after it was sent. Requests still waiting to
+        be sent go out on the next connection.
+
+        @param guild_id The guild to request members from.
+        @param user_ids The ids of the members to request.
+        @return A future holding the members that were found.
+     */
+    std::future<std::vector<std::shared_ptr<Member>>> request_members(Snowflake guild_id, std::vector<Snowflake> user_ids);
+
+    /** Request members of a guild whose username starts with a string.
+
+        @param guild_id The guild to request members from.
+        @param query The prefix that usernames must start with. An empty query requests every member.
+        @param limit The maximum amount of members to return. Zero means no limit when the query is empty.
+        @return A future holding the members that were found, which fails the same way as a request by ids.
+     */
+    std::future<std::vector<std::shared_ptr<Member>>> request_members(Snowflake guild_id, std::string query, uint32_t limit = 0);
+
+    /** Get the round trip time of the last heartbeat.
+
+        @return The time between the last heartbeat and its ACK, or zero if none was ACKed yet.
+     */
+    std::chrono::microseconds latency() const;
+
+    /** Get every heartbeat round trip time recorded since the gateway was created.
+
+        @return A histogram of heartbeat latencies in milliseconds.
+     */
+    const Histogram& latency_histogram() const;
+
+    /** Get queue and latency statistics for each stage of the receive pipeline: inflate, parse and
+        dispatch, followed by the whole path from the socket to the end of dispatch.
+
+        @return The statistics of each stage.
+     */
+    std::vector<PipelineStage> pipeline_stats() const;
+
+    /** Get how long it took to get a working session back after the last disconnect.
+
+        @return The time from the connection closing to RESUMED or READY, or zero if the gateway has
+                not reconnected yet.
+     */
+    std::chrono::milliseconds time_to_resume() const;
+
+    /** Get how long each type of event took from arriving to being handled.
+
+        @return The statistics of each event type that has been received, ordered by name.
+     */
+    std::vector<EventStats> event_stats() const;
+
+    /** Write every frame received to a file, exactly as it arrived. The recording can be played back
+        with replay to measure event handling without a connection.
+
+        @param path The file to record to. An empty path stops recording.
+     */
+    void set_recording(std::string path);
+
+    /** Feed recorded frames through the receive pipeline as if they came from the socket. Only
+        dispatches are handled, since the recorded connection itself no longer exists. Should not be
+        used on a gateway that was started.
+
+        @param frames The frames to replay, from GatewayRecorder::load.
+        @param real_time Whether to keep the time between frames as recorded, or send them as fast as possible.
+        @return The amount of frames replayed. Returns once all of them have been handled.
+     */
+    size_t replay(const std::vector<RecordedFrame>& frames, bool real_time = false);
+
+    /** Start a gateway connection. Blocks until the first connection is made. */
     void start();
 
     /** Whether or not this gateway is currently connected.
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+#include <fstream>
+#include <mutex>
+
+#include "common.h"
+
+namespace Discord
+{
+  /** A frame exactly as it arrived from the gateway. */
+  struct RecordedFrame
+  {
+    std::chrono::microseconds offset;   //  Time from the start of the recording.
+    bool compressed;
+    std::string data;
+  };
+
+  /** Writes raw gateway frames to a file so a session can be replayed offline.
+
+      The file starts with "LDGR" and a version (u32). Each frame follows as: offset in microseconds
+      (u64), compressed flag (u8), length (u32), then the bytes as received before inflating.
+   */
+  class GatewayRecorder
+  {
+    std::ofstream m_file;
+    std::chrono::steady_clock::time_point m_start;
+    std::mutex m_mutex;
+  public:
+    /** Start a recording, replacing the file if it exists.
+
+        @param path The file to record to.
+     */
+    explicit GatewayRecorder(std::string path);
+
+    /** Check if the recording file could be opened.
+
+        @return Whether frames are being recorded.
+     */
+    bool is_open() const;
+
+    /** Append a frame to the recording.
+
+        @param data The frame's bytes.
+        @param compressed Whether the frame was a compressed binary message.
+     */
+    void record(const std::string& data, bool compressed);
+
+    /** Load every frame from a recording.
+
+        @param path The recording file.
+        @return The frames in the order they arrived. Empty if the file could not be read.
+     */
+    static std::vector<RecordedFrame> load(std::string path);
+  };
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 #include "common.h"
@@ -53,6 +55,41 @@ namespace Discord
     json = static_cast<int>(level);
   }
 
+  /** The approximate memory held by one kind of cached object. */
+  struct CacheUsage
+  {
+    size_t count = 0;
+    size_t bytes = 0;
+
+    CacheUsage& operator+=(const CacheUsage& other);
+  };
+
+  /** The approximate memory held by a guild, split by what holds it.
+
+      Sizes count each object and the heap data it owns, such as strings and id lists, plus the
+      container entry that holds it. They are estimates meant for finding what drives memory use,
+      not exact allocator figures.
+   */
+  struct GuildMemory
+  {
+    CacheUsage guilds;
+    CacheUsage channels;
+    CacheUsage members;
+    CacheUsage users;
+    CacheUsage presences;
+    CacheUsage roles;
+    CacheUsage emojis;
+    CacheUsage voice_states;
+
+    /** Get the approximate memory held by every cache together.
+
+        @return The total size in bytes.
+     */
+    size_t bytes() const;
+
+    GuildMemory& operator+=(const GuildMemory& other);
+  };
+
   /** Represents a Guild or Server. */
   class Guild : public Identifiable
   {
@@ -75,11 +112,23 @@ namespace Discord
     bool m_large;
     uint32_t m_member_count;
     std::vector<std::shared_ptr<VoiceState>> m_voice_states;
-    std::map<Snowflake, std::shared_ptr<Member>> m_members;
+    std::unordered_map<Snowflake, std::shared_ptr<Member>> m_members;
     std::vector<std::shared_ptr<Channel>> m_channels;
     std::map<Snowflake, std::shared_ptr<PresenceUpdate>> m_presences;
 
     bool m_unavailable;
+
+    //  Kept up to date by every change to the lists above, so reading it never walks the guild.
+    //  The metrics thread reads it while the dispatch thread changes the guild, so it has a lock.
+    GuildMemory m_memory;
+    mutable std::mutex m_memory_mutex;
+
+    void account_member(const std::shared_ptr<Member>& member, bool add);
+    void account_presence(const std::shared_ptr<PresenceUpdate>& presence, bool add);
+    void account_role(const std::shared_ptr<Role>& role, bool add);
+    void account_channel(const std::shared_ptr<Channel>& channel, bool add);
+    void account_emojis();
+    void account_guild();
   public:
     Guild();
     explicit Guild(const nlohmann::json& data);
@@ -90,6 +139,22 @@ namespace Discord
      */
     void merge(std::shared_ptr<Guild> other);
 
+    /** Add the members of another guild object that this one does not have. Large guilds only send
+        online members, so this keeps offline members that were loaded before, such as from a snapshot.
+
+        @param other The guild whose members should be added.
+     */
+    void merge_members(std::shared_ptr<Guild> other);
+
+    /** Get the approximate memory this guild holds in each of its caches.
+
+        The figures are updated as objects are added and removed, so this is cheap to call, and it
+        is safe to call from any thread.
+
+        @return The guild's memory use.
+     */
+    GuildMemory memory() const;
+
     /** Get the name of a Guild
      
         @return The name of the Guild.
@@ -150,13 +215,62 @@ namespace Discord
      */
     uint32_t member_count() const;
 
+    /** Get the hash of a guild's icon.
+
+        @return The guild's icon hash, or an empty string if it has none.
+     */
+    std::string icon() const;
+
+    /** Get the roles of a guild.
+
+        @return A vector of the guild's roles.
+     */
+    std::vector<std::shared_ptr<Role>> roles() const;
+
+    /** Get every loaded member of a guild.
+
+        @return A vector of the members that are loaded.
+     */
+    std::vector<std::shared_ptr<Member>> members() const;
+
+    /** Get when the bot joined a guild.
+
+        @return An ISO8601 timestamp of when the bot joined.
+     */
+    std::string joined_at() const;
+
+    /** Get whether a guild is over the large threshold.
+
+        @return Whether or not the guild is large.
+     */
+    bool large() const;
+
+    /** Get whether a guild is unavailable due to an outage.
+
+        @return Whether or not the guild is unavailable.
+     */
+    bool unavailable() const;
+
     /** Get a user in this guild.
-     
+
+        Only loaded members are looked at, so this never makes a request. Offline members of a large
+        guild have to be loaded with Bot::request_members first.
+
         @param user_id The id of the user to get.
-        @return The user that was found.
+        @return The user that was found, or an empty user if they are not a loaded member of this guild.
      */
     std::shared_ptr<User> get_user(Snowflake user_id) const;
 
+    /** Get a member of this guild.
+
+        Large guilds only send online members when connecting, so a member that was not
+        seen yet can be loaded with Bot::request_members.
+
+        @param user_id The id of the member to get.
+        @return The member, or nullptr if the member is not loaded.
+     */
+    std::shared_ptr<Member> get_member(Snowflake user_id) const;
+
     /** Set the name of this guild.
 
     NOTE: This has no outside effect unless done within a modify callback.
@@ -232,6 +346,15 @@ namespace Discord
     */
     void add_member(std::shared_ptr<Member> member);
 
+    /** Adds every member in a GUILD_MEMBERS_CHUNK member array to the guild's list of members.
+
+        Members are parsed straight into the member list, and members that are already known
+        are replaced with the newer data.
+
+        @param members The JSON array of members from the chunk.
+    */
+    void add_members(const nlohmann::json& members);
+
     /** Removes a member to the guild's list of members.
 
         @param member The member that was removed.
@@ -324,6 +447,12 @@ namespace Discord
      */
     std::vector<std::shared_ptr<Channel>> channels() const;
 
+    /** Get the channels of this guild as they were last seen on the gateway, without calling the API.
+
+        @return The guild's cached channels.
+     */
+    std::vector<std::shared_ptr<Channel>> cached_channels() const;
+
     /** Create a new text channel in this guild.
 
         @param name The name of the new channel.
@@ -350,10 +479,10 @@ namespace Discord
     std::vector<std::shared_ptr<Channel>> reorder_channels(const std::map<Snowflake, uint32_t>& positions) const;
   };
 
-  inline void from_json(const nlohmann::json& json, Guild& guild)
-  {
-    guild = Guild(json);
-  }
+  /** Write a guild along with its channels, members, roles and emojis, in the same form that
+      GUILD_CREATE sends them. Presences and voice states are left out.
+   */
+  void to_json(nlohmann::json& json, const Guild& guild);
 
   class UserGuild : public Identifiable
   {
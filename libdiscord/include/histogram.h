@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace Discord
+{
+  /** A histogram of observed values with fixed bucket bounds, such as latencies in milliseconds.
+
+      Each bucket counts values up to and including its upper bound. Values above the last bound
+      are counted in one final overflow bucket.
+
+      Recording is lock free, so it is cheap enough for hot paths. Reads are not a consistent
+      snapshot while values are being recorded, which is fine for statistics.
+   */
+  class Histogram
+  {
+    std::vector<double> m_bounds;
+    std::unique_ptr<std::atomic<uint64_t>[]> m_counts;
+    std::atomic<uint64_t> m_count;
+    std::atomic<double> m_sum;
+    std::atomic<double> m_max;
+  public:
+    /** Create a histogram.
+
+        @param bounds The upper bound of each bucket, in ascending order.
+     */
+    explicit Histogram(std::vector<double> bounds);
+
+    /** Create bucket bounds that grow by a constant factor.
+
+        @param start The upper bound of the first bucket.
+        @param factor The amount each bound is multiplied by to get the next one.
+        @param count The amount of bounds to create.
+        @return The bucket bounds.
+     */
+    static std::vector<double> exponential_bounds(double start, double factor, size_t count);
+
+    /** Record a value.
+
+        @param value The value to record.
+     */
+    void observe(double value);
+
+    /** Get the upper bound of each bucket.
+
+        @return The bucket bounds, not including the overflow bucket.
+     */
+    std::vector<double> bounds() const;
+
+    /** Get the amount of values in each bucket.
+
+        @return One count per bound, followed by the count of the overflow bucket.
+     */
+    std::vector<uint64_t> counts() const;
+
+    /** Get the amount of values recorded.
+
+        @return The amount of values recorded.
+     */
+    uint64_t count() const;
+
+    /** Get the sum of every value recorded.
+
+        @return The sum of the values.
+     */
+    double sum() const;
+
+    /** Get the mean of every value recorded.
+
+        @return The mean, or zero if nothing was recorded.
+     */
+    double mean() const;
+
+    /** Estimate a percentile from the buckets.
+
+        @param percentile The percentile to get, from 0 to 100.
+        @return The upper bound of the bucket the percentile falls in, or the largest value recorded if
+                it falls in the overflow bucket. Zero if nothing was recorded.
+     */
+    double percentile(double percentile) const;
+  };
+}
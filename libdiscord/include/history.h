@@ -0,0 +1,99 @@
+#pragma once
+
+#include <future>
+#include <iterator>
+
+#include "common.h"
+
+namespace Discord
+{
+  class Message;
+
+  /** A lazily loaded range over a channel's messages, from newest to oldest.
+
+      Messages are requested in pages of 100 only as the range is iterated, and the next
+      page is requested in the background while the current one is being consumed. A range
+      abandoned part-way doesn't wait for that request; it finishes on its own thread and its
+      page is dropped.
+
+      @code
+      for (auto& message : channel->history(10000))
+      {
+        //  Handle message
+      }
+      @endcode
+   */
+  class MessageHistory
+  {
+    static const int32_t PageSize = 100;
+
+    class State
+    {
+      Snowflake m_channel_id;
+      Snowflake m_before;
+      std::function<bool(std::shared_ptr<Message>)> m_until;
+      size_t m_limit;
+      size_t m_count;
+      bool m_started;
+      bool m_last_page;
+      bool m_done;
+
+      std::vector<std::shared_ptr<Message>> m_page;
+      size_t m_index;
+      std::future<std::vector<std::shared_ptr<Message>>> m_next_page;
+
+      void prefetch();
+      void load_next_page();
+      void check_current();
+    public:
+      State(Snowflake channel_id, size_t limit, std::function<bool(std::shared_ptr<Message>)> until, Snowflake before);
+
+      void start();
+      bool done() const;
+      std::shared_ptr<Message> current() const;
+      void advance();
+    };
+
+    std::shared_ptr<State> m_state;
+  public:
+    class iterator
+    {
+      std::shared_ptr<State> m_state;
+    public:
+      typedef std::input_iterator_tag iterator_category;
+      typedef std::shared_ptr<Message> value_type;
+      typedef std::ptrdiff_t difference_type;
+      typedef const std::shared_ptr<Message>* pointer;
+      typedef std::shared_ptr<Message> reference;
+
+      iterator() {};
+      explicit iterator(std::shared_ptr<State> state) : m_state(state) {};
+
+      std::shared_ptr<Message> operator*() const;
+      iterator& operator++();
+      bool operator==(const iterator& rhs) const;
+      bool operator!=(const iterator& rhs) const;
+    };
+
+    /** Create a history range for a channel.
+
+        @param channel_id The channel to read messages from.
+        @param limit The maximum amount of messages to return. If zero, there is no limit.
+        @param until Iteration stops at the first message this returns true for. That message is not returned.
+        @param before Only messages older than this id are returned. If zero, starts from the newest message.
+     */
+    MessageHistory(Snowflake channel_id, size_t limit = 0, std::function<bool(std::shared_ptr<Message>)> until = nullptr, Snowflake before = 0);
+
+    /** Get an iterator to the first message. The range can only be traversed once.
+
+        @return An iterator to the newest message in the range.
+     */
+    iterator begin() const;
+
+    /** Get an iterator that marks the end of the range.
+
+        @return The end iterator.
+     */
+    iterator end() const;
+  };
+}
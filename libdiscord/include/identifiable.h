@@ -23,7 +23,7 @@ namespace Discord
     }
 
     template <typename T>
-    void set_id_from_json(T key, nlohmann::json data)
+    void set_id_from_json(T key, const nlohmann::json& data)
     {
       set_from_json(m_id, key, data);
     }
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "common.h"
+
+namespace Discord
+{
+  /** Control over how the library's logs are written.
+
+      By default easylogging++ formats every line and writes it to the log file and console from the
+      thread that logged it. With async logging started, each thread instead copies its log records
+      into its own lock-free ring buffer as compact binary records, and a background thread formats
+      and writes them. A thread whose buffer is full drops the record rather than waiting, so logging
+      can never stall the gateway or a handler. Dropped records are counted and reported in the log.
+   */
+  namespace Logging
+  {
+    /** Start writing logs from a background thread.
+
+        @param path The file to write to. If empty, the default logger's configured file is used.
+        @param buffer_bytes The size of each logging thread's buffer. Rounded up to a power of two.
+     */
+    void start_async(std::string path = "", size_t buffer_bytes = 64 * 1024);
+
+    /** Write everything still buffered and go back to writing logs from the logging thread. */
+    void stop_async();
+
+    /** Check if logs are being written from a background thread.
+
+        @return Whether async logging is running.
+     */
+    bool async();
+
+    /** Wait until every record logged before this call is written. */
+    void flush();
+
+    /** Get the amount of log records dropped because a thread's buffer was full.
+
+        @return The amount of dropped records since async logging started.
+     */
+    uint64_t dropped();
+
+    /** Check if debug logs are written anywhere, so callers can skip building expensive messages,
+        such as dumping a payload, that would only be thrown away.
+
+        @return Whether LOG(DEBUG) writes anything.
+     */
+    bool debug_enabled();
+  }
+}
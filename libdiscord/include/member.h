@@ -25,6 +25,7 @@ namespace Discord
     std::vector<Snowflake> roles() const;
     std::string nick() const;
     std::string nickname() const;
+    std::string joined_at() const;
 
     void set_user(std::shared_ptr<User> user);
     void set_nick(std::string nick);
@@ -35,4 +36,6 @@ namespace Discord
   {
     member = Member(json);
   }
+
+  void to_json(nlohmann::json& json, const Member& member);
 }
@@ -33,6 +33,13 @@ namespace Discord
     Message();
     explicit Message(const nlohmann::json& data);
 
+    /** Overwrite the fields of this message that are present in a payload.
+        Used for MESSAGE_UPDATE, which only sends the fields that changed.
+
+        @param data The partial message payload.
+     */
+    void update(const nlohmann::json& data);
+
     Snowflake channel_id() const;
     std::shared_ptr<User> author() const;
     std::shared_ptr<User> user() const;
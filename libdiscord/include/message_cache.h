@@ -0,0 +1,97 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+
+#include "common.h"
+
+namespace Discord
+{
+  class Message;
+
+  /** A bounded cache of the most recent messages in each channel.
+
+      Each channel keeps a ring of its newest messages up to a set depth. The whole cache is also
+      capped at an approximate amount of memory, past which the oldest messages across all channels
+      are evicted first.
+   */
+  class MessageCache
+  {
+    struct Entry
+    {
+      uint64_t sequence;
+      size_t bytes;
+      std::shared_ptr<Message> message;
+    };
+
+    std::map<Snowflake, std::deque<Entry>> m_channels;
+
+    //  Every insert in order, used to find the globally oldest message when over the memory cap.
+    std::deque<std::pair<Snowflake, uint64_t>> m_order;
+
+    size_t m_depth;
+    size_t m_max_bytes;
+    size_t m_bytes;
+    size_t m_count;
+    uint64_t m_sequence;
+    mutable std::mutex m_mutex;
+
+    void pop_front(std::deque<Entry>& ring);
+    void evict();
+  public:
+    /** Create a message cache.
+
+        @param depth The amount of messages to keep per channel. Zero disables the cache.
+        @param max_bytes The approximate amount of memory the whole cache may use.
+     */
+    MessageCache(size_t depth = 50, size_t max_bytes = 32 * 1024 * 1024);
+
+    /** Change the limits of the cache, evicting messages if needed.
+
+        @param depth The amount of messages to keep per channel. Zero disables the cache.
+        @param max_bytes The approximate amount of memory the whole cache may use.
+     */
+    void set_limits(size_t depth, size_t max_bytes);
+
+    /** Add a newly created message to the cache.
+
+        @param message The message to add.
+     */
+    void add(std::shared_ptr<Message> message);
+
+    /** Apply a MESSAGE_UPDATE payload to a cached message.
+
+        @param data The update payload, which may only contain the fields that changed.
+        @return The message as it was before the update, or nullptr if it was not cached.
+     */
+    std::shared_ptr<Message> update(const nlohmann::json& data);
+
+    /** Remove a message from the cache.
+
+        @param channel_id The channel the message is in.
+        @param message_id The message to remove.
+        @return The message that was removed, or nullptr if it was not cached.
+     */
+    std::shared_ptr<Message> remove(Snowflake channel_id, Snowflake message_id);
+
+    /** Get a message from the cache.
+
+        @param channel_id The channel the message is in.
+        @param message_id The message to get.
+        @return The cached message, or nullptr if it is not cached.
+     */
+    std::shared_ptr<Message> get(Snowflake channel_id, Snowflake message_id) const;
+
+    /** Get the amount of messages in the cache.
+
+        @return The amount of cached messages.
+     */
+    size_t size() const;
+
+    /** Get the approximate amount of memory used by cached messages.
+
+        @return The approximate size of the cache in bytes.
+     */
+    size_t bytes() const;
+  };
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+
+#include "common.h"
+
+namespace Discord
+{
+  class Message;
+
+  /** A local, persistent store of messages seen on the gateway.
+
+      Every channel has an append-only log in the store directory which is memory mapped for reads.
+      Each record in <channel_id>.msgs is: kind (u8), message id (u64), length (u32), then the message
+      JSON. Creates and updates append the full message, deletes append an empty record.
+
+      A sorted index of message ids to their newest record is rebuilt from the log when a channel is
+      first used, so point lookups and time range scans are binary searches over memory. A deleted
+      message stays in the index as a tombstone pointing at its last stored copy, so it can still be
+      read with include_deleted.
+   */
+  class MessageStore
+  {
+    class ChannelLog;
+
+    std::string m_directory;
+    mutable std::map<Snowflake, std::unique_ptr<ChannelLog>> m_logs;
+    mutable std::mutex m_logs_mutex;
+
+    ChannelLog* get_log(Snowflake channel_id) const;
+  public:
+    /** Create a store that keeps its logs in a directory. The directory must already exist.
+
+        @param directory The directory to keep message logs in.
+     */
+    explicit MessageStore(std::string directory);
+    ~MessageStore();
+
+    /** Store a new message, or merge an update into a stored message. An update for a message that
+        was never stored is only kept if it carries the whole message, with its author and timestamp.
+
+        @param data The message payload from MESSAGE_CREATE or MESSAGE_UPDATE.
+     */
+    void store(const nlohmann::json& data);
+
+    /** Mark a message as deleted. Its last stored copy is kept.
+
+        @param channel_id The channel the message was in.
+        @param message_id The message that was deleted.
+        @return The last stored payload of the message, or null if it was never stored.
+     */
+    nlohmann::json remove(Snowflake channel_id, Snowflake message_id);
+
+    /** Get a stored message.
+
+        @param channel_id The channel the message is in.
+        @param message_id The message to get.
+        @param include_deleted Whether to return the last copy of a deleted message.
+        @return The message, or nullptr if it is not stored or was deleted.
+     */
+    std::shared_ptr<Message> get(Snowflake channel_id, Snowflake message_id, bool include_deleted = false) const;
+
+    /** Get the raw JSON of a stored message.
+
+        @param channel_id The channel the message is in.
+        @param message_id The message to get.
+        @param include_deleted Whether to return the last copy of a deleted message.
+        @return The message payload, or null if it is not stored or was deleted.
+     */
+    nlohmann::json get_json(Snowflake channel_id, Snowflake message_id, bool include_deleted = false) const;
+
+    /** Get every stored message with an id in a range.
+
+        @param channel_id The channel to read from.
+        @param after Only messages with a greater id are returned.
+        @param before Only messages with a smaller id are returned. If zero, there is no upper bound.
+        @return The messages in ascending id order.
+     */
+    std::vector<std::shared_ptr<Message>> range(Snowflake channel_id, Snowflake after, Snowflake before = 0) const;
+
+    /** Get every stored message that was posted in a span of time.
+
+        @param channel_id The channel to read from.
+        @param begin The earliest time to include.
+        @param end The latest time to include.
+        @return The messages in ascending id order.
+     */
+    std::vector<std::shared_ptr<Message>> range(Snowflake channel_id, std::chrono::system_clock::time_point begin, std::chrono::system_clock::time_point end) const;
+
+    /** Get the amount of messages stored for a channel, not counting deleted ones.
+
+        @param channel_id The channel to count.
+        @return The amount of stored messages.
+     */
+    size_t count(Snowflake channel_id) const;
+  };
+}
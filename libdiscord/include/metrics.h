@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+#include "common.h"
+#include "histogram.h"
+
+namespace Discord
+{
+  /** A value that only goes up, such as the amount of events received. Updating it is lock free. */
+  class Counter
+  {
+    std::atomic<uint64_t> m_value;
+  public:
+    Counter() : m_value(0) {};
+
+    /** Add to the counter.
+
+        @param amount The amount to add.
+     */
+    void increment(uint64_t amount = 1)
+    {
+      m_value.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    /** Get the current value.
+
+        @return The value of the counter.
+     */
+    uint64_t value() const
+    {
+      return m_value.load(std::memory_order_relaxed);
+    }
+  };
+
+  /** A registry of counters, histograms and gauges describing what the library is doing.
+
+      Collection is off by default. Instrumented code checks enabled() before doing any work, so a
+      disabled registry costs one relaxed load per call site. Metrics are looked up by name and an
+      optional label set written in Prometheus form, such as `event="MESSAGE_CREATE"`. Callers on hot
+      paths should keep the returned reference rather than looking it up every time.
+   */
+  namespace Metrics
+  {
+    /** Turn collection on or off.
+
+        @param enabled Whether instrumented code should record metrics.
+     */
+    void set_enabled(bool enabled);
+
+    /** Check if metrics are being collected.
+
+        @return Whether collection is on.
+     */
+    bool enabled();
+
+    /** Get a counter, creating it the first time it's used.
+
+        @param name The metric name, such as "discord_gateway_events_total".
+        @param labels The labels in Prometheus form, without braces.
+        @return The counter, which lives as long as the program.
+     */
+    Counter& counter(const std::string& name, const std::string& labels = "");
+
+    /** Get a histogram of durations in milliseconds, creating it the first time it's used.
+
+        @param name The metric name, such as "discord_rest_request_ms".
+        @param labels The labels in Prometheus form, without braces.
+        @return The histogram, which lives as long as the program.
+     */
+    Histogram& histogram(const std::string& name, const std::string& labels = "");
+
+    /** Register a value that is read when the metrics are exported, such as the size of a cache.
+
+        @param name The metric name.
+        @param read Called on every export to get the current value. Replaces any earlier gauge with the same name and labels.
+        @param labels The labels in Prometheus form, without braces.
+     */
+    void gauge(const std::string& name, std::function<double()> read, const std::string& labels = "");
+
+    /** Remove a gauge, for when whatever it reads is going away.
+
+        @param name The metric name.
+        @param labels The labels the gauge was registered with.
+     */
+    void remove_gauge(const std::string& name, const std::string& labels = "");
+
+    /** Format every metric in the Prometheus text exposition format.
+
+        @return The metrics as text.
+     */
+    std::string prometheus();
+
+    /** Write the metrics to a file in the Prometheus text format.
+
+        The file is replaced in one step, so a scraper reading it never sees a partial write.
+
+        @param path The file to write.
+        @return Whether or not the file was written.
+     */
+    bool write_prometheus(std::string path);
+
+    /** Write the metrics to a file on an interval from a background thread.
+
+        @param path The file to write.
+        @param interval The time between writes.
+     */
+    void start_export(std::string path, std::chrono::seconds interval = std::chrono::seconds(15));
+
+    /** Serve the metrics over HTTP on the loopback interface, at /metrics.
+
+        @param port The port to listen on.
+        @return Whether or not the listener could be opened.
+     */
+    bool serve(uint16_t port);
+
+    /** Stop the file export and the HTTP listener, if either is running. */
+    void stop_export();
+  }
+}
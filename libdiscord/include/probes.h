@@ -0,0 +1,44 @@
+#pragma once
+
+/*  Static tracepoints (USDT) on the hot paths, for attaching perf, bpftrace or SystemTap to a running
+    bot without rebuilding it. Each probe compiles to a single NOP until a tracer enables it.
+
+    Probes are built in on Linux when <sys/sdt.h> is available (systemtap-sdt-dev or
+    systemtap-sdt-devel), and compile to nothing elsewhere or when LIBDISCORD_NO_PROBES is defined.
+    All probes are in the "libdiscord" provider:
+
+      frame_received(bytes, compressed)          A gateway frame was read from the socket.
+      inflate_done(compressed_bytes, bytes)      A compressed frame was inflated.
+      dispatch_start(event)                      A frame is about to be processed. event is a C string,
+                                                 empty for frames that aren't dispatches.
+      dispatch_end(event)                        The frame was processed and its handlers started.
+      ratelimit_wait_start(route_hash)           A REST call is waiting for its rate limit bucket.
+      ratelimit_wait_end(route_hash)             The REST call got its turn.
+      rest_start(route_hash, route, bytes)       A REST request is sent. route is a C string with ids removed.
+      rest_end(route_hash, status, bytes)        The response arrived.
+
+    For example, to list the probes and time REST calls by route:
+
+      bpftrace -l 'usdt:/usr/lib/libdiscord.so:*'
+      bpftrace -e 'usdt:/usr/lib/libdiscord.so:libdiscord:rest_start { @start[arg0] = nsecs; @route[arg0] = str(arg1); }
+                   usdt:/usr/lib/libdiscord.so:libdiscord:rest_end /@start[arg0]/ { @ms[@route[arg0]] = hist((nsecs - @start[arg0]) / 1000000); }'
+*/
+
+#if defined(__linux__) && !defined(LIBDISCORD_NO_PROBES) && defined(__has_include)
+#  if __has_include(<sys/sdt.h>)
+#    include <sys/sdt.h>
+#    define LIBDISCORD_PROBES 1
+#  endif
+#endif
+
+#if defined(LIBDISCORD_PROBES)
+#  define LIBDISCORD_PROBE1(name, a) DTRACE_PROBE1(libdiscord, name, a)
+#  define LIBDISCORD_PROBE2(name, a, b) DTRACE_PROBE2(libdiscord, name, a, b)
+#  define LIBDISCORD_PROBE3(name, a, b, c) DTRACE_PROBE3(libdiscord, name, a, b, c)
+#else
+//  The arguments stay referenced so callers don't warn about values only the probes use, but they
+//  sit in an unevaluated sizeof and cost nothing.
+#  define LIBDISCORD_PROBE1(name, a) do { (void)sizeof(a); } while (0)
+#  define LIBDISCORD_PROBE2(name, a, b) do { (void)sizeof(a); (void)sizeof(b); } while (0)
+#  define LIBDISCORD_PROBE3(name, a, b, c) do { (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); } while (0)
+#endif
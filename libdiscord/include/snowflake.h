@@ -9,6 +9,9 @@ namespace Discord
 {
   class Snowflake
   {
+    //  Milliseconds between the Unix epoch and the first second of 2015.
+    static const uint64_t DiscordEpoch = 1420070400000;
+
     uint64_t m_id;
   public:
     Snowflake() : m_id(0) {};
@@ -53,6 +56,25 @@ namespace Discord
     {
       return std::to_string(m_id);
     }
+
+    /** Get the time this id was created.
+     
+        @return The creation time in milliseconds since the Unix epoch.
+     */
+    uint64_t timestamp() const
+    {
+      return (m_id >> 22) + DiscordEpoch;
+    }
+
+    /** Get the smallest id that could have been created at a given time.
+     
+        @param ms The time in milliseconds since the Unix epoch.
+        @return The smallest id for that time.
+     */
+    static Snowflake from_timestamp(uint64_t ms)
+    {
+      return Snowflake(ms > DiscordEpoch ? (ms - DiscordEpoch) << 22 : 0);
+    }
   };
 
   inline void to_json(nlohmann::json& json, const Snowflake& id)
@@ -64,4 +86,16 @@ namespace Discord
   {
     id = Snowflake(json.get<std::string>());
   }
-}
\ No newline at end of file
+}
+
+namespace std
+{
+  template <>
+  struct hash<Discord::Snowflake>
+  {
+    size_t operator()(const Discord::Snowflake& id) const
+    {
+      return std::hash<uint64_t>()(static_cast<uint64_t>(id));
+    }
+  };
+}
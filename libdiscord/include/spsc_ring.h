@@ -0,0 +1,184 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Discord
+{
+  /** A bounded queue between exactly one producer thread and one consumer thread.
+
+      Pushing and popping are lock free. When the queue is full or empty the blocking calls spin
+      briefly and then sleep until the other side makes progress, so an idle stage costs no CPU.
+   */
+  template<typename T>
+  class SpscRing
+  {
+    std::vector<T> m_slots;
+    size_t m_mask;
+
+    //  Kept on separate cache lines so the producer and consumer don't contend on them.
+    alignas(64) std::atomic<size_t> m_head;   //  Next slot to pop
+    alignas(64) std::atomic<size_t> m_tail;   //  Next slot to push
+
+    std::atomic<bool> m_closed;
+    std::atomic<int> m_sleepers;
+    std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+
+    void wake()
+    {
+      //  Pairs with the increment in sleep, so a sleeper either sees the change or gets notified.
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+
+      if (m_sleepers.load(std::memory_order_relaxed) > 0)
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_wakeup.notify_all();
+      }
+    }
+
+    template<typename Ready>
+    void sleep(Ready ready)
+    {
+      for (auto i = 0; i < 64; ++i)
+      {
+        if (ready())
+        {
+          return;
+        }
+
+        std::this_thread::yield();
+      }
+
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_sleepers.fetch_add(1, std::memory_order_seq_cst);
+      m_wakeup.wait(lock, [&]() { return ready() || m_closed.load(); });
+      m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+    }
+  public:
+    /** Create a ring.
+
+        @param capacity The most items the ring can hold. Rounded up to a power of two.
+     */
+    explicit SpscRing(size_t capacity)
+    {
+      size_t size = 1;
+
+      while (size < capacity)
+      {
+        size <<= 1;
+      }
+
+      m_slots.resize(size);
+      m_mask = size - 1;
+      m_head = 0;
+      m_tail = 0;
+      m_closed = false;
+      m_sleepers = 0;
+    }
+
+    /** Add an item if there is room. Only call from the producer thread.
+
+        @param value The item to add. It is moved from only if it was added.
+        @return Whether or not the item was added.
+     */
+    bool try_push(T& value)
+    {
+      auto tail = m_tail.load(std::memory_order_relaxed);
+
+      if (tail - m_head.load(std::memory_order_acquire) > m_mask)
+      {
+        return false;
+      }
+
+      m_slots[tail & m_mask] = std::move(value);
+      m_tail.store(tail + 1, std::memory_order_release);
+      wake();
+
+      return true;
+    }
+
+    /** Take the oldest item if there is one. Only call from the consumer thread.
+
+        @param value Set to the item that was taken.
+        @return Whether or not an item was taken.
+     */
+    bool try_pop(T& value)
+    {
+      auto head = m_head.load(std::memory_order_relaxed);
+
+      if (head == m_tail.load(std::memory_order_acquire))
+      {
+        return false;
+      }
+
+      value = std::move(m_slots[head & m_mask]);
+      m_slots[head & m_mask] = T();
+      m_head.store(head + 1, std::memory_order_release);
+      wake();
+
+      return true;
+    }
+
+    /** Add an item, waiting for room if the ring is full. Only call from the producer thread.
+
+        @param value The item to add.
+        @return False if the ring was closed before the item could be added.
+     */
+    bool push(T value)
+    {
+      while (!try_push(value))
+      {
+        if (m_closed)
+        {
+          return false;
+        }
+
+        sleep([this]() { return m_tail.load(std::memory_order_relaxed) - m_head.load(std::memory_order_acquire) <= m_mask; });
+      }
+
+      return true;
+    }
+
+    /** Take the oldest item, waiting for one if the ring is empty. Only call from the consumer thread.
+
+        @param value Set to the item that was taken.
+        @return False if the ring was closed and is empty.
+     */
+    bool pop(T& value)
+    {
+      while (!try_pop(value))
+      {
+        if (m_closed)
+        {
+          return false;
+        }
+
+        sleep([this]() { return m_head.load(std::memory_order_relaxed) != m_tail.load(std::memory_order_acquire); });
+      }
+
+      return true;
+    }
+
+    /** Stop the ring. Waiting calls return, and pops still drain what is left. */
+    void close()
+    {
+      m_closed = true;
+
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_wakeup.notify_all();
+    }
+
+    /** Get the amount of items waiting in the ring. Safe to call from any thread.
+
+        @return The amount of items in the ring.
+     */
+    size_t size() const
+    {
+      return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+    }
+  };
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <chrono>
+
+#include "common.h"
+
+namespace Discord
+{
+  /** Sampled latency traces that follow one gateway frame through the library.
+
+      A frame picked by sample() gets a trace id, and each stage it passes through records a span
+      tagged with that id: the queue waits and work of the gateway pipeline, JSON parsing, processing,
+      the event handler, and the bucket wait and network time of each REST call the handler makes.
+      The id follows the work across threads through Scope, so REST calls made from a handler are
+      tied back to the frame that caused them.
+
+      Spans are kept in memory, dropping the oldest past a limit, and can be written out in the
+      Chrome trace format to open in chrome://tracing or Perfetto. Frames that are not sampled only
+      pay for one relaxed atomic load.
+   */
+  namespace Trace
+  {
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    /** Set how many frames are traced.
+
+        @param rate The fraction of frames to trace, from 0 (off, the default) to 1 (every frame).
+     */
+    void set_sample_rate(double rate);
+
+    /** Get how many frames are traced.
+
+        @return The fraction of frames traced.
+     */
+    double sample_rate();
+
+    /** Decide whether to trace a new unit of work.
+
+        @return A new trace id, or zero if the work should not be traced.
+     */
+    uint64_t sample();
+
+    /** Get the trace the current thread is working for.
+
+        @return The trace id, or zero if the current work is not traced.
+     */
+    uint64_t current();
+
+    /** Record a finished span.
+
+        @param name What was being done, such as "inflate" or "GET /channels/{id}/messages".
+        @param category The part of the library the span belongs to, such as "gateway" or "rest".
+        @param start When the span started.
+        @param end When the span ended.
+        @param trace The trace the span belongs to. Nothing is recorded if it is zero.
+     */
+    void record(const std::string& name, const char* category, TimePoint start, TimePoint end, uint64_t trace);
+
+    /** Makes a trace current on this thread until the scope ends. */
+    class Scope
+    {
+      uint64_t m_previous;
+    public:
+      explicit Scope(uint64_t trace);
+      ~Scope();
+
+      Scope(const Scope&) = delete;
+      Scope& operator=(const Scope&) = delete;
+    };
+
+    /** Records a span from construction to destruction, if the current thread is being traced. */
+    class Span
+    {
+      std::string m_name;
+      const char* m_category;
+      uint64_t m_trace;
+      TimePoint m_start;
+    public:
+      Span(std::string name, const char* category);
+      ~Span();
+
+      Span(const Span&) = delete;
+      Span& operator=(const Span&) = delete;
+    };
+
+    /** Wrap a function so that it runs in the current trace, and record a span for it. Used to follow
+        a trace onto the thread an event handler runs on.
+
+        @param name The name of the span.
+        @param function The function to wrap.
+        @return A function that takes the same arguments.
+     */
+    template<typename Function>
+    auto wrap(std::string name, Function function)
+    {
+      auto trace = current();
+
+      return [trace, name, function](auto&&... args)
+      {
+        Scope scope(trace);
+        Span span(name, "handler");
+        function(std::forward<decltype(args)>(args)...);
+      };
+    }
+
+    /** Format every recorded span in the Chrome trace event format.
+
+        @return The trace as JSON text.
+     */
+    std::string chrome_trace();
+
+    /** Write every recorded span to a file in the Chrome trace event format.
+
+        @param path The file to write.
+        @return Whether or not the file was written.
+     */
+    bool write_chrome_trace(std::string path);
+
+    /** Throw away every recorded span. */
+    void clear();
+  }
+}
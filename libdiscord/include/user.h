@@ -74,6 +74,15 @@ namespace Discord
     user = User(json);
   }
 
+  inline void to_json(nlohmann::json& json, const User& user)
+  {
+    json["id"] = user.id();
+    json["username"] = user.username();
+    json["discriminator"] = user.discriminator();
+    json["avatar"] = user.avatar_id();
+    json["bot"] = user.is_bot();
+  }
+
   class Connection
   {
     std::string m_id;
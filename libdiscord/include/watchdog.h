@@ -0,0 +1,103 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "cancellation.h"
+#include "common.h"
+
+namespace Discord
+{
+  /** Watches running event handlers and flags the ones that run past a time budget.
+
+      A handler over budget is logged once with its name, guild and how long it has run, and counted
+      in the discord_handler_slow_total metric. If cancelling is on, its CancellationToken is also
+      cancelled. When a flagged handler finally returns, how long it took in total is logged too.
+
+      Handlers are checked from one background thread a few times per budget, so a handler is
+      flagged at most a quarter of the budget late.
+   */
+  class HandlerWatchdog
+  {
+    struct Running
+    {
+      std::string name;
+      Snowflake guild_id;
+      std::chrono::steady_clock::time_point start;
+      CancellationToken token;
+      bool flagged;
+    };
+
+    std::chrono::milliseconds m_budget;
+    bool m_cancel;
+
+    std::map<uint64_t, Running> m_running;
+    uint64_t m_next_id;
+    bool m_stop;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::thread m_thread;
+
+    void watch();
+  public:
+    /** Start watching handlers.
+
+        @param budget How long a handler may run before it is flagged.
+        @param cancel Whether to cancel a handler's token when it is flagged.
+     */
+    HandlerWatchdog(std::chrono::milliseconds budget, bool cancel = false);
+    ~HandlerWatchdog();
+
+    HandlerWatchdog(const HandlerWatchdog&) = delete;
+    HandlerWatchdog& operator=(const HandlerWatchdog&) = delete;
+
+    /** Get how long a handler may run before it is flagged.
+
+        @return The budget.
+     */
+    std::chrono::milliseconds budget() const;
+
+    /** Check if flagged handlers are cancelled.
+
+        @return Whether flagged handlers have their token cancelled.
+     */
+    bool cancels() const;
+
+    /** Get the amount of handlers running right now.
+
+        @return The amount of running handlers.
+     */
+    size_t running() const;
+
+    /** Start watching a handler.
+
+        @param name The name of the handler, such as "command !ping" or "on_message".
+        @param guild_id The guild the handler's event came from, or zero for direct messages.
+        @param token The handler's token, cancelled when it is flagged if cancelling is on.
+        @return An id to pass to finish when the handler returns.
+     */
+    uint64_t start(std::string name, Snowflake guild_id, CancellationToken token);
+
+    /** Stop watching a handler.
+
+        @param id The id returned by start.
+     */
+    void finish(uint64_t id);
+
+    /** Run a handler with its token current, record its time in the discord_handler_ms histogram
+        and watch it if there is a watchdog. A handler stopped by a CancelledException is logged
+        rather than treated as failing.
+
+        @param watchdog The watchdog, or nullptr to only time the handler.
+        @param name The name of the handler.
+        @param guild_id The guild the handler's event came from, or zero for direct messages.
+        @param token The handler's token.
+        @param handler The handler to run.
+     */
+    static void run(const std::shared_ptr<HandlerWatchdog>& watchdog, const std::string& name, Snowflake guild_id, const CancellationToken& token, const std::function<void()>& handler);
+  };
+}
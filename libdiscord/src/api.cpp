@@ -1,6 +1,12 @@
 #include "api.h"
+#include "cancellation.h"
 #include "common.h"
+#include "logging.h"
+#include "metrics.h"
+#include "probes.h"
+#include "trace.h"
 
+#include <algorithm>
 #include <future>
 #include <cpprest/http_client.h>
 
@@ -9,8 +15,10 @@ namespace Discord
   namespace API
   {
     static utility::string_t Token;
+    static utility::string_t BaseURL = U("https://discordapp.com/api/v6");
     static std::mutex GlobalMutex;
     static std::map<size_t, std::unique_ptr<std::mutex>> APIMutex;
+    static std::mutex APIMutexLock;
 
     namespace detail
     {
@@ -62,11 +70,12 @@ namespace Discord
 
     using namespace nlohmann;
 
-    static const auto API_BASE = U("https://discordapp.com/api/v6");
-
-    json raw_request(web::http::method type, utility::string_t endpoint, nlohmann::json data)
+    json raw_request(web::http::method type, utility::string_t endpoint, nlohmann::json data, size_t route_hash, const std::string& route)
     {
-      http_client client(API_BASE);
+      size_t request_bytes = 0;
+      size_t response_bytes = 0;
+
+      http_client client(BaseURL);
       http_request request(type);
       request.set_request_uri(endpoint);
       request.headers().add(U("Authorization"), Token);
@@ -76,7 +85,11 @@ namespace Discord
       {
         if (type == web::http::methods::GET)
         {
-          LOG(DEBUG) << "Setting query parameters: " << data.dump();
+          if (Logging::debug_enabled())
+          {
+            LOG(DEBUG) << "Setting query parameters: " << data.dump();
+          }
+
           uri_builder builder(endpoint);
           
           for (auto it = std::begin(data); it != std::end(data); ++it)
@@ -100,12 +113,17 @@ namespace Discord
         }
         else
         {
-          LOG(DEBUG) << "Setting request data: " << data.dump();
-          request.set_body(data.dump());
+          auto body = data.dump();
+          LOG(DEBUG) << "Setting request data: " << body;
+          request_bytes = body.size();
+          request.set_body(body);
         }
       }
 
-      pplx::task<json> requestTask = client.request(request).then([=](http_response res) -> json
+      LIBDISCORD_PROBE3(rest_start, route_hash, route.c_str(), request_bytes);
+
+      //  The task is waited on below, so the response size can be written back by reference.
+      pplx::task<json> requestTask = client.request(request).then([=, &response_bytes](http_response res) -> json
       {
         //  A container to hold all our response stuff.
         nlohmann::json container = { { "response_status", res.status_code() } };
@@ -142,7 +160,8 @@ namespace Discord
 
         if (global != std::end(headers))
         {
-          container["X-RateLimit-Global"] = std::stoull(utility::conversions::to_utf8string(global->second));
+          //  Discord sends "true" here, which isn't a number, so only the header being present matters.
+          container["X-RateLimit-Global"] = true;
         }
 
         container["response_status"] = res.status_code();
@@ -155,8 +174,9 @@ namespace Discord
           bodyStream.read_to_end(inStringBuffer).then([inStringBuffer](size_t bytesRead)
           {
             return inStringBuffer.collection();
-          }).then([&container](std::string text)
+          }).then([&container, &response_bytes](std::string text)
           {
+            response_bytes = text.size();
             auto payload = json::parse(text.c_str());
             container["response_data"] = payload;
           }).get();
@@ -164,6 +184,7 @@ namespace Discord
         else if (res.status_code() != status_codes::NoContent)
         {
           auto json_str = utility::conversions::to_utf8string(res.extract_string().get());
+          response_bytes = json_str.size();
           auto response = json::parse(json_str.c_str());
 
           container["response_data"] = response;
@@ -173,26 +194,50 @@ namespace Discord
       });
 
       requestTask.wait();
-      return requestTask.get();
+      auto response = requestTask.get();
+
+      LIBDISCORD_PROBE3(rest_end, route_hash, response["response_status"].get<int>(), response_bytes);
+
+      return response;
     }
 
     nlohmann::json request(APICall& key, RequestType type, nlohmann::json data)
     {
-      LOG(DEBUG) << "Request: ("
-                << detail::get_method_name(type) 
-                << ") - " << key.endpoint() 
-                << " " << data.dump(2);
+      //  A handler that was cancelled stops at its next call instead of queueing for a bucket.
+      auto& cancellation = CancellationToken::current();
+      cancellation.throw_if_cancelled();
+
+      if (Logging::debug_enabled())
+      {
+        LOG(DEBUG) << "Request: ("
+                  << detail::get_method_name(type) 
+                  << ") - " << key.endpoint() 
+                  << " " << data.dump(2);
+      }
 
       auto map_key = key.hash();
-      auto mutex_it = APIMutex.find(map_key);
+      std::mutex* mutex;
 
-      //  If the cached mutex does not exist, create it.
-      if (mutex_it == std::end(APIMutex))
       {
-        APIMutex[map_key] = std::make_unique<std::mutex>();
+        //  Requests for different buckets can run concurrently, so guard the mutex map itself.
+        std::lock_guard<std::mutex> map_lock(APIMutexLock);
+        auto mutex_it = APIMutex.find(map_key);
+
+        //  If the cached mutex does not exist, create it.
+        if (mutex_it == std::end(APIMutex))
+        {
+          mutex_it = APIMutex.emplace(map_key, std::make_unique<std::mutex>()).first;
+        }
+
+        mutex = mutex_it->second.get();
       }
 
-      auto mutex = APIMutex[map_key].get();
+      auto metrics = Metrics::enabled();
+      auto trace = Trace::current();
+      auto route = metrics ? "route=\"" + key.route() + "\"" : "";
+      auto waiting = std::chrono::steady_clock::now();
+
+      LIBDISCORD_PROBE1(ratelimit_wait_start, map_key);
 
       std::lock_guard<std::mutex> api_lock(*mutex);
 
@@ -209,15 +254,51 @@ namespace Discord
         LOG(DEBUG) << "Global mutex unlocked.";
       }
 
+      LIBDISCORD_PROBE1(ratelimit_wait_end, map_key);
+
+      //  It may have been cancelled while waiting, in which case the bucket goes to the next caller.
+      cancellation.throw_if_cancelled();
+
+      auto start = std::chrono::steady_clock::now();
+
       //  Get result from the request.
-      auto response = raw_request(detail::get_method(type), utility::conversions::to_string_t(key.endpoint()), data);
+      auto response = raw_request(detail::get_method(type), utility::conversions::to_string_t(key.endpoint()), data, map_key, key.route());
       auto rdata = response["response_data"];
 
+      if (trace)
+      {
+        auto end = std::chrono::steady_clock::now();
+
+        Trace::record("rate limit wait " + key.route(), "rest", waiting, start, trace);
+        Trace::record(detail::get_method_name(type) + " " + key.route(), "rest", start, end, trace);
+      }
+
+      if (metrics)
+      {
+        auto labels = "method=\"" + detail::get_method_name(type) + "\"," + route;
+        auto now = std::chrono::steady_clock::now();
+
+        //  Time spent queued behind other requests in the same bucket, or behind a global limit.
+        Metrics::histogram("discord_rest_rate_limit_wait_ms", route).observe(std::chrono::duration<double, std::milli>(start - waiting).count());
+        Metrics::histogram("discord_rest_request_ms", labels).observe(std::chrono::duration<double, std::milli>(now - start).count());
+
+        if (response["response_status"].get<int>() == status_codes::TooManyRequests)
+        {
+          auto scope = response.count("X-RateLimit-Global") ? "global" : "route";
+          Metrics::counter("discord_rest_rate_limited_total", route + ",scope=\"" + scope + "\"").increment();
+        }
+      }
+
       if (response.count("X-RateLimit-Global"))
       {
         auto wait_time = response["Retry-After"].get<uint32_t>();
         LOG(ERROR) << "Hit the global rate limit. Waiting for " << wait_time << "ms.";
 
+        if (metrics)
+        {
+          Metrics::histogram("discord_rest_rate_limit_sleep_ms", "scope=\"global\"").observe(wait_time);
+        }
+
         //  This is a global rate limit, lock the global mutex and wait.
         std::lock_guard<std::mutex> global_lock(GlobalMutex);
         std::this_thread::sleep_for(std::chrono::milliseconds(wait_time));
@@ -232,6 +313,13 @@ namespace Discord
         auto total_time = std::chrono::duration_cast<std::chrono::seconds>(end_time - std::chrono::system_clock::now()).count();
 
         LOG(WARNING) << "We hit the rate limit for endpoint " << key.endpoint() << ". Sleeping for " << total_time << " seconds.";
+
+        if (metrics)
+        {
+          auto sleep_ms = std::chrono::duration<double, std::milli>(end_time - std::chrono::system_clock::now()).count();
+          Metrics::histogram("discord_rest_rate_limit_sleep_ms", "scope=\"route\"").observe(std::max(sleep_ms, 0.0));
+        }
+
         std::this_thread::sleep_until(end_time);
       }
       else if (rdata.count("code"))
@@ -291,6 +379,11 @@ namespace Discord
       Token = utility::conversions::to_string_t(token);
     }
 
+    void set_base_url(std::string url)
+    {
+      BaseURL = utility::conversions::to_string_t(url);
+    }
+
     std::string get_wss_url()
     {
       auto response = request(APICall() << "gateway", GET);
@@ -6,6 +6,7 @@
 #include "emoji.h"
 #include "invite.h"
 #include "message.h"
+#include "message_cache.h"
 #include "user.h"
 
 #include <cpprest/http_msg.h>
@@ -17,15 +18,24 @@ namespace Discord
     namespace Channel
     {
       static std::map<Snowflake, std::shared_ptr<Discord::Channel>> ChannelCache;
+      static std::mutex ChannelCacheMutex;
+      static MessageCache RecentMessages;
+
+      //  Maximum amount of characters Discord accepts in a single message.
+      static const size_t MaxMessageSize = 2000;
 
       void update_cache(std::shared_ptr<Discord::Channel> channel)
       {
         LOG(DEBUG) << "Adding channel " << channel->name() << " (" << channel->id().to_string() << ") to cache.";
-        if (ChannelCache.count(channel->id()))
+
+        //  Handlers add channels they fetch here while the dispatch thread commits guilds.
+        std::lock_guard<std::mutex> lock(ChannelCacheMutex);
+        auto itr = ChannelCache.find(channel->id());
+
+        if (itr != std::end(ChannelCache))
         {
           LOG(TRACE) << "Merging new channel information with cached value.";
-          auto old = get(channel->id());
-          old->merge(channel);
+          itr->second->merge(channel);
         }
         else
         {
@@ -35,6 +45,7 @@ namespace Discord
 
       void remove_cache(std::shared_ptr<Discord::Channel> channel)
       {
+        std::lock_guard<std::mutex> lock(ChannelCacheMutex);
         auto itr = ChannelCache.find(channel->id());
 
         if (itr != std::end(ChannelCache))
@@ -47,11 +58,27 @@ namespace Discord
         }
       }
 
+      size_t cache_size()
+      {
+        std::lock_guard<std::mutex> lock(ChannelCacheMutex);
+        return ChannelCache.size();
+      }
+
+      MessageCache& message_cache()
+      {
+        return RecentMessages;
+      }
+
       std::shared_ptr<Discord::Channel> get(Snowflake channel_id)
       {
-        if (ChannelCache.count(channel_id))
         {
-          return ChannelCache[channel_id];
+          std::lock_guard<std::mutex> lock(ChannelCacheMutex);
+          auto itr = ChannelCache.find(channel_id);
+
+          if (itr != std::end(ChannelCache))
+          {
+            return itr->second;
+          }
         }
 
         LOG(DEBUG) << "Could not return channel from cache, calling API.";
@@ -148,6 +175,13 @@ namespace Discord
 
       std::shared_ptr<Message> get_message(Snowflake channel_id, Snowflake message_id)
       {
+        auto cached = RecentMessages.get(channel_id, message_id);
+
+        if (cached)
+        {
+          return cached;
+        }
+
         auto response = request(APICall(channel_id) << "channels" << channel_id << "messages" << message_id, GET);
 
         return std::make_shared<Message>(response);
@@ -161,6 +195,23 @@ namespace Discord
           throw DiscordException("Cannot send an empty message.");
         }
 
+        if (utf8_length(content) > MaxMessageSize)
+        {
+          //  Preemptively split to avoid the API rejecting the message.
+          //  Each part goes through the same bucket, so they are sent in order.
+          auto parts = split_message(content, MaxMessageSize);
+
+          LOG(DEBUG) << "Message to channel " << channel_id.to_string() << " is too long, sending in " << parts.size() << " parts.";
+
+          for (size_t i = 0; i + 1 < parts.size(); ++i)
+          {
+            create_message(channel_id, parts[i], tts);
+          }
+
+          //  Any embed is attached to the final part.
+          return create_message(channel_id, parts.back(), tts, embed);
+        }
+
         nlohmann::json payload = {
           { "tts", tts },
           { "mentions", nlohmann::json::array() }
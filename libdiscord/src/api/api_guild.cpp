@@ -1,4 +1,5 @@
 #include "api.h"
+#include "api/api_channel.h"
 #include "api/api_guild.h"
 #include "channel.h"
 #include "guild.h"
@@ -10,6 +11,7 @@
 #include "voice.h"
 
 #include <map>
+#include <mutex>
 
 namespace Discord
 {
@@ -18,18 +20,37 @@ namespace Discord
     namespace Guild
     {
       static std::map<Snowflake, std::shared_ptr<Discord::Guild>> GuildCache;
+      static std::mutex GuildCacheMutex;
 
       std::shared_ptr<Discord::Guild> update_cache(std::shared_ptr<Discord::Guild> guild)
       {
-        if (GuildCache.count(guild->id()))
+        std::shared_ptr<Discord::Guild> old;
+
+        {
+          //  Handlers and the metrics thread read the cache while the dispatch thread changes it.
+          std::lock_guard<std::mutex> lock(GuildCacheMutex);
+          auto itr = GuildCache.find(guild->id());
+
+          if (itr != std::end(GuildCache))
+          {
+            old = itr->second;
+          }
+          else
+          {
+            GuildCache[guild->id()] = guild;
+          }
+        }
+
+        if (old)
         {
           LOG(TRACE) << "Merging new guild information with cached value.";
-          auto old = get(guild->id());
           old->merge(guild);
         }
-        else
+
+        //  Done here rather than when the guild is decoded, so channels are committed in event order.
+        for (auto& channel : guild->cached_channels())
         {
-          GuildCache[guild->id()] = guild;
+          Discord::API::Channel::update_cache(channel);
         }
 
         return guild;
@@ -37,6 +58,7 @@ namespace Discord
 
       void remove_cache(Snowflake guild_id)
       {
+        std::lock_guard<std::mutex> lock(GuildCacheMutex);
         auto itr = GuildCache.find(guild_id);
 
         if (itr != std::end(GuildCache))
@@ -54,6 +76,25 @@ namespace Discord
         remove_cache(guild->id());
       }
 
+      size_t cache_size()
+      {
+        std::lock_guard<std::mutex> lock(GuildCacheMutex);
+        return GuildCache.size();
+      }
+
+      Discord::GuildMemory cache_memory()
+      {
+        Discord::GuildMemory memory;
+        std::lock_guard<std::mutex> lock(GuildCacheMutex);
+
+        for (auto& guild : GuildCache)
+        {
+          memory += guild.second->memory();
+        }
+
+        return memory;
+      }
+
       void mark_unavailable(Snowflake guild_id)
       {
         auto guild = get(guild_id);
@@ -62,9 +103,14 @@ namespace Discord
 
       std::shared_ptr<Discord::Guild> get(Snowflake guild_id)
       {
-        if (GuildCache.count(guild_id))
         {
-          return GuildCache[guild_id];
+          std::lock_guard<std::mutex> lock(GuildCacheMutex);
+          auto itr = GuildCache.find(guild_id);
+
+          if (itr != std::end(GuildCache))
+          {
+            return itr->second;
+          }
         }
 
         LOG(DEBUG) << "Could not return guild from cache, calling API.";
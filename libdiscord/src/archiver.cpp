@@ -0,0 +1,421 @@
+#include "archiver.h"
+
+#include "api_exceptions.h"
+#include "api/api_channel.h"
+#include "channel.h"
+#include "guild.h"
+#include "message.h"
+#include "user.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <mutex>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace Discord
+{
+  namespace
+  {
+    const int32_t PageSize = 100;
+
+    //  id (u64) + author id (u64) + content length (u32)
+    const uint64_t RecordHeaderSize = 20;
+
+    //  id (u64) + offset (u64)
+    const uint64_t IndexEntrySize = 16;
+
+    uint64_t file_size(const std::string& path)
+    {
+      std::ifstream file(path, std::ios::binary | std::ios::ate);
+      return file.is_open() ? static_cast<uint64_t>(file.tellg()) : 0;
+    }
+
+    bool truncate_file(const std::string& path, uint64_t size)
+    {
+#ifdef _WIN32
+      auto file = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+      LARGE_INTEGER end;
+      end.QuadPart = static_cast<LONGLONG>(size);
+
+      auto ok = file != INVALID_HANDLE_VALUE && SetFilePointerEx(file, end, nullptr, FILE_BEGIN) && SetEndOfFile(file);
+
+      if (file != INVALID_HANDLE_VALUE)
+      {
+        CloseHandle(file);
+      }
+
+      return ok != FALSE;
+#else
+      return ::truncate(path.c_str(), static_cast<off_t>(size)) == 0;
+#endif
+    }
+
+    /** Check that a whole record is in the log at an offset.
+
+        @param log The log to read.
+        @param offset Where the record starts.
+        @param log_size The size of the log.
+        @param id Set to the record's message id if it is complete.
+        @return The offset just past the record, or 0 if the record is cut short.
+     */
+    uint64_t record_end(std::ifstream& log, uint64_t offset, uint64_t log_size, uint64_t& id)
+    {
+      if (offset + RecordHeaderSize > log_size)
+      {
+        return 0;
+      }
+
+      char header[RecordHeaderSize];
+      log.clear();
+      log.seekg(offset);
+      log.read(header, sizeof(header));
+
+      auto end = offset + RecordHeaderSize + read_le(&header[16], 4);
+
+      if (!log || end > log_size)
+      {
+        return 0;
+      }
+
+      id = read_le(header, 8);
+      return end;
+    }
+
+    uint64_t index_entry(std::ifstream& index, uint64_t entry, uint64_t& offset)
+    {
+      char data[IndexEntrySize];
+      index.clear();
+      index.seekg(entry * IndexEntrySize);
+      index.read(data, sizeof(data));
+
+      offset = read_le(&data[8], 8);
+      return read_le(data, 8);
+    }
+  }
+
+  double ArchiveStats::messages_per_second() const
+  {
+    return seconds > 0 ? messages / seconds : 0;
+  }
+
+  Archiver::Archiver(std::string directory, size_t concurrency) : m_directory(directory), m_concurrency(std::max(concurrency, static_cast<size_t>(1)))
+  {
+    if (!m_directory.empty() && m_directory.back() != '/' && m_directory.back() != '\\')
+    {
+      m_directory += "/";
+    }
+  }
+
+  std::string Archiver::log_path(Snowflake channel_id) const
+  {
+    return m_directory + channel_id.to_string() + ".log";
+  }
+
+  std::string Archiver::index_path(Snowflake channel_id) const
+  {
+    return m_directory + channel_id.to_string() + ".idx";
+  }
+
+  ArchiveStats Archiver::archive(std::shared_ptr<Guild> guild) const
+  {
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<Snowflake> channels;
+
+    for (auto& channel : guild->channels())
+    {
+      if (channel->type() == Text)
+      {
+        channels.push_back(channel->id());
+      }
+    }
+
+    ArchiveStats total;
+    std::mutex total_mutex;
+    std::atomic<size_t> next(0);
+
+    //  Each worker takes the next channel until none are left.
+    auto worker = [&]()
+    {
+      for (auto i = next++; i < channels.size(); i = next++)
+      {
+        try
+        {
+          auto stats = archive_channel(channels[i]);
+
+          std::lock_guard<std::mutex> lock(total_mutex);
+          total.channels += stats.channels;
+          total.messages += stats.messages;
+          total.bytes += stats.bytes;
+        }
+        catch (const std::exception& e)
+        {
+          LOG(ERROR) << "Failed to archive channel " << channels[i].to_string() << " in " << guild->name() << ": " << e.what();
+        }
+      }
+    };
+
+    std::vector<std::future<void>> workers;
+
+    for (size_t i = 0; i < std::min(m_concurrency, channels.size()); ++i)
+    {
+      workers.push_back(std::async(std::launch::async, worker));
+    }
+
+    for (auto& task : workers)
+    {
+      task.get();
+    }
+
+    total.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    LOG(INFO) << "Archived " << total.messages << " messages from " << total.channels << " channels in "
+              << guild->name() << " (" << total.messages_per_second() << " messages/second).";
+
+    return total;
+  }
+
+  ArchiveStats Archiver::archive_channel(Snowflake channel_id) const
+  {
+    auto start = std::chrono::steady_clock::now();
+
+    ArchiveStats stats;
+    stats.channels = 1;
+
+    repair(channel_id);
+
+    std::ofstream log(log_path(channel_id), std::ios::binary | std::ios::app);
+    std::ofstream index(index_path(channel_id), std::ios::binary | std::ios::app);
+
+    if (!log.is_open() || !index.is_open())
+    {
+      throw DiscordException("Could not open archive files for channel " + channel_id.to_string());
+    }
+
+    log.seekp(0, std::ios::end);
+    uint64_t offset = log.tellp();
+
+    //  Snowflakes start far above 1, so "after 1" covers the whole history of a new channel.
+    auto last_id = std::max(static_cast<uint64_t>(last_archived(channel_id)), static_cast<uint64_t>(1));
+    std::vector<std::shared_ptr<Message>> page;
+
+    do
+    {
+      page = Discord::API::Channel::get_messages(channel_id, PageSize, SearchCriteria::After, last_id);
+
+      //  Pages come back newest first, but the archive is kept in ascending order.
+      std::sort(std::begin(page), std::end(page), [](std::shared_ptr<Message> a, std::shared_ptr<Message> b)
+      {
+        return a->id() < b->id();
+      });
+
+      std::string records;
+      std::string entries;
+
+      for (auto& message : page)
+      {
+        auto content = message->content();
+        auto author = message->author();
+
+        write_le(entries, static_cast<uint64_t>(message->id()), 8);
+        write_le(entries, offset + records.size(), 8);
+
+        write_le(records, static_cast<uint64_t>(message->id()), 8);
+        write_le(records, author ? static_cast<uint64_t>(author->id()) : 0, 8);
+        write_le(records, static_cast<uint32_t>(content.size()), 4);
+        records += content;
+      }
+
+      //  Write the log before the index so an index entry never points past the log.
+      log.write(records.data(), records.size());
+      log.flush();
+      index.write(entries.data(), entries.size());
+      index.flush();
+
+      offset += records.size();
+      stats.messages += page.size();
+      stats.bytes += records.size();
+
+      if (!page.empty())
+      {
+        last_id = static_cast<uint64_t>(page.back()->id());
+      }
+    } while (page.size() == static_cast<size_t>(PageSize));
+
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    LOG(DEBUG) << "Archived " << stats.messages << " messages from channel " << channel_id.to_string()
+               << " (" << stats.messages_per_second() << " messages/second).";
+
+    return stats;
+  }
+
+  Snowflake Archiver::last_archived(Snowflake channel_id) const
+  {
+    std::ifstream index(index_path(channel_id), std::ios::binary | std::ios::ate);
+
+    if (!index.is_open())
+    {
+      return 0;
+    }
+
+    //  Ignore any partially written entry at the end of the file.
+    auto entries = static_cast<uint64_t>(index.tellg()) / IndexEntrySize;
+
+    if (entries == 0)
+    {
+      return 0;
+    }
+
+    uint64_t offset;
+    return index_entry(index, entries - 1, offset);
+  }
+
+  void Archiver::repair(Snowflake channel_id) const
+  {
+    auto log_size = file_size(log_path(channel_id));
+    auto index_size = file_size(index_path(channel_id));
+    auto entries = index_size / IndexEntrySize;
+
+    std::string missing;
+    uint64_t end = 0;
+
+    {
+      std::ifstream log(log_path(channel_id), std::ios::binary);
+      std::ifstream index(index_path(channel_id), std::ios::binary);
+      uint64_t id;
+
+      //  Find the newest index entry whose record made it into the log completely.
+      for (; entries > 0; --entries)
+      {
+        uint64_t offset;
+        index_entry(index, entries - 1, offset);
+
+        if ((end = record_end(log, offset, log_size, id)) != 0)
+        {
+          break;
+        }
+      }
+
+      //  The log is written first, so a run can stop with complete records that were never indexed.
+      for (auto next = record_end(log, end, log_size, id); next != 0; next = record_end(log, end, log_size, id))
+      {
+        write_le(missing, id, 8);
+        write_le(missing, end, 8);
+        end = next;
+      }
+    }
+
+    if (end == log_size && entries * IndexEntrySize == index_size && missing.empty())
+    {
+      return;
+    }
+
+    LOG(WARNING) << "Archive for channel " << channel_id.to_string() << " was left partly written. Trimming "
+                 << log_size - end << " bytes from the log and indexing " << missing.size() / IndexEntrySize << " records.";
+
+    if ((end != log_size && !truncate_file(log_path(channel_id), end)) || (entries * IndexEntrySize != index_size && !truncate_file(index_path(channel_id), entries * IndexEntrySize)))
+    {
+      throw DiscordException("Could not repair archive files for channel " + channel_id.to_string());
+    }
+
+    if (!missing.empty())
+    {
+      std::ofstream index(index_path(channel_id), std::ios::binary | std::ios::app);
+      index.write(missing.data(), missing.size());
+    }
+  }
+
+  std::vector<ArchivedMessage> Archiver::load(Snowflake channel_id, Snowflake after) const
+  {
+    std::vector<ArchivedMessage> messages;
+    std::ifstream log(log_path(channel_id), std::ios::binary);
+
+    if (!log.is_open())
+    {
+      return messages;
+    }
+
+    uint64_t start = 0;
+    std::ifstream index(index_path(channel_id), std::ios::binary | std::ios::ate);
+
+    if (index.is_open())
+    {
+      //  Find the first indexed message newer than after. Starting at the entry before it also
+      //  covers records past the end of the index, which are all newer than every indexed one.
+      uint64_t low = 0;
+      uint64_t high = static_cast<uint64_t>(index.tellg()) / IndexEntrySize;
+
+      while (low < high)
+      {
+        auto middle = low + (high - low) / 2;
+        uint64_t offset;
+
+        if (index_entry(index, middle, offset) <= static_cast<uint64_t>(after))
+        {
+          low = middle + 1;
+        }
+        else
+        {
+          high = middle;
+        }
+      }
+
+      if (low > 0)
+      {
+        index_entry(index, low - 1, start);
+      }
+    }
+
+    log.seekg(0, std::ios::end);
+    auto log_size = static_cast<uint64_t>(log.tellg());
+
+    if (start > log_size)
+    {
+      LOG(WARNING) << "Archive index for channel " << channel_id.to_string() << " points past its log. Reading the whole log.";
+      start = 0;
+    }
+
+    std::string data(static_cast<size_t>(log_size - start), '\0');
+    log.seekg(start);
+    log.read(&data[0], data.size());
+    size_t pos = 0;
+
+    while (pos + RecordHeaderSize <= data.size())
+    {
+      ArchivedMessage message;
+      message.id = read_le(&data[pos], 8);
+      message.author_id = read_le(&data[pos + 8], 8);
+      auto length = read_le(&data[pos + 16], 4);
+      pos += RecordHeaderSize;
+
+      if (pos + length > data.size())
+      {
+        LOG(WARNING) << "Archive for channel " << channel_id.to_string() << " ends with a truncated record.";
+        break;
+      }
+
+      //  A record can be written twice if a run stopped between writing the log and the index.
+      if (after < message.id)
+      {
+        after = message.id;
+        message.content = data.substr(pos, length);
+        messages.push_back(message);
+      }
+
+      pos += length;
+    }
+
+    return messages;
+  }
+}
@@ -4,19 +4,79 @@
 #include "api/api_channel.h"
 #include "api/api_guild.h"
 #include "api/api_user.h"
+#include "cache_snapshot.h"
 #include "channel.h"
 #include "common.h"
 #include "emoji.h"
 #include "events.h"
 #include "event/event_message.h"
 #include "gateway.h"
+#include "gateway_recording.h"
 #include "guild.h"
+#include "logging.h"
 #include "member.h"
+#include "message.h"
+#include "message_cache.h"
+#include "message_store.h"
+#include "metrics.h"
 #include "role.h"
+#include "trace.h"
 #include "user.h"
+#include "watchdog.h"
+
+#include <set>
 
 namespace Discord
 {
+  namespace
+  {
+    //  Wrap an event handler so it is timed and, if a handler budget is set, watched.
+    template<typename Event>
+    std::function<void(Event)> watched(std::shared_ptr<HandlerWatchdog> watchdog, std::string name, Snowflake guild_id, std::function<void(Event)> callback)
+    {
+      return [watchdog, name, guild_id, callback](Event event)
+      {
+        HandlerWatchdog::run(watchdog, name, guild_id, CancellationToken(), [&]() { callback(event); });
+      };
+    }
+
+    //  Message handlers also get a token through the event, which the watchdog can cancel.
+    std::function<void(MessageEvent)> watched(std::shared_ptr<HandlerWatchdog> watchdog, std::string name, Snowflake guild_id, std::function<void(MessageEvent)> callback)
+    {
+      return [watchdog, name, guild_id, callback](MessageEvent event)
+      {
+        auto token = CancellationToken::create();
+        event.set_cancellation(token);
+
+        HandlerWatchdog::run(watchdog, name, guild_id, token, [&]() { callback(event); });
+      };
+    }
+
+    /** Sums the guild cache memory at most once a second, so the gauges of one export share a
+        single pass over the guilds instead of each making their own.
+     */
+    class CacheMemoryReader
+    {
+      std::mutex m_mutex;
+      std::chrono::steady_clock::time_point m_read;
+      GuildMemory m_memory;
+    public:
+      GuildMemory read()
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto now = std::chrono::steady_clock::now();
+
+        if (now - m_read >= std::chrono::seconds(1))
+        {
+          m_memory = API::Guild::cache_memory();
+          m_read = now;
+        }
+
+        return m_memory;
+      }
+    };
+  }
+
   Bot::Bot()
   {
     m_is_user = false;
@@ -28,6 +88,23 @@ namespace Discord
     m_on_emoji_updated = nullptr;
     m_on_typing = nullptr;
     m_on_presence = nullptr;
+    m_on_ready = nullptr;
+
+    m_snapshot_interval = std::chrono::seconds(600);
+    m_restored_snapshot = false;
+    m_fully_ready = false;
+  }
+
+  Bot::~Bot()
+  {
+    save_cache_snapshot();
+
+    if (!m_trace_path.empty())
+    {
+      Trace::write_chrome_trace(m_trace_path);
+    }
+
+    Logging::flush();
   }
 
   std::shared_ptr<Bot> Bot::create(nlohmann::json settings)
@@ -48,9 +125,145 @@ namespace Discord
 
     Discord::API::set_token(token);
 
+    std::string api_url;
+    set_from_json(api_url, "api_url", settings);
+
+    if (!api_url.empty())
+    {
+      Discord::API::set_base_url(api_url);
+    }
+
+    if (settings.count("message_cache"))
+    {
+      //  Defaults keep the last 50 messages per channel in at most 32MB.
+      size_t depth = 50;
+      size_t max_bytes = 32 * 1024 * 1024;
+
+      auto cache_settings = settings["message_cache"];
+
+      if (cache_settings.count("depth"))
+      {
+        depth = cache_settings["depth"].get<size_t>();
+      }
+
+      if (cache_settings.count("max_bytes"))
+      {
+        max_bytes = cache_settings["max_bytes"].get<size_t>();
+      }
+
+      Discord::API::Channel::message_cache().set_limits(depth, max_bytes);
+    }
+
+    std::string store_directory;
+    set_from_json(store_directory, "message_store", settings);
+
+    if (!store_directory.empty())
+    {
+      bot->m_message_store = std::make_shared<MessageStore>(store_directory);
+    }
+
     bot->m_gateway = std::make_shared<Gateway>(token);
     bot->m_gateway->set_bot(bot); //  Let the gateway know about the bot so it can send events.
 
+    std::string snapshot_path;
+    set_from_json(snapshot_path, "cache_snapshot", settings);
+
+    if (!snapshot_path.empty())
+    {
+      uint32_t interval = 600;
+      set_from_json(interval, "cache_snapshot_interval", settings);
+
+      bot->set_cache_snapshot(snapshot_path, std::chrono::seconds(interval));
+    }
+
+    std::string session_file;
+    set_from_json(session_file, "session_file", settings);
+
+    if (!session_file.empty())
+    {
+      bot->m_gateway->set_session_file(session_file);
+    }
+
+    std::string gateway_url;
+    set_from_json(gateway_url, "gateway_url", settings);
+
+    if (!gateway_url.empty())
+    {
+      bot->m_gateway->set_url(gateway_url);
+    }
+
+    std::string recording;
+    set_from_json(recording, "gateway_recording", settings);
+
+    if (!recording.empty())
+    {
+      bot->m_gateway->set_recording(recording);
+    }
+
+    if (settings.count("intents"))
+    {
+      bot->set_intents(settings["intents"].get<uint32_t>());
+    }
+
+    if (settings.count("large_threshold"))
+    {
+      bot->m_gateway->set_large_threshold(settings["large_threshold"].get<uint32_t>());
+    }
+
+    if (settings.count("async_logging"))
+    {
+      auto logging_settings = settings["async_logging"];
+
+      std::string file;
+      size_t buffer_bytes = 64 * 1024;
+
+      set_from_json(file, "file", logging_settings);
+      update_from_json(buffer_bytes, "buffer_bytes", logging_settings);
+
+      Logging::start_async(file, buffer_bytes);
+    }
+
+    if (settings.count("metrics"))
+    {
+      auto metrics_settings = settings["metrics"];
+
+      std::string file;
+      uint32_t interval = 15;
+      uint16_t port = 0;
+
+      set_from_json(file, "file", metrics_settings);
+      set_from_json(interval, "interval", metrics_settings);
+      set_from_json(port, "port", metrics_settings);
+
+      bot->enable_metrics(file, std::chrono::seconds(interval), port);
+    }
+
+    if (settings.count("trace"))
+    {
+      auto trace_settings = settings["trace"];
+
+      double sample_rate = 0;
+      std::string file;
+
+      set_from_json(sample_rate, "sample_rate", trace_settings);
+      set_from_json(file, "file", trace_settings);
+
+      bot->enable_tracing(sample_rate, file);
+    }
+
+    if (settings.count("handler_budget"))
+    {
+      auto budget_settings = settings["handler_budget"];
+
+      uint32_t budget_ms = 0;
+      bool cancel = false;
+
+      set_from_json(budget_ms, "budget_ms", budget_settings);
+      set_from_json(cancel, "cancel", budget_settings);
+
+      bot->set_handler_budget(std::chrono::milliseconds(budget_ms), cancel);
+    }
+
     return bot;
   }
 
@@ -102,7 +315,15 @@ namespace Discord
 
   std::string Bot::invite_url() const
   {
-    return "https://discordapp.com/oauth2/authorize?client_id=" + profile()->id().to_string() + "&scope=bot";
+    auto self = profile();
+
+    if (!self)
+    {
+      LOG(WARNING) << "The bot's profile isn't known until the gateway has connected.";
+      return "";
+    }
+
+    return "https://discordapp.com/oauth2/authorize?client_id=" + self->id().to_string() + "&scope=bot";
   }
 
   std::vector<std::shared_ptr<Guild>> Bot::guilds() const
@@ -110,14 +331,293 @@ namespace Discord
     return m_guilds;
   }
 
+  std::chrono::microseconds Bot::latency() const
+  {
+    return m_gateway->latency();
+  }
+
+  std::future<std::vector<std::shared_ptr<Member>>> Bot::request_members(Snowflake guild_id, std::vector<Snowflake> user_ids) const
+  {
+    return m_gateway->request_members(guild_id, user_ids);
+  }
+
+  std::future<std::vector<std::shared_ptr<Member>>> Bot::request_members(Snowflake guild_id, std::string query, uint32_t limit) const
+  {
+    return m_gateway->request_members(guild_id, query, limit);
+  }
+
+  std::vector<EventStats> Bot::event_stats() const
+  {
+    return m_gateway->event_stats();
+  }
+
+  void Bot::set_gateway_recording(std::string path)
+  {
+    m_gateway->set_recording(path);
+  }
+
+  size_t Bot::replay_gateway(std::string path, bool real_time)
+  {
+    return m_gateway->replay(GatewayRecorder::load(path), real_time);
+  }
+
+  size_t Bot::replay_gateway(const std::vector<RecordedFrame>& frames, bool real_time)
+  {
+    return m_gateway->replay(frames, real_time);
+  }
+
+  void Bot::set_intents(uint32_t intents)
+  {
+    m_gateway->set_intents(intents);
+  }
+
+  void Bot::enable_metrics(std::string file, std::chrono::seconds interval, uint16_t port)
+  {
+    Metrics::set_enabled(true);
+
+    Metrics::gauge("discord_cache_guilds", []() { return static_cast<double>(API::Guild::cache_size()); });
+    Metrics::gauge("discord_cache_channels", []() { return static_cast<double>(API::Channel::cache_size()); });
+    Metrics::gauge("discord_cache_messages", []() { return static_cast<double>(API::Channel::message_cache().size()); });
+    Metrics::gauge("discord_cache_message_bytes", []() { return static_cast<double>(API::Channel::message_cache().bytes()); });
+    Metrics::gauge("discord_log_dropped", []() { return static_cast<double>(Logging::dropped()); });
+
+    //  Approximate per-cache memory, summed from the figures each guild keeps.
+    std::vector<std::pair<std::string, CacheUsage GuildMemory::*>> caches = {
+      { "guilds", &GuildMemory::guilds },
+      { "channels", &GuildMemory::channels },
+      { "members", &GuildMemory::members },
+      { "users", &GuildMemory::users },
+      { "presences", &GuildMemory::presences },
+      { "roles", &GuildMemory::roles },
+      { "emojis", &GuildMemory::emojis },
+      { "voice_states", &GuildMemory::voice_states }
+    };
+
+    auto memory = std::make_shared<CacheMemoryReader>();
+
+    for (auto& cache : caches)
+    {
+      auto usage = cache.second;
+      auto labels = "cache=\"" + cache.first + "\"";
+
+      Metrics::gauge("discord_cache_objects", [memory, usage]() { return static_cast<double>((memory->read().*usage).count); }, labels);
+      Metrics::gauge("discord_cache_bytes", [memory, usage]() { return static_cast<double>((memory->read().*usage).bytes); }, labels);
+    }
+
+    //  The gauges outlive the bot, so they only hold on to the gateway weakly.
+    std::weak_ptr<Gateway> gateway = m_gateway;
+
+    Metrics::gauge("discord_gateway_latency_ms", [gateway]()
+    {
+      auto locked = gateway.lock();
+      return locked ? locked->latency().count() / 1000.0 : 0.0;
+    });
+
+    for (auto stage : { "inflate", "parse", "dispatch" })
+    {
+      std::string name = stage;
+
+      Metrics::gauge("discord_gateway_queue_depth", [gateway, name]()
+      {
+        auto locked = gateway.lock();
+
+        if (locked)
+        {
+          for (auto& stats : locked->pipeline_stats())
+          {
+            if (stats.name == name)
+            {
+              return static_cast<double>(stats.depth);
+            }
+          }
+        }
+
+        return 0.0;
+      }, "stage=\"" + name + "\"");
+    }
+
+    if (!file.empty())
+    {
+      Metrics::start_export(file, interval);
+    }
+
+    if (port != 0)
+    {
+      Metrics::serve(port);
+    }
+  }
+
+  void Bot::enable_tracing(double sample_rate, std::string file)
+  {
+    Trace::set_sample_rate(sample_rate);
+    m_trace_path = file;
+  }
+
+  void Bot::set_handler_budget(std::chrono::milliseconds budget, bool cancel)
+  {
+    m_watchdog = budget.count() > 0 ? std::make_shared<HandlerWatchdog>(budget, cancel) : nullptr;
+  }
+
+  void Bot::set_message_store(std::shared_ptr<MessageStore> store)
+  {
+    m_message_store = store;
+  }
+
+  std::shared_ptr<MessageStore> Bot::message_store() const
+  {
+    return m_message_store;
+  }
+
+  void Bot::set_cache_snapshot(std::string path, std::chrono::seconds interval)
+  {
+    m_snapshot_path = path;
+    m_snapshot_interval = interval;
+    m_last_snapshot = std::chrono::steady_clock::now();
+
+    if (!m_snapshot_path.empty())
+    {
+      restore_cache_snapshot();
+    }
+  }
+
+  void Bot::restore_cache_snapshot()
+  {
+    auto start = std::chrono::steady_clock::now();
+
+    CacheSnapshot snapshot(m_snapshot_path);
+    auto guilds = snapshot.guilds();
+
+    if (guilds.empty())
+    {
+      return;
+    }
+
+    for (auto& guild : guilds)
+    {
+      m_guilds.push_back(Discord::API::Guild::update_cache(guild));
+    }
+
+    m_restored_snapshot = true;
+
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    LOG(INFO) << "Restored " << guilds.size() << " guilds from the cache snapshot in " << elapsed << "ms.";
+  }
+
+  void Bot::save_cache_snapshot()
+  {
+    if (m_snapshot_path.empty())
+    {
+      return;
+    }
+
+    //  Never let two writers share the temporary file.
+    if (m_snapshot_task.valid())
+    {
+      m_snapshot_task.wait();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto bytes = CacheSnapshot::save(m_snapshot_path, m_guilds);
+
+    m_last_snapshot = std::chrono::steady_clock::now();
+
+    auto elapsed = std::chrono::duration<double, std::milli>(m_last_snapshot - start).count();
+    LOG(DEBUG) << "Wrote a " << bytes << " byte cache snapshot of " << m_guilds.size() << " guilds in " << elapsed << "ms.";
+  }
+
+  void Bot::start_cache_snapshot()
+  {
+    if (m_snapshot_path.empty())
+    {
+      return;
+    }
+
+    //  A slow disk shouldn't pile up writers, so wait for the next dispatch if one is still running.
+    if (m_snapshot_task.valid() && m_snapshot_task.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+      return;
+    }
+
+    //  Guilds are changed in place by later events, so copy them here and encode the copy on another thread.
+    auto start = std::chrono::steady_clock::now();
+    auto guilds = std::make_shared<std::vector<nlohmann::json>>(CacheSnapshot::copy(m_guilds));
+    auto path = m_snapshot_path;
+
+    m_last_snapshot = std::chrono::steady_clock::now();
+
+    auto elapsed = std::chrono::duration<double, std::milli>(m_last_snapshot - start).count();
+    LOG(DEBUG) << "Copied " << guilds->size() << " guilds for a cache snapshot in " << elapsed << "ms.";
+
+    m_snapshot_task = std::async(std::launch::async, [path, guilds]()
+    {
+      auto start = std::chrono::steady_clock::now();
+      auto bytes = CacheSnapshot::save(path, *guilds);
+
+      auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      LOG(DEBUG) << "Wrote a " << bytes << " byte cache snapshot of " << guilds->size() << " guilds in " << elapsed << "ms.";
+    });
+  }
+
+  bool Bot::restored_cache_snapshot() const
+  {
+    return m_restored_snapshot;
+  }
+
   void Bot::handle_dispatch(std::string event_name, nlohmann::json data)
   {
     //LOG(INFO) << "Bot.handle_dispatch entered with " << event_name.c_str() << ".";
 
+    //  The guild the event came from, if any, so slow handlers can be reported with it.
+    Snowflake event_guild;
+    set_from_json(event_guild, "guild_id", data);
+
     if (event_name == "READY")
     {
       set_from_json(m_self, "user", data);
       set_from_json(m_private_channels, "private_channels", data);
+      m_fully_ready = false;
+
+      //  Drop guilds from the snapshot that the bot was removed from while it was offline.
+      if (m_restored_snapshot)
+      {
+        std::set<Snowflake> current;
+
+        for (auto& guild : data["guilds"])
+        {
+          current.insert(guild["id"].get<Snowflake>());
+        }
+
+        for (auto& guild : m_guilds)
+        {
+          if (!current.count(guild->id()))
+          {
+            Discord::API::Guild::remove_cache(guild->id());
+          }
+        }
+
+        m_guilds.erase(std::remove_if(std::begin(m_guilds), std::end(m_guilds), [&current](std::shared_ptr<Guild> guild)
+        {
+          return !current.count(guild->id());
+        }), std::end(m_guilds));
+      }
+    }
+    else if (event_name == "RESUMED")
+    {
+      //  A session resumed after a restart skips READY, so the guilds from the snapshot are all there is.
+      m_fully_ready = m_fully_ready || m_restored_snapshot;
+
+      //  READY is also where the bot's own user comes from, so ask for it instead.
+      if (!m_self)
+      {
+        try
+        {
+          m_self = Discord::API::User::get_current_user();
+        }
+        catch (const std::exception& e)
+        {
+          LOG(ERROR) << "Could not get the bot's profile after resuming: " << e.what();
+        }
+      }
     }
     else if (event_name == "CHANNEL_CREATE" || event_name == "CHANNEL_UPDATE")
     {
@@ -163,8 +663,7 @@ namespace Discord
     }
     else if (event_name == "GUILD_CREATE")
     {
-      auto guild = Discord::API::Guild::update_cache(std::make_shared<Guild>(data));
-      m_guilds.push_back(guild);
+      handle_guild_create(std::make_shared<Guild>(data));
     }
     else if (event_name == "GUILD_UPDATE")
     {
@@ -250,12 +749,7 @@ namespace Discord
     else if (event_name == "GUILD_MEMBERS_CHUNK")
     {
       auto guild = Discord::API::Guild::get(data["guild_id"]);
-      auto members = data["members"].get<std::vector<std::shared_ptr<Member>>>();
-
-      for (auto& member : members)
-      {
-        guild->add_member(member);
-      }
+      guild->add_members(data["members"]);
     }
     else if (event_name == "GUILD_ROLE_CREATE")
     {
@@ -274,7 +768,14 @@ namespace Discord
     }
     else if (event_name == "MESSAGE_CREATE")
     {
+      if (m_message_store)
+      {
+        m_message_store->store(data);
+      }
+
       auto event = MessageEvent(data);
+      Discord::API::Channel::message_cache().add(event.message());
+
       auto word = event.content().substr(0, event.content().find_first_of(" \n"));
 
       //  If we have a prefix and it's the start of this message and it's a command
@@ -285,26 +786,58 @@ namespace Discord
         )
       {
         //  Call the command
-        m_threads.push_back(std::async(std::launch::async, m_commands[word.substr(m_prefix.size())], event));
+        auto name = "command " + word;
+        m_threads.push_back(std::async(std::launch::async, Trace::wrap(name, watched(m_watchdog, name, event_guild, m_commands[word.substr(m_prefix.size())])), event));
       }
       else if (m_on_message) 
       {
         //  Not a command, but if we have an OnMessage handler call that instead.
-        m_threads.push_back(std::async(std::launch::async, m_on_message, event));
+        m_threads.push_back(std::async(std::launch::async, Trace::wrap("on_message", watched(m_watchdog, "on_message", event_guild, m_on_message)), event));
       }
     }
     else if (event_name == "MESSAGE_UPDATE")
     {
+      if (m_message_store)
+      {
+        m_message_store->store(data);
+      }
+
+      auto& cache = Discord::API::Channel::message_cache();
+      auto previous = cache.update(data);
+
       if (m_on_message_edited)
       {
-        m_threads.push_back(std::async(std::launch::async, m_on_message_edited, MessageEvent(data)));
+        //  A cached message has the update merged in, which fills in fields partial updates leave out.
+        auto message = previous ? cache.get(previous->channel_id(), previous->id()) : nullptr;
+
+        if (!message)
+        {
+          message = std::make_shared<Message>(data);
+        }
+
+        m_threads.push_back(std::async(std::launch::async, Trace::wrap("on_message_edited", watched(m_watchdog, "on_message_edited", event_guild, m_on_message_edited)), MessageEvent(message, previous)));
       }
     }
     else if (event_name == "MESSAGE_DELETE")
     {
+      nlohmann::json stored;
+
+      if (m_message_store)
+      {
+        stored = m_message_store->remove(data["channel_id"].get<Snowflake>(), data["id"].get<Snowflake>());
+      }
+
+      auto deleted = Discord::API::Channel::message_cache().remove(data["channel_id"].get<Snowflake>(), data["id"].get<Snowflake>());
+
       if (m_on_message_deleted)
       {
-        m_threads.push_back(std::async(std::launch::async, m_on_message_deleted, MessageDeletedEvent(data)));
+        //  The store keeps messages that have long left the message cache.
+        if (!deleted && stored.is_object())
+        {
+          deleted = std::make_shared<Message>(stored);
+        }
+
+        m_threads.push_back(std::async(std::launch::async, Trace::wrap("on_message_deleted", watched(m_watchdog, "on_message_deleted", event_guild, m_on_message_deleted)), MessageDeletedEvent(data, deleted)));
       }
     }
     else if (event_name == "MESSAGE_DELETE_BULK")
@@ -314,11 +847,25 @@ namespace Discord
 
       LOG(DEBUG) << "Sending out " << ids.size() << " MessageDeletedEvents";
 
-      if (m_on_message_deleted)
+      for (auto& id : ids)
       {
-        for (auto& id : ids)
+        nlohmann::json stored;
+
+        if (m_message_store)
+        {
+          stored = m_message_store->remove(chan_id, id);
+        }
+
+        auto deleted = Discord::API::Channel::message_cache().remove(chan_id, id);
+
+        if (m_on_message_deleted)
         {
-          m_threads.push_back(std::async(std::launch::async, m_on_message_deleted, MessageDeletedEvent(id, chan_id)));
+          if (!deleted && stored.is_object())
+          {
+            deleted = std::make_shared<Message>(stored);
+          }
+
+          m_threads.push_back(std::async(std::launch::async, Trace::wrap("on_message_deleted", watched(m_watchdog, "on_message_deleted", event_guild, m_on_message_deleted)), MessageDeletedEvent(id, chan_id, deleted)));
         }
       }
     }
@@ -333,7 +880,7 @@ namespace Discord
     {
       if (m_on_typing)
       {
-        m_threads.push_back(std::async(std::launch::async, m_on_typing, TypingEvent(data)));
+        m_threads.push_back(std::async(std::launch::async, Trace::wrap("on_typing", watched(m_watchdog, "on_typing", event_guild, m_on_typing)), TypingEvent(data)));
       }
     }
     else if (event_name == "VOICE_STATE_UPDATE")
@@ -345,6 +892,12 @@ namespace Discord
 
     }
 
+    //  Only write periodic snapshots once every guild is loaded, so a partial list never replaces a full one.
+    if (m_fully_ready && !m_snapshot_path.empty() && std::chrono::steady_clock::now() - m_last_snapshot >= m_snapshot_interval)
+    {
+      start_cache_snapshot();
+    }
+
     //  If we can lock the thread array, then do so.
     if (m_thread_mutex.try_lock())
     {
@@ -360,6 +913,40 @@ namespace Discord
     }
   }
 
+  void Bot::handle_guild_create(std::shared_ptr<Guild> guild)
+  {
+    auto id = guild->id();
+    auto existing = std::find_if(std::begin(m_guilds), std::end(m_guilds), [id](std::shared_ptr<Guild> g)
+    {
+      return g->id() == id;
+    });
+
+    if (existing == std::end(m_guilds))
+    {
+      m_guilds.push_back(Discord::API::Guild::update_cache(guild));
+      return;
+    }
+
+    //  The guild came from a snapshot, so update the object that lookups already hold.
+    if (guild->large())
+    {
+      guild->merge_members(*existing);
+    }
+
+    Discord::API::Guild::update_cache(guild);
+  }
+
+  void Bot::handle_ready()
+  {
+    m_fully_ready = true;
+    start_cache_snapshot();
+
+    if (m_on_ready)
+    {
+      m_threads.push_back(std::async(std::launch::async, m_on_ready));
+    }
+  }
+
   void Bot::on_message(std::function<void(MessageEvent)> callback)
   {
     m_on_message = callback;
@@ -400,6 +987,11 @@ namespace Discord
     m_on_presence = callback;
   }
 
+  void Bot::on_ready(std::function<void()> callback)
+  {
+    m_on_ready = callback;
+  }
+
   void Bot::add_command(std::string command, std::function<void(MessageEvent)> callback)
   {
     m_commands[command] = callback;
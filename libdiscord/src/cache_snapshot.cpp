@@ -0,0 +1,361 @@
+#include "cache_snapshot.h"
+
+#include "guild.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Discord
+{
+  namespace
+  {
+    const char Magic[4] = { 'L', 'D', 'C', 'S' };
+    const uint32_t Version = 1;
+
+    //  magic + version (u32) + created (u64) + count (u32)
+    const uint64_t HeaderSize = 20;
+
+    //  guild id (u64) + offset (u64) + length (u32)
+    const uint64_t EntrySize = 20;
+
+
+    //  Run a function over [0, count) split into one range per core.
+    template<typename F>
+    void parallel_for(size_t count, F func)
+    {
+      auto workers = std::max(std::min(static_cast<size_t>(std::thread::hardware_concurrency()), count), static_cast<size_t>(1));
+      std::vector<std::future<void>> tasks;
+
+      for (size_t w = 0; w < workers; ++w)
+      {
+        auto first = count * w / workers;
+        auto last = count * (w + 1) / workers;
+
+        tasks.push_back(std::async(std::launch::async, [first, last, &func]()
+        {
+          for (auto i = first; i < last; ++i)
+          {
+            func(i);
+          }
+        }));
+      }
+
+      for (auto& task : tasks)
+      {
+        task.get();
+      }
+    }
+  }
+
+  CacheSnapshot::CacheSnapshot(std::string path) : m_path(path)
+  {
+#ifdef _WIN32
+    m_file = INVALID_HANDLE_VALUE;
+    m_mapping = nullptr;
+#else
+    m_fd = -1;
+#endif
+    m_view = nullptr;
+    m_size = 0;
+
+    if (!map())
+    {
+      unmap();
+      return;
+    }
+
+    if (m_size < HeaderSize || memcmp(m_view, Magic, sizeof(Magic)) != 0 || read_le(m_view + 4, 4) != Version)
+    {
+      LOG(WARNING) << "Cache snapshot " << m_path << " is not a valid snapshot, ignoring it.";
+      unmap();
+      return;
+    }
+
+    m_created = std::chrono::system_clock::time_point(std::chrono::milliseconds(read_le(m_view + 8, 8)));
+
+    auto count = read_le(m_view + 16, 4);
+
+    if (HeaderSize + count * EntrySize > m_size)
+    {
+      LOG(WARNING) << "Cache snapshot " << m_path << " is truncated, ignoring it.";
+      unmap();
+      return;
+    }
+
+    m_entries.reserve(count);
+
+    for (uint64_t i = 0; i < count; ++i)
+    {
+      auto data = m_view + HeaderSize + i * EntrySize;
+
+      Entry entry;
+      entry.guild_id = read_le(data, 8);
+      entry.offset = read_le(data + 8, 8);
+      entry.length = static_cast<uint32_t>(read_le(data + 16, 4));
+
+      if (entry.offset + entry.length > m_size)
+      {
+        LOG(WARNING) << "Cache snapshot " << m_path << " is truncated, ignoring it.";
+        m_entries.clear();
+        unmap();
+        return;
+      }
+
+      m_entries.push_back(entry);
+    }
+  }
+
+  CacheSnapshot::~CacheSnapshot()
+  {
+    unmap();
+  }
+
+  bool CacheSnapshot::map()
+  {
+#ifdef _WIN32
+    m_file = CreateFileA(m_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (m_file == INVALID_HANDLE_VALUE)
+    {
+      return false;
+    }
+
+    LARGE_INTEGER size;
+
+    if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+    {
+      return false;
+    }
+
+    m_size = static_cast<uint64_t>(size.QuadPart);
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+    if (!m_mapping)
+    {
+      return false;
+    }
+
+    m_view = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+    m_fd = open(m_path.c_str(), O_RDONLY);
+
+    if (m_fd < 0)
+    {
+      return false;
+    }
+
+    struct stat info;
+
+    if (fstat(m_fd, &info) != 0 || info.st_size == 0)
+    {
+      return false;
+    }
+
+    m_size = static_cast<uint64_t>(info.st_size);
+
+    auto view = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    m_view = view == MAP_FAILED ? nullptr : static_cast<const char*>(view);
+#endif
+
+    return m_view != nullptr;
+  }
+
+  void CacheSnapshot::unmap()
+  {
+#ifdef _WIN32
+    if (m_view)
+    {
+      UnmapViewOfFile(m_view);
+    }
+
+    if (m_mapping)
+    {
+      CloseHandle(m_mapping);
+    }
+
+    if (m_file != INVALID_HANDLE_VALUE)
+    {
+      CloseHandle(m_file);
+    }
+
+    m_file = INVALID_HANDLE_VALUE;
+    m_mapping = nullptr;
+#else
+    if (m_view)
+    {
+      munmap(const_cast<char*>(m_view), m_size);
+    }
+
+    if (m_fd >= 0)
+    {
+      close(m_fd);
+    }
+
+    m_fd = -1;
+#endif
+
+    m_view = nullptr;
+    m_size = 0;
+  }
+
+  std::shared_ptr<Guild> CacheSnapshot::decode(const Entry& entry) const
+  {
+    auto data = reinterpret_cast<const uint8_t*>(m_view + entry.offset);
+    std::vector<uint8_t> packed(data, data + entry.length);
+
+    return std::make_shared<Guild>(nlohmann::json::from_msgpack(packed));
+  }
+
+  uint64_t CacheSnapshot::save(std::string path, const std::vector<std::shared_ptr<Guild>>& guilds)
+  {
+    return save(path, copy(guilds));
+  }
+
+  std::vector<nlohmann::json> CacheSnapshot::copy(const std::vector<std::shared_ptr<Guild>>& guilds)
+  {
+    std::vector<nlohmann::json> copies(guilds.size());
+
+    parallel_for(guilds.size(), [&guilds, &copies](size_t i)
+    {
+      copies[i] = *guilds[i];
+    });
+
+    return copies;
+  }
+
+  uint64_t CacheSnapshot::save(std::string path, const std::vector<nlohmann::json>& guilds)
+  {
+    std::vector<std::vector<uint8_t>> encoded(guilds.size());
+
+    parallel_for(guilds.size(), [&guilds, &encoded](size_t i)
+    {
+      encoded[i] = nlohmann::json::to_msgpack(guilds[i]);
+    });
+
+    auto created = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+    std::string header(Magic, sizeof(Magic));
+    write_le(header, Version, 4);
+    write_le(header, static_cast<uint64_t>(created), 8);
+    write_le(header, guilds.size(), 4);
+
+    auto offset = HeaderSize + guilds.size() * EntrySize;
+
+    for (size_t i = 0; i < guilds.size(); ++i)
+    {
+      write_le(header, static_cast<uint64_t>(guilds[i]["id"].get<Snowflake>()), 8);
+      write_le(header, offset, 8);
+      write_le(header, encoded[i].size(), 4);
+      offset += encoded[i].size();
+    }
+
+    //  Write a temporary file and swap it in, so a crash never leaves a half written snapshot.
+    auto temporary = path + ".tmp";
+
+    {
+      std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+
+      if (!out.is_open())
+      {
+        LOG(ERROR) << "Could not open " << temporary << " to write a cache snapshot.";
+        return 0;
+      }
+
+      out.write(header.data(), header.size());
+
+      for (auto& guild : encoded)
+      {
+        out.write(reinterpret_cast<const char*>(guild.data()), guild.size());
+      }
+
+      if (!out)
+      {
+        LOG(ERROR) << "Could not write cache snapshot to " << temporary;
+        return 0;
+      }
+    }
+
+    //  Renaming over an existing file fails on Windows, so remove it and try again.
+    if (std::rename(temporary.c_str(), path.c_str()) != 0)
+    {
+      std::remove(path.c_str());
+
+      if (std::rename(temporary.c_str(), path.c_str()) != 0)
+      {
+        LOG(ERROR) << "Could not replace cache snapshot " << path;
+        return 0;
+      }
+    }
+
+    return offset;
+  }
+
+  size_t CacheSnapshot::size() const
+  {
+    return m_entries.size();
+  }
+
+  std::chrono::system_clock::time_point CacheSnapshot::created() const
+  {
+    return m_created;
+  }
+
+  std::vector<Snowflake> CacheSnapshot::guild_ids() const
+  {
+    std::vector<Snowflake> ids;
+    ids.reserve(m_entries.size());
+
+    for (auto& entry : m_entries)
+    {
+      ids.push_back(entry.guild_id);
+    }
+
+    return ids;
+  }
+
+  std::shared_ptr<Guild> CacheSnapshot::guild(Snowflake guild_id) const
+  {
+    auto entry = std::find_if(std::begin(m_entries), std::end(m_entries), [guild_id](const Entry& e)
+    {
+      return e.guild_id == guild_id;
+    });
+
+    return entry == std::end(m_entries) ? nullptr : decode(*entry);
+  }
+
+  std::vector<std::shared_ptr<Guild>> CacheSnapshot::guilds() const
+  {
+    std::vector<std::shared_ptr<Guild>> guilds(m_entries.size());
+
+    parallel_for(m_entries.size(), [this, &guilds](size_t i)
+    {
+      try
+      {
+        guilds[i] = decode(m_entries[i]);
+      }
+      catch (const std::exception& e)
+      {
+        LOG(WARNING) << "Could not decode guild " << m_entries[i].guild_id.to_string() << " from the cache snapshot: " << e.what();
+      }
+    });
+
+    guilds.erase(std::remove(std::begin(guilds), std::end(guilds), nullptr), std::end(guilds));
+
+    return guilds;
+  }
+}
@@ -0,0 +1,60 @@
+#include "cancellation.h"
+
+#include "api_exceptions.h"
+
+namespace Discord
+{
+  namespace
+  {
+    thread_local CancellationToken CurrentToken;
+  }
+
+  CancellationToken CancellationToken::create()
+  {
+    CancellationToken token;
+    token.m_cancelled = std::make_shared<std::atomic<bool>>(false);
+    return token;
+  }
+
+  void CancellationToken::cancel() const
+  {
+    if (m_cancelled)
+    {
+      m_cancelled->store(true, std::memory_order_relaxed);
+    }
+  }
+
+  bool CancellationToken::can_cancel() const
+  {
+    return m_cancelled != nullptr;
+  }
+
+  bool CancellationToken::cancelled() const
+  {
+    return m_cancelled && m_cancelled->load(std::memory_order_relaxed);
+  }
+
+  void CancellationToken::throw_if_cancelled() const
+  {
+    if (cancelled())
+    {
+      throw CancelledException("The handler was cancelled.");
+    }
+  }
+
+  const CancellationToken& CancellationToken::current()
+  {
+    return CurrentToken;
+  }
+
+  CancellationScope::CancellationScope(const CancellationToken& token)
+  {
+    m_previous = CurrentToken;
+    CurrentToken = token;
+  }
+
+  CancellationScope::~CancellationScope()
+  {
+    CurrentToken = m_previous;
+  }
+}
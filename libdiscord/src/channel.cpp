@@ -141,6 +141,11 @@ namespace Discord
     return m_user_limit;
   }
 
+  std::vector<Overwrite> Channel::permission_overwrites() const
+  {
+    return m_permission_overwrites;
+  }
+
   void Channel::set_name(std::string name)
   {
     if (name.size() >= MinNameSize && name.size() <= MaxNameSize)
@@ -226,6 +231,11 @@ namespace Discord
     return Discord::API::Channel::get_message(m_id, message_id);
   }
 
+  MessageHistory Channel::history(size_t limit, std::function<bool(std::shared_ptr<Message>)> until, Snowflake before) const
+  {
+    return MessageHistory(m_id, limit, until, before);
+  }
+
   std::shared_ptr<Message> Channel::send_message(std::string content, bool tts) const
   {
     return Discord::API::Channel::create_message(m_id, content, tts);
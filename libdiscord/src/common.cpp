@@ -1,6 +1,14 @@
 #include "common.h"
 
+#include <bitset>
+#include <cstring>
 #include <fstream>
+#include <zlib.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LIBDISCORD_USE_SSE2
+#endif
 
 INITIALIZE_EASYLOGGINGPP
 
@@ -40,4 +48,210 @@ namespace Discord
       ofs << json.dump(pretty ? 2 : -1);
     }
   }
-}
\ No newline at end of file
+
+  size_t utf8_length(const std::string& str)
+  {
+    auto data = reinterpret_cast<const uint8_t*>(str.data());
+    auto size = str.size();
+    size_t count = 0;
+    size_t i = 0;
+
+#ifdef LIBDISCORD_USE_SSE2
+    //  Every byte that isn't a continuation byte (10xxxxxx) starts a code point.
+    //  As signed values, continuation bytes are exactly the ones <= -65.
+    const auto threshold = _mm_set1_epi8(-65);
+
+    for (; i + 16 <= size; i += 16)
+    {
+      auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+      auto mask = _mm_movemask_epi8(_mm_cmpgt_epi8(chunk, threshold));
+      count += std::bitset<16>(static_cast<unsigned long>(mask)).count();
+    }
+#endif
+
+    for (; i < size; ++i)
+    {
+      if ((data[i] & 0xC0) != 0x80)
+      {
+        count++;
+      }
+    }
+
+    return count;
+  }
+
+  namespace detail
+  {
+    /** Toggle code block state for every fence found in a piece of a message. */
+    void track_code_blocks(const std::string& piece, std::string& open_fence)
+    {
+      auto pos = piece.find("```");
+
+      while (pos != std::string::npos)
+      {
+        pos += 3;
+
+        if (open_fence.empty())
+        {
+          //  Keep the language tag so the block can be reopened with the same highlighting.
+          auto end = piece.find_first_of(" \t\r\n`", pos);
+          auto lang = piece.substr(pos, (end == std::string::npos ? piece.size() : end) - pos);
+
+          open_fence = "```" + lang;
+          pos += lang.size();
+        }
+        else
+        {
+          open_fence.clear();
+        }
+
+        pos = piece.find("```", pos);
+      }
+    }
+  }
+
+  std::vector<std::string> split_message(const std::string& content, size_t max_length)
+  {
+    std::vector<std::string> pieces;
+
+    if (utf8_length(content) <= max_length)
+    {
+      pieces.push_back(content);
+      return pieces;
+    }
+
+    static const std::string close_fence = "\n```";
+
+    std::string open_fence;
+    size_t pos = 0;
+
+    while (pos < content.size())
+    {
+      auto prefix = open_fence.empty() ? "" : open_fence + "\n";
+      auto overhead = utf8_length(prefix) + close_fence.size();
+      auto budget = max_length > overhead ? max_length - overhead : 1;
+
+      //  Walk forward budget code points to find the furthest byte we could cut at.
+      auto limit = pos;
+      size_t points = 0;
+
+      while (limit < content.size() && points <= budget)
+      {
+        if ((static_cast<uint8_t>(content[limit]) & 0xC0) != 0x80)
+        {
+          if (points == budget)
+          {
+            break;
+          }
+
+          points++;
+        }
+
+        limit++;
+      }
+
+      auto cut = limit;
+      auto skip = 0;
+
+      if (limit < content.size())
+      {
+        auto window = content.substr(pos, limit - pos);
+        auto newline = window.find_last_of('\n');
+        auto space = window.find_last_of(" \t");
+
+        if (newline != std::string::npos && newline > 0)
+        {
+          cut = pos + newline;
+          skip = 1;
+        }
+        else if (space != std::string::npos && space > 0)
+        {
+          cut = pos + space;
+          skip = 1;
+        }
+        else
+        {
+          //  Hard split, but never through the middle of a code fence.
+          while (cut > pos + 1 && content[cut - 1] == '`')
+          {
+            cut--;
+          }
+        }
+      }
+
+      auto piece = content.substr(pos, cut - pos);
+      detail::track_code_blocks(piece, open_fence);
+
+      if (!open_fence.empty())
+      {
+        piece += close_fence;
+      }
+
+      pieces.push_back(prefix + piece);
+      pos = cut + skip;
+    }
+
+    return pieces;
+  }
+
+  std::string zlib_inflate(const std::string& compressed)
+  {
+    std::string str;
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+
+    if (inflateInit(&zs) != Z_OK)
+    {
+      LOG(ERROR) << "Could not initialize zlib Inflate";
+    }
+
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(compressed.data()));
+    zs.avail_in = static_cast<uInt>(compressed.size());
+
+    int ret;
+    char buffer[32768];
+
+    do
+    {
+      zs.next_out = reinterpret_cast<Bytef *>(buffer);
+      zs.avail_out = sizeof(buffer);
+
+      ret = inflate(&zs, 0);
+
+      if (str.size() < zs.total_out)
+      {
+        str.append(buffer, zs.total_out - str.size());
+      }
+    } while (ret == Z_OK);
+
+    inflateEnd(&zs);
+
+    if (ret != Z_STREAM_END)
+    {
+      LOG(ERROR) << "Error during zlib decompression: (" << ret << ")";
+    }
+
+    return str;
+  }
+
+  void write_le(std::string& out, uint64_t value, size_t size)
+  {
+    for (size_t i = 0; i < size; ++i)
+    {
+      out.push_back(static_cast<char>((value >> (i * 8)) & 0xFF));
+    }
+  }
+
+  uint64_t read_le(const char* data, size_t size)
+  {
+    uint64_t value = 0;
+
+    for (size_t i = 0; i < size; ++i)
+    {
+      value |= static_cast<uint64_t>(static_cast<uint8_t>(data[i])) << (i * 8);
+    }
+
+    return value;
+  }
+}
@@ -17,6 +17,8 @@ namespace Discord
   {
     m_stream << other.m_stream.str();
     m_message = other.m_message;
+    m_previous = other.m_previous;
+    m_cancellation = other.m_cancellation;
   }
 
   std::shared_ptr<User> MessageEvent::author() const
@@ -49,6 +51,11 @@ namespace Discord
     return m_message;
   }
 
+  std::shared_ptr<Message> MessageEvent::previous() const
+  {
+    return m_previous;
+  }
+
   bool MessageEvent::from_bot() const
   {
     return m_message->author()->is_bot();
@@ -59,15 +66,37 @@ namespace Discord
     return m_message->respond(content, tts);
   }
 
-  MessageDeletedEvent::MessageDeletedEvent(Snowflake id, Snowflake channel_id) : Identifiable(id)
+  const CancellationToken& MessageEvent::cancellation() const
+  {
+    return m_cancellation;
+  }
+
+  bool MessageEvent::cancelled() const
+  {
+    return m_cancellation.cancelled();
+  }
+
+  void MessageEvent::set_cancellation(CancellationToken token)
+  {
+    m_cancellation = token;
+  }
+
+  MessageDeletedEvent::MessageDeletedEvent(Snowflake id, Snowflake channel_id, std::shared_ptr<Message> message) : Identifiable(id)
   {
     m_channel_id = channel_id;
+    m_message = message;
   }
 
-  MessageDeletedEvent::MessageDeletedEvent(nlohmann::json data)
+  MessageDeletedEvent::MessageDeletedEvent(nlohmann::json data, std::shared_ptr<Message> message)
   {
     set_id_from_json("id", data);
     set_from_json(m_channel_id, "channel_id", data);
+    m_message = message;
+  }
+
+  std::shared_ptr<Message> MessageDeletedEvent::message() const
+  {
+    return m_message;
   }
 
   std::shared_ptr<Channel> MessageDeletedEvent::channel() const
@@ -55,4 +55,19 @@ namespace Discord
   {
     return m_user;
   }
+
+  std::vector<Snowflake> PresenceUpdate::roles() const
+  {
+    return m_roles;
+  }
+
+  Game PresenceUpdate::game() const
+  {
+    return m_game;
+  }
+
+  std::string PresenceUpdate::status() const
+  {
+    return m_status;
+  }
 }
@@ -1,24 +1,252 @@
 #include "gateway.h"
 
 #include "api.h"
+#include "api/api_guild.h"
 #include "bot.h"
+#include "gateway_recording.h"
+#include "guild.h"
+#include "logging.h"
+#include "member.h"
+#include "probes.h"
 
-#include <zlib.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
 #include <cpprest/http_msg.h>
 
 namespace Discord
 {
-  const uint8_t Gateway::LARGE_SERVER = 100;
+  namespace
+  {
+    /** Find the value of a key at the top level of a JSON object without parsing it. Everything
+        nested is skipped over.
+
+        @param text The raw payload.
+        @param key The key to look for.
+        @return The position of the first character of the value, or npos if the key isn't there.
+     */
+    size_t find_top_level(const std::string& text, const char* key)
+    {
+      const char* whitespace = " \t\r\n";
+      size_t depth = 0;
+
+      for (size_t i = 0; i < text.size(); ++i)
+      {
+        auto c = text[i];
+
+        if (c == '{' || c == '[')
+        {
+          depth++;
+        }
+        else if (c == '}' || c == ']')
+        {
+          depth--;
+        }
+        else if (c == '"')
+        {
+          auto end = i + 1;
+
+          while (end < text.size() && text[end] != '"')
+          {
+            end += text[end] == '\\' ? 2 : 1;
+          }
+
+          if (end >= text.size())
+          {
+            return std::string::npos;
+          }
+
+          auto colon = text.find_first_not_of(whitespace, end + 1);
+
+          if (depth == 1 && colon != std::string::npos && text[colon] == ':')
+          {
+            if (text.compare(i + 1, end - i - 1, key) == 0)
+            {
+              return text.find_first_not_of(whitespace, colon + 1);
+            }
+
+            i = colon;
+          }
+          else
+          {
+            i = end;
+          }
+        }
+      }
+
+      return std::string::npos;
+    }
+
+    /** Find the event name and sequence number of a dispatch without parsing the payload.
+
+        @param text The raw payload.
+        @param name Set to the event name.
+        @param sequence Set to the sequence number.
+        @return Whether the payload is a dispatch with both fields.
+     */
+    bool peek_dispatch(const std::string& text, std::string& name, uint32_t& sequence)
+    {
+      //  Event names never contain escapes. Anything other than a string means it isn't a dispatch.
+      auto name_start = find_top_level(text, "t");
+
+      if (name_start == std::string::npos || text[name_start] != '"')
+      {
+        return false;
+      }
+
+      auto name_end = text.find('"', name_start + 1);
+      auto sequence_start = find_top_level(text, "s");
+
+      if (name_end == std::string::npos || sequence_start == std::string::npos || !isdigit(static_cast<unsigned char>(text[sequence_start])))
+      {
+        return false;
+      }
+
+      name = text.substr(name_start + 1, name_end - name_start - 1);
+      sequence = static_cast<uint32_t>(std::strtoul(text.c_str() + sequence_start, nullptr, 10));
+      return true;
+    }
+
+    /** Find the opcode of a payload without parsing it.
+
+        @param text The raw payload.
+        @param op Set to the opcode.
+        @return Whether the payload has a numeric opcode.
+     */
+    bool peek_op(const std::string& text, uint8_t& op)
+    {
+      auto start = find_top_level(text, "op");
+
+      if (start == std::string::npos || !isdigit(static_cast<unsigned char>(text[start])))
+      {
+        return false;
+      }
+
+      op = static_cast<uint8_t>(std::strtoul(text.c_str() + start, nullptr, 10));
+      return true;
+    }
+
+    /** Holds one of the parse stage's decoder slots, waiting for one to be free, and gives it back
+        when destroyed.
+     */
+    class DecoderSlot
+    {
+      std::mutex& m_mutex;
+      size_t& m_active;
+      std::condition_variable& m_available;
+    public:
+      DecoderSlot(std::mutex& mutex, size_t& active, std::condition_variable& available, size_t limit)
+        : m_mutex(mutex), m_active(active), m_available(available)
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_available.wait(lock, [this, limit]() { return m_active < limit; });
+        m_active++;
+      }
+
+      ~DecoderSlot()
+      {
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_active--;
+        }
+
+        m_available.notify_one();
+      }
+
+      DecoderSlot(const DecoderSlot&) = delete;
+      DecoderSlot& operator=(const DecoderSlot&) = delete;
+    };
+
+    /** Get the intents that cause an event to be sent.
+
+        @param name The event name.
+        @return The intents, any of which deliver the event. Zero for events that are always needed.
+     */
+    uint32_t event_intents(const std::string& name)
+    {
+      //  GUILD_CREATE and GUILD_DELETE are left out, since startup and the guild cache depend on them.
+      static const std::map<std::string, uint32_t> intents =
+      {
+        { "GUILD_UPDATE", Intents::Guilds },
+        { "GUILD_ROLE_CREATE", Intents::Guilds },
+        { "GUILD_ROLE_UPDATE", Intents::Guilds },
+        { "GUILD_ROLE_DELETE", Intents::Guilds },
+        { "CHANNEL_CREATE", Intents::Guilds },
+        { "CHANNEL_UPDATE", Intents::Guilds },
+        { "CHANNEL_DELETE", Intents::Guilds },
+        { "CHANNEL_PINS_UPDATE", Intents::Guilds | Intents::DirectMessages },
+        { "GUILD_MEMBER_ADD", Intents::GuildMembers },
+        { "GUILD_MEMBER_UPDATE", Intents::GuildMembers },
+        { "GUILD_MEMBER_REMOVE", Intents::GuildMembers },
+        { "GUILD_BAN_ADD", Intents::GuildBans },
+        { "GUILD_BAN_REMOVE", Intents::GuildBans },
+        { "GUILD_EMOJIS_UPDATE", Intents::GuildEmojis },
+        { "GUILD_INTEGRATIONS_UPDATE", Intents::GuildIntegrations },
+        { "WEBHOOKS_UPDATE", Intents::GuildWebhooks },
+        { "INVITE_CREATE", Intents::GuildInvites },
+        { "INVITE_DELETE", Intents::GuildInvites },
+        { "VOICE_STATE_UPDATE", Intents::GuildVoiceStates },
+        { "PRESENCE_UPDATE", Intents::GuildPresences },
+        { "MESSAGE_CREATE", Intents::GuildMessages | Intents::DirectMessages },
+        { "MESSAGE_UPDATE", Intents::GuildMessages | Intents::DirectMessages },
+        { "MESSAGE_DELETE", Intents::GuildMessages | Intents::DirectMessages },
+        { "MESSAGE_DELETE_BULK", Intents::GuildMessages },
+        { "MESSAGE_REACTION_ADD", Intents::GuildMessageReactions | Intents::DirectMessageReactions },
+        { "MESSAGE_REACTION_REMOVE", Intents::GuildMessageReactions | Intents::DirectMessageReactions },
+        { "MESSAGE_REACTION_REMOVE_ALL", Intents::GuildMessageReactions | Intents::DirectMessageReactions },
+        { "TYPING_START", Intents::GuildMessageTyping | Intents::DirectMessageTyping }
+      };
+
+      auto event = intents.find(name);
+      return event == std::end(intents) ? 0 : event->second;
+    }
+  }
+
+  const uint32_t Gateway::LARGE_SERVER = 100;
+  const size_t Gateway::MAX_MEMBER_REQUEST_IDS = 100;
+  const uint32_t Gateway::MEMBER_REQUEST_TIMEOUT = 30000;
+  const size_t Gateway::MAX_DECODERS = std::max(std::thread::hardware_concurrency(), 2u);
+  const size_t Gateway::RECEIVE_QUEUE_SIZE = 256;
+  const uint32_t Gateway::HELLO_TIMEOUT = 5000;
+  const uint32_t Gateway::RECONNECT_BASE_DELAY = 1000;
+  const uint32_t Gateway::RECONNECT_MAX_DELAY = 60000;
+  const int64_t Gateway::SESSION_MAX_AGE = 5 * 60 * 1000;
+  const size_t Gateway::SEND_LIMIT = 120;
+  const uint32_t Gateway::SEND_WINDOW = 60000;
   const utility::string_t Gateway::VERSION = utility::string_t(U("6"));
   const utility::string_t Gateway::ENCODING = utility::string_t(U("json"));
 
-  Gateway::Gateway()
+  Gateway::Gateway() : m_latency_histogram({ 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000 }),
+    m_inflate_stage("inflate"), m_parse_stage("parse"), m_dispatch_stage("dispatch"),
+    m_receive_latency({ 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 25, 50, 100, 250, 500, 1000 })
   {
     m_heartbeat_interval = 0;
+    m_heartbeat_running = false;
+    m_latency_us = 0;
     m_last_seq = 0;
     m_recieved_ack = true; // Set true to start because first hearbeat sent doesn't require an ACK.
     m_connected = false;
     m_use_resume = false;
+    m_large_threshold = LARGE_SERVER;
+    m_intents = Intents::All;
+    m_filtered_events = 0;
+    m_received_messages = 0;
+    m_finished_messages = 0;
+    m_replaying = false;
+    m_next_nonce = 0;
+    m_active_decoders = 0;
+    m_loading = false;
+    m_loaded_guilds = 0;
+    m_action = Action::None;
+    m_stopped = false;
+    m_connection_id = 0;
+    m_reconnect_attempts = 0;
+    m_reconnecting = false;
+    m_time_to_resume_ms = 0;
+    m_rng.seed(std::random_device{}());
+    m_send_stopped = false;
   }
 
   Gateway::Gateway(std::string token) : Gateway()
@@ -26,17 +254,82 @@ namespace Discord
     m_token = token;
   }
 
+  Gateway::~Gateway()
+  {
+    //  The socket's handlers hold this gateway, so stop them before anything they use goes away.
+    abandon_connection();
+
+    {
+      std::lock_guard<std::mutex> lock(m_state_mutex);
+      m_action = Action::Stop;
+    }
+
+    m_state_changed.notify_all();
+
+    if (m_reconnect_thread.joinable())
+    {
+      m_reconnect_thread.join();
+    }
+
+    stop_heartbeat();
+
+    //  Closing the first queue lets each stage finish what it has and then close the next one.
+    m_inflate_stage.queue.close();
+
+    for (auto stage : { &m_inflate_stage, &m_parse_stage, &m_dispatch_stage })
+    {
+      if (stage->thread.joinable())
+      {
+        stage->thread.join();
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_send_mutex);
+      m_send_stopped = true;
+    }
+
+    m_send_ready.notify_all();
+
+    if (m_send_thread.joinable())
+    {
+      m_send_thread.join();
+    }
+
+    save_session();
+  }
+
   void Gateway::set_bot(std::weak_ptr<Bot> bot)
   {
     m_bot = bot;
   }
 
-  void Gateway::start()
+  void Gateway::set_url(std::string url)
+  {
+    m_wss_url = utility::conversions::to_string_t(url);
+
+    if (!m_wss_url.empty())
+    {
+      m_wss_url += url_query();
+    }
+  }
+
+  utility::string_t Gateway::url_query()
   {
     web::uri_builder builder(U(""));
     builder.append_query(U("v"), VERSION);
     builder.append_query(U("encoding"), ENCODING);
 
+    return builder.to_string();
+  }
+
+  void Gateway::start()
+  {
+    if (!m_session_file.empty())
+    {
+      load_session();
+    }
+
     if (m_wss_url.empty())
     {
       do
@@ -54,247 +347,1407 @@ namespace Discord
         }
       } while (m_wss_url.empty());  //  Keep trying until we get it.
 
-      m_wss_url += builder.to_string();
+      m_wss_url += url_query();
     }
 
-    m_client.set_message_handler([&](web::websockets::client::websocket_incoming_message msg)
-    {
-      try 
-      {
-        on_message(msg);
-      }
-      catch (const std::exception& e)
-      {
-        LOG(ERROR) << "WebSocket Exception: " << e.what();
-      }
-    });
+    start_pipeline();
+    m_send_thread = std::thread(&Gateway::send_loop, this);
+    m_reconnect_thread = std::thread(&Gateway::reconnect_loop, this);
 
-    m_client.set_close_handler([&](web::websockets::client::websocket_close_status status, const utility::string_t& reason, const std::error_code& code)
-    {
-      if (m_connected)
-      {
-        LOG(ERROR)  << "WebSocket connection has closed with reason "
-                    << utility::conversions::to_utf8string(reason) << " - "
-                    << code.message() << " (" << code.value() << ")";
-        m_connected = false;
-        connect();
-      }
-    });
+    std::unique_lock<std::mutex> lock(m_state_mutex);
+    m_action = Action::Connect;
+    m_state_changed.notify_all();
 
-    connect();
+    m_state_changed.wait(lock, [this]() { return m_connected || m_stopped; });
   }
 
-  void Gateway::connect()
+  void Gateway::reconnect_loop()
   {
-    LOG(DEBUG) << "Connecting to " << utility::conversions::to_utf8string(m_wss_url);
+    std::unique_lock<std::mutex> lock(m_state_mutex);
 
-    while (!m_connected)
+    for (;;)
     {
-      //  Try to connect
-      m_client.connect(m_wss_url).then([](){}).get();
+      m_state_changed.wait(lock, [this]() { return m_action != Action::None; });
 
-      //  Sleep 5 seconds before checking connected status.
-      std::this_thread::sleep_for(std::chrono::seconds(5));
+      auto action = m_action;
+      m_action = Action::None;
 
-      if (!m_connected)
+      if (action == Action::Stop)
       {
-        LOG(DEBUG) << "Took longer than 5 seconds to receive a HELLO response, trying to connect again.";
+        break;
       }
-    }
-  }
-
-  void Gateway::on_message(web::websockets::client::websocket_incoming_message msg)
-  {
-    std::string str;
-
-    //  If the message is binary data, then we need to decompress it using ZLib.
-    if (msg.message_type() == web::websockets::client::websocket_message_type::binary_message)
-    {
-      Concurrency::streams::container_buffer<std::string> strbuf;
-      std::string compressed;
 
-      //  Read the entire binary payload and put into a string container
-      compressed = msg.body().read_to_end(strbuf).then([strbuf](size_t bytesRead)
+      if (action == Action::Reidentify)
       {
-        return strbuf.collection();
-      }).get();
+        //  Discord asks for a random wait of 1 to 5 seconds before identifying again.
+        auto delay = std::chrono::milliseconds(std::uniform_int_distribution<int>(1000, 5000)(m_rng));
 
-      z_stream zs;
-      memset(&zs, 0, sizeof(zs));
+        //  If the connection closes while waiting, reconnecting takes care of it instead.
+        if (m_state_changed.wait_for(lock, delay, [this]() { return m_action != Action::None; }))
+        {
+          continue;
+        }
 
-      if (inflateInit(&zs) != Z_OK)
-      {
-        LOG(ERROR) << "Could not initialize zlib Inflate";
-      }
+        lock.unlock();
 
-      zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(compressed.data()));
-      zs.avail_in = static_cast<uInt>(compressed.size());
+        if (m_use_resume)
+        {
+          send_resume();
+        }
+        else
+        {
+          send_identify();
+          m_use_resume = true;
+        }
 
-      int ret;
-      char buffer[32768];
+        lock.lock();
+        continue;
+      }
 
-      do
+      //  The first attempt after a disconnect is immediate, later ones back off exponentially.
+      if (m_reconnect_attempts > 0)
       {
-        zs.next_out = reinterpret_cast<Bytef *>(buffer);
-        zs.avail_out = sizeof(buffer);
+        auto exponent = std::min(m_reconnect_attempts - 1, 16u);
+        auto limit = std::min(static_cast<uint64_t>(RECONNECT_BASE_DELAY) << exponent, static_cast<uint64_t>(RECONNECT_MAX_DELAY));
+
+        //  Pick a random delay in the upper half so many clients don't retry in step.
+        auto delay = std::chrono::milliseconds(std::uniform_int_distribution<uint64_t>(limit / 2, limit)(m_rng));
 
-        ret = inflate(&zs, 0);
+        LOG(INFO) << "Reconnecting to the gateway in " << delay.count() << "ms (attempt " << m_reconnect_attempts + 1 << ").";
 
-        if (str.size() < zs.total_out)
+        if (m_state_changed.wait_for(lock, delay, [this]() { return m_action == Action::Stop; }))
         {
-          str.append(buffer, zs.total_out - str.size());
+          break;
         }
-      } while (ret == Z_OK);
+      }
 
-      inflateEnd(&zs);
+      m_reconnect_attempts++;
 
-      if (ret != Z_STREAM_END)
+      if (Metrics::enabled())
       {
-        LOG(ERROR) << "Error during zlib decompression: (" << ret << ")";
+        Metrics::counter("discord_gateway_reconnects_total").increment();
       }
-    }
-    else
-    {
-      //  If not compressed, just get the string.
-      str = msg.extract_string().get();
-    }
-
-    //  Parse our payload as JSON.
-    auto payload = nlohmann::json::parse(str.c_str());
-
-    if (str.size() > 1000)
-    {
-      LOG(DEBUG) << "Got WS Payload: " << payload.dump(2).substr(0, 1000);
-    }
-    else
-    {
-      LOG(DEBUG) << "Got WS Payload: " << payload.dump(2);
-    }
-
-    auto data = payload["d"]; //  Get the data for the event
 
-    switch (payload["op"].get<uint8_t>())
-    {
-    case Dispatch:
-      m_last_seq = payload["s"];
-      handle_dispatch_event(payload["t"], data);
-      break;
-    case Reconnect:
-      send_resume();
-      break;
-    case Hello:
-      m_connected = true;
-      m_heartbeat_interval = data["heartbeat_interval"].get<uint32_t>();
-      LOG(DEBUG) << "Set heartbeat interval to " << m_heartbeat_interval;
+      lock.unlock();
+      auto opened = open_connection();
+      lock.lock();
 
-      if (m_use_resume)
+      auto hello = opened && m_state_changed.wait_for(lock, std::chrono::milliseconds(HELLO_TIMEOUT), [this]()
       {
-        LOG(INFO) << "Connected again, sending Resume packet.";
-        send_resume();
-      }
-      else
+        return m_connected || m_action != Action::None;
+      });
+
+      if (!hello)
       {
-        m_heartbeat_thread = std::thread([&]() {
-          while (connected())
-          {
-            send_heartbeat();
-            std::this_thread::sleep_for(std::chrono::milliseconds(m_heartbeat_interval));
-          }
+        LOG(WARNING) << "Did not receive a HELLO from the gateway, trying to connect again.";
 
-          LOG(DEBUG) << "Disconnected, stopping heartbeats.";
-        });
+        lock.unlock();
+        abandon_connection();
+        lock.lock();
+      }
 
-        LOG(DEBUG) << "Connected, sending Identify packet.";
-        send_identify();
-        m_use_resume = true;  //  Next time use Resume
+      if (!m_connected && m_action == Action::None)
+      {
+        m_action = Action::Connect;
       }
-      break;
-    case Heartbeat_ACK:
-      LOG(TRACE) << "Recieved Heartbeat ACK.";
-      m_recieved_ack = true;
-      break;
-    default:
-      LOG(WARNING) << "Unhandled WS Opcode (" << static_cast<int>(payload["op"].get<uint8_t>()) << ")";
     }
+
+    m_stopped = true;
+    m_state_changed.notify_all();
   }
 
-  void Gateway::handle_dispatch_event(std::string event_name, nlohmann::json data)
+  bool Gateway::open_connection()
   {
-    //LOG(INFO) << "Recieved " << event_name << " event.";
+    LOG(DEBUG) << "Connecting to " << utility::conversions::to_utf8string(m_wss_url);
 
-    if (event_name == "READY")
-    {
-      LOG(DEBUG) << "Using gateway version " << data["v"];
+    m_connect_time = std::chrono::steady_clock::now();
 
-      //  Save session id so we can restart a session
-      m_session_id = data["session_id"].get<std::string>();
+    //  A websocket client can't be used again once it has closed, so every attempt gets a new one.
+    auto id = ++m_connection_id;
+    web::websockets::client::websocket_callback_client client;
 
-      if (auto p = m_bot.lock())
+    client.set_message_handler([this, id](web::websockets::client::websocket_incoming_message msg)
+    {
+      if (id != m_connection_id)
       {
-        p->handle_dispatch(event_name, data);
+        return;
       }
-      else
+
+      try 
       {
-        LOG(ERROR) << "Could not lock Bot pointer.";
+        on_message(msg);
       }
-    }
-    else if (event_name == "RESUMED")
-    {
-      LOG(DEBUG) << "Successfully resumed.";
-    }
-    else
-    {
-      if (auto p = m_bot.lock())
+      catch (const std::exception& e)
       {
-        p->handle_dispatch(event_name, data);
+        LOG(ERROR) << "WebSocket Exception: " << e.what();
       }
-      else
+    });
+
+    client.set_close_handler([this, id](web::websockets::client::websocket_close_status status, const utility::string_t& reason, const std::error_code& code)
+    {
+      if (id == m_connection_id)
       {
-        LOG(ERROR) << "Could not lock Bot pointer.";
+        on_close(status, reason, code);
       }
+    });
+
+    {
+      std::lock_guard<std::mutex> lock(m_client_mutex);
+      m_client = client;
+    }
+
+    {
+      //  Heartbeats and session packets belong to the old connection, and the new one has a fresh budget.
+      std::lock_guard<std::mutex> lock(m_send_mutex);
+      m_send_queues[Critical].clear();
+      m_sent_times.clear();
+    }
+
+    try
+    {
+      client.connect(m_wss_url).get();
+      return true;
+    }
+    catch (const std::exception& e)
+    {
+      LOG(ERROR) << "Could not connect to the gateway: " << e.what();
+      return false;
     }
   }
 
-  void Gateway::send(Opcode op, nlohmann::json data)
+  void Gateway::abandon_connection()
   {
-    nlohmann::json packet = {
-      { "op", op },
-      { "d", data }
-    };
-
-    web::websockets::client::websocket_outgoing_message msg;
-    msg.set_utf8_message(packet.dump());
+    //  Stop listening to the connection before closing it, so closing doesn't start another reconnect.
+    m_connection_id++;
 
-    LOG(DEBUG) << "Sending packet: " << packet.dump(2);
+    std::lock_guard<std::mutex> lock(m_client_mutex);
 
     try
     {
-      m_client.send(msg);
+      m_client.close(static_cast<web::websockets::client::websocket_close_status>(4000), U("Abandoned"));
     }
-    catch(web::websockets::client::websocket_exception& e)
+    catch (const std::exception& e)
     {
-      LOG(ERROR) << "WS Exception: " << e.what();
+      LOG(DEBUG) << "Exception closing an abandoned connection: " << e.what();
     }
   }
 
-  void Gateway::send_heartbeat()
+  void Gateway::on_close(web::websockets::client::websocket_close_status status, const utility::string_t& reason, const std::error_code& code)
   {
-    if (!m_recieved_ack)
+    auto close_code = static_cast<int>(status);
+
+    LOG(ERROR)  << "WebSocket connection has closed with code " << close_code << " and reason "
+                << utility::conversions::to_utf8string(reason) << " - "
+                << code.message() << " (" << code.value() << ")";
+
+    m_connected = false;
+    stop_heartbeat();
+
+    //  Chunks for requests sent on this connection won't come anymore.
+    fail_member_requests(std::chrono::steady_clock::time_point::max(), "The gateway connection closed before the requested members arrived.");
+
+    std::lock_guard<std::mutex> lock(m_state_mutex);
+
+    if (!m_reconnecting)
     {
-      LOG(WARNING) << "Did not recieve a heartbeat ACK packet before this heartbeat.";
+      m_reconnecting = true;
+      m_disconnect_time = std::chrono::steady_clock::now();
     }
 
-    LOG(DEBUG) << "Sending heartbeat packet.";
-    send(Heartbeat, { m_last_seq });
-    m_recieved_ack = false;
+    switch (close_code)
+    {
+    case 4004:  //  Authentication failed
+    case 4010:  //  Invalid shard
+    case 4011:  //  Sharding required
+    case 4012:  //  Invalid API version
+    case 4013:  //  Invalid intents
+    case 4014:  //  Disallowed intents
+      LOG(ERROR) << "The gateway closed with a code that can't be recovered from, not reconnecting.";
+      m_action = Action::Stop;
+      break;
+    case 4007:  //  Invalid sequence
+    case 4009:  //  Session timed out
+    {
+      LOG(INFO) << "The session can't be resumed, starting a new one.";
+      m_use_resume = false;
+
+      std::lock_guard<std::mutex> session_lock(m_session_mutex);
+      m_session_id.clear();
+      m_last_seq = 0;
+      m_action = Action::Connect;
+      break;
+    }
+    default:
+      m_action = Action::Connect;
+    }
+
+    m_state_changed.notify_all();
   }
 
-  void Gateway::send_identify()
+  void Gateway::session_established(bool resumed)
   {
-    LOG(DEBUG) << "Sending identify packet.";
+    save_session();
 
-    send(Identify,
-    {
+    std::lock_guard<std::mutex> lock(m_state_mutex);
+
+    m_reconnect_attempts = 0;
+
+    if (m_reconnecting)
+    {
+      auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_disconnect_time);
+
+      m_reconnecting = false;
+      m_time_to_resume_ms = elapsed.count();
+
+      LOG(INFO) << (resumed ? "Resumed the session " : "Started a new session ") << elapsed.count() << "ms after disconnecting.";
+    }
+  }
+
+  void Gateway::load_session()
+  {
+    nlohmann::json session;
+
+    try
+    {
+      session = read_json_file(m_session_file);
+    }
+    catch (const std::exception& e)
+    {
+      LOG(WARNING) << "Could not read session file " << m_session_file << ": " << e.what();
+      return;
+    }
+
+    if (!session.is_object() || !session.count("session_id"))
+    {
+      return;
+    }
+
+    int64_t saved_at = 0;
+    set_from_json(saved_at, "saved_at", session);
+
+    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+    //  Discord forgets sessions a while after they disconnect, so an old one would just be invalidated.
+    if (now - saved_at > SESSION_MAX_AGE)
+    {
+      LOG(INFO) << "Saved session is too old to resume, identifying instead.";
+      return;
+    }
+
+    //  Resuming skips READY and every GUILD_CREATE, so the guilds can only come from a snapshot.
+    auto bot = m_bot.lock();
+
+    if (bot && !bot->restored_cache_snapshot())
+    {
+      LOG(WARNING) << "Not resuming the saved session because no guilds were restored from a cache snapshot, identifying instead.";
+      return;
+    }
+
+    std::string url;
+    std::string session_id;
+    uint32_t sequence = 0;
+
+    set_from_json(session_id, "session_id", session);
+    set_from_json(sequence, "seq", session);
+    set_from_json(url, "gateway_url", session);
+
+    //  A URL set explicitly wins over the one the session was made on.
+    if (!url.empty() && m_wss_url.empty())
+    {
+      m_wss_url = utility::conversions::to_string_t(url);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_session_mutex);
+      m_session_id = session_id;
+      m_last_seq = sequence;
+    }
+
+    m_use_resume = !session_id.empty();
+
+    LOG(INFO) << "Loaded session " << session_id << " at sequence " << sequence << ", resuming.";
+  }
+
+  void Gateway::save_session()
+  {
+    if (m_session_file.empty())
+    {
+      return;
+    }
+
+    std::string session_id;
+    uint32_t sequence;
+
+    {
+      std::lock_guard<std::mutex> lock(m_session_mutex);
+      session_id = m_session_id;
+      sequence = m_last_seq;
+    }
+
+    std::lock_guard<std::mutex> lock(m_session_file_mutex);
+
+    if (session_id.empty())
+    {
+      std::remove(m_session_file.c_str());
+      return;
+    }
+
+    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+    nlohmann::json session = {
+      { "session_id", session_id },
+      { "seq", sequence },
+      { "gateway_url", utility::conversions::to_utf8string(m_wss_url) },
+      { "saved_at", now }
+    };
+
+    //  Write a temporary file and swap it in, so a crash never leaves a half written session.
+    auto temporary = m_session_file + ".tmp";
+    write_json_file(temporary, session, false);
+
+    //  Renaming over an existing file fails on Windows, so remove it and try again.
+    if (std::rename(temporary.c_str(), m_session_file.c_str()) != 0)
+    {
+      std::remove(m_session_file.c_str());
+
+      if (std::rename(temporary.c_str(), m_session_file.c_str()) != 0)
+      {
+        LOG(WARNING) << "Could not save session to " << m_session_file;
+      }
+    }
+  }
+
+  void Gateway::set_sequence(uint32_t sequence)
+  {
+    std::lock_guard<std::mutex> lock(m_session_mutex);
+    m_last_seq = sequence;
+  }
+
+  void Gateway::on_message(web::websockets::client::websocket_incoming_message msg)
+  {
+    Message message;
+    message.received = std::chrono::steady_clock::now();
+    message.compressed = msg.message_type() == web::websockets::client::websocket_message_type::binary_message;
+
+    if (message.compressed)
+    {
+      Concurrency::streams::container_buffer<std::string> strbuf;
+
+      //  Read the entire binary payload and put into a string container
+      message.data = msg.body().read_to_end(strbuf).then([strbuf](size_t bytesRead)
+      {
+        return strbuf.collection();
+      }).get();
+    }
+    else
+    {
+      //  If not compressed, just get the string.
+      message.data = msg.extract_string().get();
+    }
+
+    receive(std::move(message));
+  }
+
+  void Gateway::receive(Message message)
+  {
+    std::shared_ptr<GatewayRecorder> recorder;
+
+    {
+      std::lock_guard<std::mutex> lock(m_recorder_mutex);
+      recorder = m_recorder;
+    }
+
+    if (recorder)
+    {
+      recorder->record(message.data, message.compressed);
+    }
+
+    LIBDISCORD_PROBE2(frame_received, message.data.size(), message.compressed);
+
+    m_received_messages++;
+    message.trace = Trace::sample();
+
+    //  Everything else happens on the pipeline threads, so the socket can keep reading.
+    m_inflate_stage.enqueue(std::move(message));
+  }
+
+  void Gateway::start_pipeline()
+  {
+    if (!m_inflate_stage.thread.joinable())
+    {
+      m_inflate_stage.thread = std::thread(&Gateway::inflate_loop, this);
+      m_parse_stage.thread = std::thread(&Gateway::parse_loop, this);
+      m_dispatch_stage.thread = std::thread(&Gateway::dispatch_loop, this);
+    }
+  }
+
+  Gateway::Stage::Stage(std::string name) : name(name), queue(RECEIVE_QUEUE_SIZE),
+    latency({ 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 25, 50, 100, 250, 500, 1000 })
+  {
+    max_depth = 0;
+  }
+
+  void Gateway::Stage::enqueue(Message message)
+  {
+    message.queued = std::chrono::steady_clock::now();
+
+    if (!queue.push(std::move(message)))
+    {
+      return;
+    }
+
+    auto depth = queue.size();
+    auto max = max_depth.load();
+
+    while (depth > max && !max_depth.compare_exchange_weak(max, depth))
+    {
+    }
+  }
+
+  void Gateway::Stage::record(const Message& message)
+  {
+    auto now = std::chrono::steady_clock::now();
+    latency.observe(std::chrono::duration<double, std::milli>(now - message.queued).count());
+
+    if (message.trace)
+    {
+      Trace::record(name + " queue", "gateway", message.queued, message.dequeued, message.trace);
+      Trace::record(name, "gateway", message.dequeued, now, message.trace);
+    }
+  }
+
+  void Gateway::inflate_loop()
+  {
+    Message message;
+
+    while (m_inflate_stage.queue.pop(message))
+    {
+      if (message.trace)
+      {
+        message.dequeued = std::chrono::steady_clock::now();
+      }
+
+      try
+      {
+        if (message.compressed)
+        {
+          auto start = std::chrono::steady_clock::now();
+
+          auto compressed_size = message.data.size();
+
+          message.data = zlib_inflate(message.data);
+          message.timings.inflate_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+          LIBDISCORD_PROBE2(inflate_done, compressed_size, message.data.size());
+
+          if (Metrics::enabled())
+          {
+            static auto& inflate_histogram = Metrics::histogram("discord_gateway_inflate_ms");
+            inflate_histogram.observe(message.timings.inflate_ms);
+          }
+        }
+      }
+      catch (const std::exception& e)
+      {
+        LOG(ERROR) << "Could not inflate WS payload: " << e.what();
+        m_finished_messages++;
+        continue;
+      }
+
+      m_inflate_stage.record(message);
+      m_parse_stage.enqueue(std::move(message));
+    }
+
+    m_parse_stage.queue.close();
+  }
+
+  void Gateway::parse_loop()
+  {
+    Message message;
+    uint32_t sequence;
+    uint8_t op;
+
+    while (m_parse_stage.queue.pop(message))
+    {
+      if (message.trace)
+      {
+        message.dequeued = std::chrono::steady_clock::now();
+      }
+
+      try
+      {
+        if (is_filtered(message.data, sequence))
+        {
+          //  The dispatch stage still needs the sequence number, so heartbeats and resumes stay correct.
+          Frame frame;
+          frame.filtered = true;
+          frame.sequence = sequence;
+
+          std::promise<Frame> skipped;
+          skipped.set_value(std::move(frame));
+          message.frame = skipped.get_future();
+          message.data.clear();
+        }
+        else if (m_loading && (!peek_op(message.data, op) || op == Dispatch))
+        {
+          //  Guild payloads in the startup burst are large and independent, so parse them across
+          //  cores. The dispatch stage waits for each one in turn, which keeps events in order.
+          //  The slot is given back when the worker is done, or right away if it never starts.
+          std::unique_ptr<DecoderSlot> slot(new DecoderSlot(m_decoder_mutex, m_active_decoders, m_decoder_available, MAX_DECODERS));
+
+          message.frame = std::async(std::launch::async, [this, slot = std::move(slot)](std::string text, uint64_t trace) mutable
+          {
+            auto held = std::move(slot);
+            return parse_frame(text, trace);
+          }, std::move(message.data), message.trace);
+        }
+        else
+        {
+          auto frame = parse_frame(message.data, message.trace);
+          message.data.clear();
+
+          //  Heartbeat packets don't depend on order, so they skip the dispatch queue. A slow
+          //  event handler or a guild still being decoded can't delay an ACK and make latency
+          //  look worse than it is.
+          if (frame.valid && frame.op == Heartbeat_ACK)
+          {
+            handle_heartbeat_ack();
+            m_parse_stage.record(message);
+            m_finished_messages++;
+            continue;
+          }
+          else if (frame.valid && frame.op == Heartbeat && !m_replaying)
+          {
+            LOG(DEBUG) << "Gateway requested a heartbeat.";
+            send_heartbeat();
+            m_parse_stage.record(message);
+            m_finished_messages++;
+            continue;
+          }
+
+          std::promise<Frame> parsed;
+          parsed.set_value(std::move(frame));
+          message.frame = parsed.get_future();
+        }
+      }
+      catch (const std::exception& e)
+      {
+        LOG(ERROR) << "Could not parse WS payload: " << e.what();
+        m_finished_messages++;
+        continue;
+      }
+
+      m_parse_stage.record(message);
+      m_dispatch_stage.enqueue(std::move(message));
+    }
+
+    m_dispatch_stage.queue.close();
+  }
+
+  void Gateway::dispatch_loop()
+  {
+    Message message;
+
+    while (m_dispatch_stage.queue.pop(message))
+    {
+      if (message.trace)
+      {
+        message.dequeued = std::chrono::steady_clock::now();
+      }
+
+      try
+      {
+        dispatch_message(message);
+      }
+      catch (const std::exception& e)
+      {
+        LOG(ERROR) << "Could not dispatch WS payload: " << e.what();
+      }
+
+      m_finished_messages++;
+    }
+  }
+
+  void Gateway::dispatch_message(Message& message)
+  {
+    Frame frame;
+
+    try
+    {
+      frame = message.frame.get();
+    }
+    catch (const std::exception& e)
+    {
+      LOG(ERROR) << "Could not decode WS payload: " << e.what();
+      return;
+    }
+
+    if (frame.filtered)
+    {
+      set_sequence(frame.sequence);
+      m_dispatch_stage.record(message);
+      return;
+    }
+
+    if (!frame.valid)
+    {
+      return;
+    }
+
+    auto loading = m_loading.load();
+    auto event = frame.payload.find("t");
+    auto has_event = event != frame.payload.end() && event->is_string();
+    auto start = std::chrono::steady_clock::now();
+
+    LIBDISCORD_PROBE1(dispatch_start, has_event ? event->get_ptr<const std::string*>()->c_str() : "");
+
+    try
+    {
+      //  Lets handlers started while processing, and the REST calls they make, join this trace.
+      Trace::Scope scope(message.trace);
+      process_frame(frame);
+    }
+    catch (const std::exception& e)
+    {
+      LOG(ERROR) << "WebSocket Exception: " << e.what();
+    }
+
+    LIBDISCORD_PROBE1(dispatch_end, has_event ? event->get_ptr<const std::string*>()->c_str() : "");
+
+    auto now = std::chrono::steady_clock::now();
+    auto latency = std::chrono::duration<double, std::milli>(now - message.received).count();
+
+    if (loading)
+    {
+      m_loading_timings.inflate_ms += message.timings.inflate_ms;
+      m_loading_timings.parse_ms += frame.timings.parse_ms;
+      m_loading_timings.decode_ms += frame.timings.decode_ms;
+      m_loading_timings.process_ms += std::chrono::duration<double, std::milli>(now - start).count();
+    }
+
+    m_dispatch_stage.record(message);
+    m_receive_latency.observe(latency);
+
+    if (Metrics::enabled())
+    {
+      static auto& parse_histogram = Metrics::histogram("discord_gateway_parse_ms");
+      static auto& decode_histogram = Metrics::histogram("discord_gateway_decode_ms");
+
+      parse_histogram.observe(frame.timings.parse_ms);
+      decode_histogram.observe(frame.timings.decode_ms);
+    }
+
+    if (has_event)
+    {
+      if (message.trace)
+      {
+        Trace::record("process " + event->get<std::string>(), "gateway", start, now, message.trace);
+      }
+
+      if (Metrics::enabled())
+      {
+        auto& metrics = m_event_metrics[event->get<std::string>()];
+
+        if (!metrics.received)
+        {
+          auto labels = "event=\"" + event->get<std::string>() + "\"";
+          metrics.received = &Metrics::counter("discord_gateway_events_total", labels);
+          metrics.handler = &Metrics::histogram("discord_dispatch_handler_ms", labels);
+        }
+
+        metrics.received->increment();
+        metrics.handler->observe(std::chrono::duration<double, std::milli>(now - start).count());
+      }
+
+      Histogram* histogram;
+
+      {
+        //  Map nodes don't move, so the histogram can be used after the lock is released.
+        std::lock_guard<std::mutex> lock(m_event_latency_mutex);
+        auto entry = m_event_latency.find(event->get<std::string>());
+
+        if (entry == std::end(m_event_latency))
+        {
+          entry = m_event_latency.emplace(std::piecewise_construct, std::forward_as_tuple(event->get<std::string>()),
+                                          std::forward_as_tuple(m_receive_latency.bounds())).first;
+        }
+
+        histogram = &entry->second;
+      }
+
+      histogram->observe(latency);
+    }
+  }
+
+  Gateway::Frame Gateway::parse_frame(const std::string& text, uint64_t trace) const
+  {
+    Frame frame;
+
+    auto start = std::chrono::steady_clock::now();
+
+    try
+    {
+      //  Parse our payload as JSON.
+      frame.payload = nlohmann::json::parse(text.c_str());
+    }
+    catch (const std::exception& e)
+    {
+      LOG(ERROR) << "Could not parse WS payload: " << e.what();
+      return frame;
+    }
+
+    auto op = frame.payload.is_object() ? frame.payload.find("op") : frame.payload.end();
+
+    if (op == frame.payload.end() || !op->is_number_unsigned())
+    {
+      LOG(ERROR) << "WS payload has no opcode.";
+      return frame;
+    }
+
+    frame.op = op->get<uint8_t>();
+    frame.valid = true;
+
+    auto parsed = std::chrono::steady_clock::now();
+
+    if (m_loading && frame.op == Dispatch && frame.payload["t"] == "GUILD_CREATE")
+    {
+      try
+      {
+        frame.guild = std::make_shared<Guild>(frame.payload["d"]);
+      }
+      catch (const std::exception& e)
+      {
+        //  The bot will try again from the JSON when the frame is processed.
+        LOG(ERROR) << "Could not decode guild ahead of time: " << e.what();
+      }
+    }
+
+    auto decoded = std::chrono::steady_clock::now();
+
+    frame.timings.parse_ms = std::chrono::duration<double, std::milli>(parsed - start).count();
+    frame.timings.decode_ms = std::chrono::duration<double, std::milli>(decoded - parsed).count();
+
+    if (trace)
+    {
+      Trace::record("json parse", "gateway", start, parsed, trace);
+
+      if (frame.guild)
+      {
+        Trace::record("decode guild", "gateway", parsed, decoded, trace);
+      }
+    }
+
+    return frame;
+  }
+
+  void Gateway::process_frame(Frame& frame)
+  {
+    auto& payload = frame.payload;
+
+    //  Dumping a large payload costs more than handling it, so only do it when it will be logged.
+    if (Logging::debug_enabled())
+    {
+      auto dump = payload.dump(2);
+
+      if (dump.size() > 1000)
+      {
+        LOG(DEBUG) << "Got WS Payload: " << dump.substr(0, 1000);
+      }
+      else
+      {
+        LOG(DEBUG) << "Got WS Payload: " << dump;
+      }
+    }
+
+    auto data = payload["d"]; //  Get the data for the event
+    auto op = frame.op;
+
+    if (m_replaying && op != Dispatch)
+    {
+      return;
+    }
+
+    switch (op)
+    {
+    case Dispatch:
+      set_sequence(payload["s"]);
+      handle_dispatch_event(payload["t"], data, frame.guild);
+      break;
+    case Reconnect:
+      LOG(INFO) << "Gateway asked us to reconnect.";
+      reconnect(U("Gateway requested reconnect"));
+      break;
+    case Invalidate_Session:
+    {
+      auto resumable = data.is_boolean() && data.get<bool>();
+
+      LOG(WARNING) << "Session was invalidated" << (resumable ? ", resuming." : ", identifying again.");
+
+      std::lock_guard<std::mutex> lock(m_state_mutex);
+
+      if (!resumable)
+      {
+        m_use_resume = false;
+
+        std::lock_guard<std::mutex> session_lock(m_session_mutex);
+        m_session_id.clear();
+        m_last_seq = 0;
+      }
+
+      m_action = Action::Reidentify;
+      m_state_changed.notify_all();
+      break;
+    }
+    case Hello:
+    {
+      m_heartbeat_interval = data["heartbeat_interval"].get<uint32_t>();
+      LOG(DEBUG) << "Set heartbeat interval to " << m_heartbeat_interval;
+
+      bool has_session;
+
+      {
+        std::lock_guard<std::mutex> lock(m_session_mutex);
+        has_session = !m_session_id.empty();
+      }
+
+      //  Queue Identify or Resume before the send thread is let go, so it goes out ahead of anything
+      //  queued while disconnected. Discord closes with 4003 if another packet comes first.
+      if (m_use_resume && has_session)
+      {
+        LOG(INFO) << "Connected again, sending Resume packet.";
+        send_resume();
+      }
+      else
+      {
+        LOG(DEBUG) << "Connected, sending Identify packet.";
+        send_identify();
+        m_use_resume = true;  //  Next time use Resume
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(m_state_mutex);
+        m_connected = true;
+      }
+
+      m_state_changed.notify_all();
+
+      {
+        //  Packets queued while disconnected can go out now. Taking the lock makes sure the send
+        //  thread is either waiting or will see the new state.
+        std::lock_guard<std::mutex> lock(m_send_mutex);
+      }
+
+      m_send_ready.notify_all();
+
+      //  Every connection needs its own heartbeats, including resumed ones.
+      start_heartbeat();
+      break;
+    }
+    case Heartbeat:
+      LOG(DEBUG) << "Gateway requested a heartbeat.";
+      send_heartbeat();
+      break;
+    case Heartbeat_ACK:
+      handle_heartbeat_ack();
+      break;
+    default:
+      LOG(WARNING) << "Unhandled WS Opcode (" << static_cast<int>(op) << ")";
+    }
+  }
+
+  void Gateway::handle_heartbeat_ack()
+  {
+    std::lock_guard<std::mutex> lock(m_heartbeat_mutex);
+
+    if (!m_recieved_ack)
+    {
+      auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_heartbeat_sent);
+
+      m_latency_us = latency.count();
+      m_latency_histogram.observe(latency.count() / 1000.0);
+
+      if (Metrics::enabled())
+      {
+        Metrics::histogram("discord_gateway_heartbeat_ms").observe(latency.count() / 1000.0);
+      }
+      m_recieved_ack = true;
+
+      LOG(TRACE) << "Recieved Heartbeat ACK after " << latency.count() / 1000.0 << "ms.";
+    }
+  }
+
+  void Gateway::handle_dispatch_event(std::string event_name, nlohmann::json data, std::shared_ptr<Guild> guild)
+  {
+    //LOG(INFO) << "Recieved " << event_name << " event.";
+
+    if (event_name == "READY")
+    {
+      LOG(DEBUG) << "Using gateway version " << data["v"];
+
+      //  Save session id so we can restart a session
+      {
+        std::lock_guard<std::mutex> lock(m_session_mutex);
+        m_session_id = data["session_id"].get<std::string>();
+      }
+
+      session_established(false);
+
+      m_ready_time = std::chrono::steady_clock::now();
+      m_loading_timings = Timings();
+      m_loading_guilds.clear();
+      m_loaded_guilds = 0;
+
+      for (auto& unavailable : data["guilds"])
+      {
+        m_loading_guilds.insert(unavailable["id"].get<Snowflake>());
+      }
+
+      LOG(INFO) << "Received READY " << std::chrono::duration<double, std::milli>(m_ready_time - m_connect_time).count()
+                << "ms after connecting, waiting for " << m_loading_guilds.size() << " guilds.";
+
+      if (auto p = m_bot.lock())
+      {
+        p->handle_dispatch(event_name, data);
+      }
+      else
+      {
+        LOG(ERROR) << "Could not lock Bot pointer.";
+      }
+
+      m_loading = !m_loading_guilds.empty();
+
+      if (!m_loading)
+      {
+        guild_loaded(0);
+      }
+    }
+    else if (event_name == "RESUMED")
+    {
+      LOG(DEBUG) << "Successfully resumed.";
+      session_established(true);
+
+      if (auto p = m_bot.lock())
+      {
+        p->handle_dispatch(event_name, data);
+      }
+    }
+    else
+    {
+      if (auto p = m_bot.lock())
+      {
+        if (guild)
+        {
+          p->handle_guild_create(guild);
+        }
+        else
+        {
+          p->handle_dispatch(event_name, data);
+        }
+      }
+      else
+      {
+        LOG(ERROR) << "Could not lock Bot pointer.";
+      }
+
+      //  Resolve member requests after the bot has added the members to the guild.
+      if (event_name == "GUILD_MEMBERS_CHUNK")
+      {
+        handle_members_chunk(data);
+      }
+
+      //  A guild that is still unavailable is deleted rather than created, which also ends its wait.
+      if (m_loading && (event_name == "GUILD_CREATE" || event_name == "GUILD_DELETE"))
+      {
+        guild_loaded(data["id"].get<Snowflake>());
+      }
+    }
+  }
+
+  void Gateway::guild_loaded(Snowflake guild_id)
+  {
+    if (m_loading_guilds.erase(guild_id))
+    {
+      m_loaded_guilds++;
+    }
+
+    if (!m_loading_guilds.empty())
+    {
+      return;
+    }
+
+    m_loading = false;
+
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_ready_time).count();
+
+    //  Decode times are summed over every worker, so they can add up to more than the time elapsed.
+    LOG(INFO) << "Loaded " << m_loaded_guilds << " guilds in " << elapsed << "ms (inflate "
+              << m_loading_timings.inflate_ms << "ms, parse " << m_loading_timings.parse_ms << "ms, decode "
+              << m_loading_timings.decode_ms << "ms, process " << m_loading_timings.process_ms << "ms).";
+
+    if (auto p = m_bot.lock())
+    {
+      p->handle_ready();
+    }
+  }
+
+  void Gateway::handle_members_chunk(nlohmann::json data)
+  {
+    if (!data.count("nonce") || !data["nonce"].is_string())
+    {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_member_request_mutex);
+
+    auto itr = m_member_requests.find(data["nonce"].get<std::string>());
+
+    if (itr == std::end(m_member_requests))
+    {
+      return;
+    }
+
+    auto guild = Discord::API::Guild::get(data["guild_id"].get<Snowflake>());
+    std::vector<std::pair<Snowflake, std::shared_ptr<Member>>> found;
+
+    for (auto& member : data["members"])
+    {
+      auto id = member["user"]["id"].get<Snowflake>();
+      auto loaded = guild->get_member(id);
+
+      if (loaded)
+      {
+        found.emplace_back(id, loaded);
+      }
+    }
+
+    uint32_t chunk_index = 0;
+    uint32_t chunk_count = 1;
+
+    set_from_json(chunk_index, "chunk_index", data);
+    set_from_json(chunk_count, "chunk_count", data);
+
+    auto last_chunk = chunk_index + 1 >= chunk_count;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(MEMBER_REQUEST_TIMEOUT);
+
+    //  Requests that shared a packet each only get the members they asked for.
+    for (auto& pending : itr->second)
+    {
+      if (pending->finished)
+      {
+        continue;
+      }
+
+      if (pending->unsent == 0)
+      {
+        pending->deadline = deadline;
+      }
+
+      for (auto& member : found)
+      {
+        if (pending->user_ids.empty() || pending->user_ids.count(member.first))
+        {
+          pending->members.push_back(member.second);
+        }
+      }
+
+      if (last_chunk && --pending->outstanding == 0)
+      {
+        pending->finished = true;
+        pending->promise.set_value(pending->members);
+      }
+    }
+
+    if (last_chunk)
+    {
+      m_member_requests.erase(itr);
+    }
+  }
+
+  void Gateway::member_request_sent(const std::string& nonce)
+  {
+    std::lock_guard<std::mutex> lock(m_member_request_mutex);
+
+    auto itr = m_member_requests.find(nonce);
+
+    if (itr == std::end(m_member_requests))
+    {
+      return;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(MEMBER_REQUEST_TIMEOUT);
+
+    for (auto& pending : itr->second)
+    {
+      if (--pending->unsent == 0)
+      {
+        pending->deadline = deadline;
+      }
+    }
+  }
+
+  void Gateway::fail_member_requests(std::chrono::steady_clock::time_point cutoff, const std::string& reason)
+  {
+    std::lock_guard<std::mutex> lock(m_member_request_mutex);
+
+    size_t failed = 0;
+
+    for (auto& nonce : m_member_requests)
+    {
+      for (auto& pending : nonce.second)
+      {
+        if (!pending->finished && pending->deadline < cutoff)
+        {
+          pending->finished = true;
+          pending->promise.set_exception(std::make_exception_ptr(DiscordException(reason)));
+          failed++;
+        }
+      }
+    }
+
+    if (failed == 0)
+    {
+      return;
+    }
+
+    //  A request split over several packets is listed under each of their nonces.
+    for (auto itr = std::begin(m_member_requests); itr != std::end(m_member_requests);)
+    {
+      auto& requests = itr->second;
+
+      requests.erase(std::remove_if(std::begin(requests), std::end(requests), [](const std::shared_ptr<MemberRequest>& pending)
+      {
+        return pending->finished;
+      }), std::end(requests));
+
+      itr = requests.empty() ? m_member_requests.erase(itr) : std::next(itr);
+    }
+
+    LOG(WARNING) << "Failed " << failed << " member requests: " << reason;
+  }
+
+  void Gateway::send(Opcode op, nlohmann::json data)
+  {
+    Priority priority;
+
+    switch (op)
+    {
+    case Heartbeat:
+    case Identify:
+    case Resume:
+      priority = Critical;
+      break;
+    case Request_Members:
+      priority = Bulk;
+      break;
+    default:
+      priority = Normal;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_send_mutex);
+      m_send_queues[priority].push_back({ op, data });
+    }
+
+    m_send_ready.notify_one();
+  }
+
+  size_t Gateway::reserved_sends() const
+  {
+    //  Keep enough of the window for every heartbeat in it, plus one Identify or Resume.
+    auto heartbeats = m_heartbeat_interval ? SEND_WINDOW / m_heartbeat_interval + 1 : 2;
+    return heartbeats + 1;
+  }
+
+  void Gateway::send_loop()
+  {
+    std::unique_lock<std::mutex> lock(m_send_mutex);
+
+    for (;;)
+    {
+      m_send_ready.wait(lock, [this]()
+      {
+        return m_send_stopped || (m_connected && std::any_of(std::begin(m_send_queues), std::end(m_send_queues), [](const std::deque<Packet>& queue)
+        {
+          return !queue.empty();
+        }));
+      });
+
+      if (m_send_stopped)
+      {
+        break;
+      }
+
+      auto priority = Critical;
+
+      while (m_send_queues[priority].empty())
+      {
+        priority = static_cast<Priority>(priority + 1);
+      }
+
+      auto now = std::chrono::steady_clock::now();
+      auto window = std::chrono::milliseconds(SEND_WINDOW);
+
+      while (!m_sent_times.empty() && now - m_sent_times.front() >= window)
+      {
+        m_sent_times.pop_front();
+      }
+
+      //  Only heartbeats and session packets may use the reserved part of the budget.
+      auto limit = priority == Critical ? SEND_LIMIT : SEND_LIMIT - std::min(reserved_sends(), SEND_LIMIT - 1);
+
+      if (m_sent_times.size() >= limit)
+      {
+        //  Wait for the oldest send to leave the window. A more urgent packet can wake this early.
+        LOG(TRACE) << "Gateway send limit reached, waiting to send.";
+        m_send_ready.wait_until(lock, m_sent_times.front() + window);
+        continue;
+      }
+
+      auto packet = std::move(m_send_queues[priority].front());
+      m_send_queues[priority].pop_front();
+      m_sent_times.push_back(now);
+
+      lock.unlock();
+
+      if (packet.op == Request_Members)
+      {
+        member_request_sent(packet.data["nonce"].get<std::string>());
+      }
+
+      write_packet(packet);
+      lock.lock();
+    }
+  }
+
+  void Gateway::write_packet(const Packet& packet)
+  {
+    nlohmann::json payload = {
+      { "op", packet.op },
+      { "d", packet.data }
+    };
+
+    web::websockets::client::websocket_outgoing_message msg;
+    msg.set_utf8_message(payload.dump());
+
+    if (Logging::debug_enabled())
+    {
+      LOG(DEBUG) << "Sending packet: " << payload.dump(2);
+    }
+
+    try
+    {
+      std::lock_guard<std::mutex> lock(m_client_mutex);
+      m_client.send(msg);
+    }
+    catch(web::websockets::client::websocket_exception& e)
+    {
+      LOG(ERROR) << "WS Exception: " << e.what();
+    }
+  }
+
+  void Gateway::start_heartbeat()
+  {
+    stop_heartbeat();
+
+    std::lock_guard<std::mutex> lock(m_heartbeat_mutex);
+    m_recieved_ack = true; //  No heartbeat is outstanding on a new connection.
+    m_heartbeat_running = true;
+    m_heartbeat_thread = std::thread(&Gateway::heartbeat_loop, this);
+  }
+
+  void Gateway::stop_heartbeat()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_heartbeat_mutex);
+      m_heartbeat_running = false;
+    }
+
+    m_heartbeat_wakeup.notify_all();
+
+    if (m_heartbeat_thread.joinable())
+    {
+      if (m_heartbeat_thread.get_id() == std::this_thread::get_id())
+      {
+        m_heartbeat_thread.detach();
+      }
+      else
+      {
+        m_heartbeat_thread.join();
+      }
+    }
+  }
+
+  void Gateway::heartbeat_loop()
+  {
+    std::unique_lock<std::mutex> lock(m_heartbeat_mutex);
+
+    //  Wait a random part of the first interval so that many clients reconnecting at the same
+    //  time don't all send heartbeats in step.
+    std::mt19937 rng(std::random_device{}());
+    std::uniform_real_distribution<double> jitter(0.0, 1.0);
+    auto delay = std::chrono::milliseconds(static_cast<int64_t>(m_heartbeat_interval * jitter(rng)));
+
+    while (m_heartbeat_running)
+    {
+      if (m_heartbeat_wakeup.wait_for(lock, delay, [this]() { return !m_heartbeat_running; }))
+      {
+        break;
+      }
+
+      delay = std::chrono::milliseconds(m_heartbeat_interval);
+
+      //  A connection that stopped answering heartbeats is dead even if the socket is still open.
+      if (!m_recieved_ack)
+      {
+        LOG(WARNING) << "Did not recieve a heartbeat ACK before the next heartbeat, reconnecting.";
+        m_heartbeat_running = false;
+        lock.unlock();
+        reconnect(U("Heartbeat was not acknowledged"));
+        return;
+      }
+
+      lock.unlock();
+      send_heartbeat();
+      save_session();
+      fail_member_requests(std::chrono::steady_clock::now(), "Timed out waiting for the requested members.");
+      lock.lock();
+    }
+
+    LOG(DEBUG) << "Disconnected, stopping heartbeats.";
+  }
+
+  void Gateway::send_heartbeat()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_heartbeat_mutex);
+      m_heartbeat_sent = std::chrono::steady_clock::now();
+      m_recieved_ack = false;
+    }
+
+    uint32_t sequence;
+
+    {
+      std::lock_guard<std::mutex> lock(m_session_mutex);
+      sequence = m_last_seq;
+    }
+
+    LOG(DEBUG) << "Sending heartbeat packet.";
+    send(Heartbeat, { sequence });
+  }
+
+  void Gateway::reconnect(const utility::string_t& reason)
+  {
+    //  Closing with 1000 or 1001 ends the session, so use a custom code to be able to resume.
+    std::lock_guard<std::mutex> lock(m_client_mutex);
+    m_client.close(static_cast<web::websockets::client::websocket_close_status>(4000), reason);
+  }
+
+  void Gateway::send_identify()
+  {
+    LOG(DEBUG) << "Sending identify packet.";
+
+    nlohmann::json identify =
+    {
       { "token", m_token },
       {
         "properties",
@@ -307,21 +1760,299 @@ namespace Discord
         }
       },
       { "compress", true },
-      { "large_threshold", LARGE_SERVER },
+      { "large_threshold", m_large_threshold },
       { "shard", nlohmann::json::array({ 0, 1 }) }
-    });
+    };
+
+    uint32_t intents = m_intents;
+
+    if (intents != Intents::All)
+    {
+      //  The guild cache is built from these, and startup waits on GUILD_CREATE.
+      intents |= Intents::Guilds;
+
+      identify["intents"] = intents;
+      identify["guild_subscriptions"] = (intents & (Intents::GuildPresences | Intents::GuildMessageTyping)) != 0;
+    }
+
+    send(Identify, identify);
   }
 
   void Gateway::send_resume()
   {
     LOG(DEBUG) << "Sending resume packet.";
 
-    send(Resume, 
+    nlohmann::json resume;
+
     {
-      { "token", m_token },
-      { "session_id", m_session_id },
-      { "seq", m_last_seq }
+      std::lock_guard<std::mutex> lock(m_session_mutex);
+
+      resume =
+      {
+        { "token", m_token },
+        { "session_id", m_session_id },
+        { "seq", m_last_seq }
+      };
+    }
+
+    send(Resume, resume);
+  }
+
+  std::future<std::vector<std::shared_ptr<Member>>> Gateway::request_members(Snowflake guild_id, std::vector<Snowflake> user_ids)
+  {
+    auto pending = std::make_shared<MemberRequest>();
+    auto result = pending->promise.get_future();
+
+    if (user_ids.empty())
+    {
+      pending->promise.set_value(std::vector<std::shared_ptr<Member>>());
+      return result;
+    }
+
+    pending->user_ids.insert(std::begin(user_ids), std::end(user_ids));
+    pending->outstanding = 0;
+
+    std::lock_guard<std::mutex> member_lock(m_member_request_mutex);
+
+    {
+      std::lock_guard<std::mutex> send_lock(m_send_mutex);
+
+      size_t next = 0;
+      nlohmann::json guild = guild_id;
+
+      //  Fill up requests for the same guild that are still waiting to be sent before adding new ones.
+      for (auto& packet : m_send_queues[Bulk])
+      {
+        if (next == user_ids.size())
+        {
+          break;
+        }
+
+        if (packet.op != Request_Members || packet.data["guild_id"] != guild || !packet.data.count("user_ids"))
+        {
+          continue;
+        }
+
+        auto& ids = packet.data["user_ids"];
+
+        if (ids.size() >= MAX_MEMBER_REQUEST_IDS)
+        {
+          continue;
+        }
+
+        while (ids.size() < MAX_MEMBER_REQUEST_IDS && next < user_ids.size())
+        {
+          ids.push_back(user_ids[next++]);
+        }
+
+        m_member_requests[packet.data["nonce"].get<std::string>()].push_back(pending);
+        pending->outstanding++;
+        pending->unsent++;
+      }
+
+      //  Only so many ids fit in one request, so larger lists are split and collected together.
+      while (next < user_ids.size())
+      {
+        auto last = std::min(next + MAX_MEMBER_REQUEST_IDS, user_ids.size());
+        std::vector<Snowflake> batch(std::begin(user_ids) + next, std::begin(user_ids) + last);
+        auto nonce = std::to_string(m_next_nonce++);
+
+        LOG(DEBUG) << "Requesting members of guild " << guild_id.to_string() << " with nonce " << nonce;
+
+        m_send_queues[Bulk].push_back({ Request_Members, {
+          { "guild_id", guild_id },
+          { "user_ids", batch },
+          { "limit", 0 },
+          { "nonce", nonce }
+        } });
+
+        m_member_requests[nonce].push_back(pending);
+        pending->outstanding++;
+        pending->unsent++;
+        next = last;
+      }
+    }
+
+    m_send_ready.notify_one();
+
+    return result;
+  }
+
+  std::future<std::vector<std::shared_ptr<Member>>> Gateway::request_members(Snowflake guild_id, std::string query, uint32_t limit)
+  {
+    auto pending = std::make_shared<MemberRequest>();
+    auto result = pending->promise.get_future();
+    pending->outstanding = 1;
+    pending->unsent = 1;
+
+    std::string nonce;
+
+    {
+      std::lock_guard<std::mutex> lock(m_member_request_mutex);
+      nonce = std::to_string(m_next_nonce++);
+      m_member_requests[nonce].push_back(pending);
+    }
+
+    LOG(DEBUG) << "Requesting members of guild " << guild_id.to_string() << " with nonce " << nonce;
+
+    send(Request_Members, {
+      { "guild_id", guild_id },
+      { "query", query },
+      { "limit", limit },
+      { "nonce", nonce }
     });
+
+    return result;
+  }
+
+  void Gateway::set_session_file(std::string path)
+  {
+    m_session_file = path;
+  }
+
+  void Gateway::set_large_threshold(uint32_t threshold)
+  {
+    m_large_threshold = std::min(std::max(threshold, 50u), 250u);
+  }
+
+  void Gateway::set_intents(uint32_t intents)
+  {
+    m_intents = intents;
+  }
+
+  uint64_t Gateway::filtered_events() const
+  {
+    return m_filtered_events;
+  }
+
+  bool Gateway::is_filtered(const std::string& text, uint32_t& sequence)
+  {
+    uint32_t intents = m_intents;
+
+    if (intents == Intents::All)
+    {
+      return false;
+    }
+
+    std::string name;
+
+    if (!peek_dispatch(text, name, sequence))
+    {
+      return false;
+    }
+
+    auto needed = event_intents(name);
+
+    if (needed == 0 || (needed & intents) != 0)
+    {
+      return false;
+    }
+
+    m_filtered_events++;
+
+    if (Metrics::enabled())
+    {
+      static auto& filtered_counter = Metrics::counter("discord_gateway_filtered_events_total");
+      filtered_counter.increment();
+    }
+
+    return true;
+  }
+
+  std::chrono::microseconds Gateway::latency() const
+  {
+    return std::chrono::microseconds(m_latency_us.load());
+  }
+
+  const Histogram& Gateway::latency_histogram() const
+  {
+    return m_latency_histogram;
+  }
+
+  std::chrono::milliseconds Gateway::time_to_resume() const
+  {
+    return std::chrono::milliseconds(m_time_to_resume_ms.load());
+  }
+
+  std::vector<EventStats> Gateway::event_stats() const
+  {
+    std::vector<EventStats> stats;
+    std::lock_guard<std::mutex> lock(m_event_latency_mutex);
+
+    for (auto& event : m_event_latency)
+    {
+      auto& latency = event.second;
+      stats.push_back({ event.first, latency.count(), latency.mean(), latency.percentile(50), latency.percentile(99) });
+    }
+
+    return stats;
+  }
+
+  void Gateway::set_recording(std::string path)
+  {
+    std::shared_ptr<GatewayRecorder> recorder;
+
+    if (!path.empty())
+    {
+      recorder = std::make_shared<GatewayRecorder>(path);
+
+      if (!recorder->is_open())
+      {
+        recorder = nullptr;
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(m_recorder_mutex);
+    m_recorder = recorder;
+  }
+
+  size_t Gateway::replay(const std::vector<RecordedFrame>& frames, bool real_time)
+  {
+    m_replaying = true;
+    start_pipeline();
+
+    auto start = std::chrono::steady_clock::now();
+    auto target = m_received_messages.load() + frames.size();
+
+    for (auto& frame : frames)
+    {
+      if (real_time)
+      {
+        std::this_thread::sleep_until(start + frame.offset);
+      }
+
+      Message message;
+      message.data = frame.data;
+      message.compressed = frame.compressed;
+      message.received = std::chrono::steady_clock::now();
+
+      receive(std::move(message));
+    }
+
+    //  Frames can finish in the parse or dispatch stage, so wait on the count rather than the queues.
+    while (m_finished_messages < target)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    m_replaying = false;
+    return frames.size();
+  }
+
+  std::vector<PipelineStage> Gateway::pipeline_stats() const
+  {
+    std::vector<PipelineStage> stats;
+
+    for (auto stage : { &m_inflate_stage, &m_parse_stage, &m_dispatch_stage })
+    {
+      stats.push_back({ stage->name, stage->queue.size(), stage->max_depth.load(), stage->latency.count(),
+                        stage->latency.mean(), stage->latency.percentile(50), stage->latency.percentile(99) });
+    }
+
+    stats.push_back({ "receive", 0, 0, m_receive_latency.count(), m_receive_latency.mean(),
+                      m_receive_latency.percentile(50), m_receive_latency.percentile(99) });
+
+    return stats;
   }
 
   bool Gateway::connected() const
@@ -0,0 +1,94 @@
+#include "gateway_recording.h"
+
+#include <cstring>
+
+namespace Discord
+{
+  namespace
+  {
+    const char Magic[4] = { 'L', 'D', 'G', 'R' };
+    const uint32_t Version = 1;
+
+    //  offset (u64) + compressed (u8) + length (u32)
+    const size_t FrameHeaderSize = 13;
+  }
+
+  GatewayRecorder::GatewayRecorder(std::string path) : m_file(path, std::ios::binary | std::ios::trunc)
+  {
+    m_start = std::chrono::steady_clock::now();
+
+    if (!m_file.is_open())
+    {
+      LOG(ERROR) << "Could not open " << path << " to record the gateway.";
+      return;
+    }
+
+    std::string header(Magic, sizeof(Magic));
+    write_le(header, Version, 4);
+    m_file.write(header.data(), header.size());
+  }
+
+  bool GatewayRecorder::is_open() const
+  {
+    return m_file.is_open();
+  }
+
+  void GatewayRecorder::record(const std::string& data, bool compressed)
+  {
+    auto offset = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start);
+
+    std::string header;
+    write_le(header, static_cast<uint64_t>(offset.count()), 8);
+    write_le(header, compressed ? 1 : 0, 1);
+    write_le(header, data.size(), 4);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_file.is_open())
+    {
+      m_file.write(header.data(), header.size());
+      m_file.write(data.data(), data.size());
+    }
+  }
+
+  std::vector<RecordedFrame> GatewayRecorder::load(std::string path)
+  {
+    std::vector<RecordedFrame> frames;
+    std::ifstream in(path, std::ios::binary);
+
+    if (!in.is_open())
+    {
+      LOG(ERROR) << "Could not open gateway recording " << path << ".";
+      return frames;
+    }
+
+    char header[8];
+
+    if (!in.read(header, sizeof(header)) || memcmp(header, Magic, sizeof(Magic)) != 0 || read_le(header + 4, 4) != Version)
+    {
+      LOG(ERROR) << path << " is not a gateway recording this version can read.";
+      return frames;
+    }
+
+    char frame_header[FrameHeaderSize];
+
+    while (in.read(frame_header, FrameHeaderSize))
+    {
+      RecordedFrame frame;
+      frame.offset = std::chrono::microseconds(read_le(frame_header, 8));
+      frame.compressed = frame_header[8] != 0;
+      frame.data.resize(read_le(frame_header + 9, 4));
+
+      if (!in.read(&frame.data[0], frame.data.size()))
+      {
+        //  The recording was cut off, most likely by the process being killed.
+        LOG(WARNING) << "Gateway recording " << path << " ends in the middle of a frame.";
+        break;
+      }
+
+      frames.push_back(std::move(frame));
+    }
+
+    return frames;
+  }
+}
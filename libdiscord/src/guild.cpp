@@ -6,12 +6,129 @@
 #include "emoji.h"
 #include "events.h"
 #include "member.h"
+#include "permission.h"
 #include "role.h"
 #include "user.h"
 #include "voice.h"
 
 namespace Discord
 {
+  namespace
+  {
+    //  Rough extra cost of each object beyond its own size: the control block make_shared puts next
+    //  to it, and the node a map or hash map keeps for each entry.
+    const size_t SharedOverhead = 2 * sizeof(void*);
+    const size_t NodeOverhead = 4 * sizeof(void*);
+
+    //  Voice session ids are 32 hex characters.
+    const size_t SessionIdBytes = 32;
+
+    size_t approximate_size(const User& user)
+    {
+      return sizeof(User) + SharedOverhead + user.username().size() + user.discriminator().size() + user.avatar_id().size() + user.email().size();
+    }
+
+    //  A member's user is counted separately, as a user.
+    size_t approximate_size(const Member& member)
+    {
+      return sizeof(Member) + SharedOverhead + NodeOverhead + member.nick().size() + member.joined_at().size() + member.roles().size() * sizeof(Snowflake);
+    }
+
+    size_t approximate_size(const PresenceUpdate& presence)
+    {
+      auto game = presence.game();
+      return sizeof(PresenceUpdate) + SharedOverhead + NodeOverhead + presence.status().size() + game.name().size() + game.url().size() + presence.roles().size() * sizeof(Snowflake);
+    }
+
+    size_t approximate_size(const Role& role)
+    {
+      return sizeof(Role) + SharedOverhead + role.name().size() + sizeof(Permission) + SharedOverhead;
+    }
+
+    size_t approximate_size(const Emoji& emoji)
+    {
+      return sizeof(Emoji) + SharedOverhead + emoji.name().size() + emoji.roles().size() * sizeof(Snowflake);
+    }
+
+    size_t approximate_size(const Channel& channel)
+    {
+      //  Each overwrite owns an allow and a deny permission.
+      auto overwrite_size = sizeof(Overwrite) + 2 * (sizeof(Permission) + SharedOverhead);
+      return sizeof(Channel) + SharedOverhead + channel.name().size() + channel.topic().size() + channel.permission_overwrites().size() * overwrite_size;
+    }
+
+    void adjust(CacheUsage& usage, size_t bytes, bool add)
+    {
+      if (add)
+      {
+        usage.count += 1;
+        usage.bytes += bytes;
+      }
+      else
+      {
+        usage.count -= std::min<size_t>(usage.count, 1);
+        usage.bytes -= std::min(usage.bytes, bytes);
+      }
+    }
+  }
+
+  CacheUsage& CacheUsage::operator+=(const CacheUsage& other)
+  {
+    count += other.count;
+    bytes += other.bytes;
+    return *this;
+  }
+
+  size_t GuildMemory::bytes() const
+  {
+    return guilds.bytes + channels.bytes + members.bytes + users.bytes + presences.bytes + roles.bytes + emojis.bytes + voice_states.bytes;
+  }
+
+  GuildMemory& GuildMemory::operator+=(const GuildMemory& other)
+  {
+    guilds += other.guilds;
+    channels += other.channels;
+    members += other.members;
+    users += other.users;
+    presences += other.presences;
+    roles += other.roles;
+    emojis += other.emojis;
+    voice_states += other.voice_states;
+    return *this;
+  }
+
+  void to_json(nlohmann::json& json, const Guild& guild)
+  {
+    json["id"] = guild.id();
+    json["name"] = guild.name();
+    json["icon"] = guild.icon();
+    json["owner_id"] = guild.owner_id();
+    json["region"] = guild.region();
+    json["afk_channel_id"] = guild.afk_channel();
+    json["afk_timeout"] = guild.afk_timeout();
+    json["verification_level"] = guild.verification_level();
+    json["default_message_notifications"] = guild.notification_level();
+    json["joined_at"] = guild.joined_at();
+    json["large"] = guild.large();
+    json["member_count"] = guild.member_count();
+    json["unavailable"] = guild.unavailable();
+    json["emojis"] = guild.emojis();
+    json["channels"] = guild.cached_channels();
+    json["members"] = guild.members();
+
+    //  A role's JSON leaves out the id since it is also used as a request body.
+    auto roles = nlohmann::json::array();
+
+    for (auto& role : guild.roles())
+    {
+      nlohmann::json role_json = *role;
+      role_json["id"] = role->id();
+      roles.push_back(role_json);
+    }
+
+    json["roles"] = roles;
+  }
+
   Guild::Guild()
   {
     m_afk_timeout = 0;
@@ -22,6 +139,9 @@ namespace Discord
     m_large = false;
     m_member_count = 0;
     m_unavailable = false;
+
+    std::lock_guard<std::mutex> lock(m_memory_mutex);
+    account_guild();
   }
 
   Guild::Guild(const nlohmann::json& data)
@@ -49,22 +169,33 @@ namespace Discord
     set_from_json(m_channels, "channels", data);
     set_from_json(m_unavailable, "unavailable", data);
 
-    //  Add each channel in this guild to the cache
+    //  Guilds can be decoded off the dispatch thread, so the channels only go into the channel cache
+    //  once the guild itself is committed with API::Guild::update_cache.
     for (auto& channel : m_channels)
     {
       //  Each channel should know what guild it is in.
       channel->set_guild_id(m_id);
-      Discord::API::Channel::update_cache(channel);
+      account_channel(channel, true);
+    }
+
+    for (auto& role : m_roles)
+    {
+      account_role(role, true);
     }
 
+    {
+      //  Voice states are only set here, so they're counted once.
+      std::lock_guard<std::mutex> lock(m_memory_mutex);
+      m_memory.voice_states.count = m_voice_states.size();
+      m_memory.voice_states.bytes = m_voice_states.size() * (sizeof(VoiceState) + SharedOverhead + SessionIdBytes);
+      account_guild();
+    }
+
+    account_emojis();
+
     if (data.count("members"))
     {
-      auto members = data["members"].get<std::vector<std::shared_ptr<Member>>>();
-      
-      for (auto& member : members)
-      {
-        m_members[member->user()->id()] = member;
-      }
+      add_members(data["members"]);
     }
 
     if (data.count("presences"))
@@ -73,7 +204,15 @@ namespace Discord
 
       for (auto& presence : presences)
       {
-        m_presences[presence->user()->id()] = presence;
+        auto& slot = m_presences[presence->user()->id()];
+
+        if (slot)
+        {
+          account_presence(slot, false);
+        }
+
+        slot = presence;
+        account_presence(presence, true);
       }
     }
   }
@@ -104,6 +243,91 @@ namespace Discord
     m_presences = other->m_presences;
 
     m_unavailable = other->m_unavailable;
+
+    auto memory = other->memory();
+    std::lock_guard<std::mutex> lock(m_memory_mutex);
+    m_memory = memory;
+    account_guild();
+  }
+
+  void Guild::merge_members(std::shared_ptr<Guild> other)
+  {
+    for (auto& member : other->m_members)
+    {
+      if (m_members.emplace(member.first, member.second).second)
+      {
+        account_member(member.second, true);
+      }
+    }
+
+    m_member_count = std::max(m_member_count, static_cast<uint32_t>(m_members.size()));
+  }
+
+  GuildMemory Guild::memory() const
+  {
+    std::lock_guard<std::mutex> lock(m_memory_mutex);
+    return m_memory;
+  }
+
+  void Guild::account_member(const std::shared_ptr<Member>& member, bool add)
+  {
+    std::lock_guard<std::mutex> lock(m_memory_mutex);
+    adjust(m_memory.members, approximate_size(*member), add);
+
+    if (member->user())
+    {
+      adjust(m_memory.users, approximate_size(*member->user()), add);
+    }
+
+    account_guild();
+  }
+
+  void Guild::account_presence(const std::shared_ptr<PresenceUpdate>& presence, bool add)
+  {
+    //  A presence's user is the same user as its member's, which is already counted there.
+    std::lock_guard<std::mutex> lock(m_memory_mutex);
+    adjust(m_memory.presences, approximate_size(*presence), add);
+  }
+
+  void Guild::account_role(const std::shared_ptr<Role>& role, bool add)
+  {
+    std::lock_guard<std::mutex> lock(m_memory_mutex);
+    adjust(m_memory.roles, approximate_size(*role), add);
+    account_guild();
+  }
+
+  void Guild::account_channel(const std::shared_ptr<Channel>& channel, bool add)
+  {
+    std::lock_guard<std::mutex> lock(m_memory_mutex);
+    adjust(m_memory.channels, approximate_size(*channel), add);
+    account_guild();
+  }
+
+  void Guild::account_emojis()
+  {
+    std::lock_guard<std::mutex> lock(m_memory_mutex);
+    m_memory.emojis = CacheUsage();
+
+    for (auto& emoji : m_emojis)
+    {
+      adjust(m_memory.emojis, approximate_size(*emoji), true);
+    }
+
+    account_guild();
+  }
+
+  //  Only called with m_memory_mutex held, by the thread that is changing the guild.
+  void Guild::account_guild()
+  {
+    m_memory.guilds.count = 1;
+    m_memory.guilds.bytes = sizeof(Guild) + SharedOverhead + NodeOverhead + m_name.size() + m_icon.size() + m_splash.size() + m_region.size() + m_joined_at.size() +
+      (m_roles.capacity() + m_emojis.capacity() + m_voice_states.capacity() + m_channels.capacity()) * sizeof(std::shared_ptr<void>) +
+      m_members.bucket_count() * sizeof(void*);
+
+    for (auto& feature : m_features)
+    {
+      m_memory.guilds.bytes += sizeof(std::string) + feature.size();
+    }
   }
 
   std::string Guild::name() const
@@ -156,27 +380,84 @@ namespace Discord
     return m_member_count;
   }
 
+  std::string Guild::icon() const
+  {
+    return m_icon;
+  }
+
+  std::vector<std::shared_ptr<Role>> Guild::roles() const
+  {
+    return m_roles;
+  }
+
+  std::vector<std::shared_ptr<Member>> Guild::members() const
+  {
+    std::vector<std::shared_ptr<Member>> members;
+    members.reserve(m_members.size());
+
+    for (auto& member : m_members)
+    {
+      members.push_back(member.second);
+    }
+
+    return members;
+  }
+
+  std::string Guild::joined_at() const
+  {
+    return m_joined_at;
+  }
+
+  bool Guild::large() const
+  {
+    return m_large;
+  }
+
+  bool Guild::unavailable() const
+  {
+    return m_unavailable;
+  }
+
   std::shared_ptr<User> Guild::get_user(Snowflake user_id) const
   {
     auto user_itr = m_members.find(user_id);
 
-    if (user_itr == std::end(m_members))
+    if (user_itr != std::end(m_members))
+    {
+      return user_itr->second->user();
+    }
+
+    //  Large guilds only send some of their members, so a miss is expected until they're requested.
+    LOG(DEBUG) << "User " << user_id.to_string() << " is not loaded in guild " << m_id.to_string();
+    return std::make_shared<User>();
+  }
+
+  std::shared_ptr<Member> Guild::get_member(Snowflake user_id) const
+  {
+    auto member_itr = m_members.find(user_id);
+
+    if (member_itr == std::end(m_members))
     {
-      LOG(ERROR) << "Could not find user with id " << user_id.to_string();
-      return std::make_shared<User>();
+      return nullptr;
     }
 
-    return user_itr->second->user();
+    return member_itr->second;
   }
 
   void Guild::set_name(std::string name)
   {
     m_name = name;
+
+    std::lock_guard<std::mutex> lock(m_memory_mutex);
+    account_guild();
   }
 
   void Guild::set_region(std::string region)
   {
     m_region = region;
+
+    std::lock_guard<std::mutex> lock(m_memory_mutex);
+    account_guild();
   }
 
   void Guild::set_verification_level(VerificationLevel level)
@@ -207,6 +488,7 @@ namespace Discord
   void Guild::set_emojis(std::vector<std::shared_ptr<Emoji>> emojis)
   {
     m_emojis = emojis;
+    account_emojis();
   }
 
   void Guild::set_unavailable(bool value)
@@ -224,13 +506,39 @@ namespace Discord
 
     m_members[member->user()->id()] = member;
     m_member_count += 1;
+    account_member(member, true);
+  }
+
+  void Guild::add_members(const nlohmann::json& members)
+  {
+    m_members.reserve(m_members.size() + members.size());
+
+    for (auto& data : members)
+    {
+      auto member = std::make_shared<Member>(data);
+      auto& slot = m_members[member->user()->id()];
+
+      if (slot)
+      {
+        account_member(slot, false);
+      }
+
+      slot = member;
+      account_member(member, true);
+    }
+
+    //  Chunked members are already part of the member count, so only grow it if we've seen more.
+    m_member_count = std::max(m_member_count, static_cast<uint32_t>(m_members.size()));
   }
 
   void Guild::remove_member(std::shared_ptr<Member> member)
   {
-    if (m_members.count(member->user()->id()))
+    auto member_itr = m_members.find(member->user()->id());
+
+    if (member_itr != std::end(m_members))
     {
-      m_members.erase(member->user()->id());
+      account_member(member_itr->second, false);
+      m_members.erase(member_itr);
       m_member_count -= 1;
     }
   }
@@ -248,23 +556,39 @@ namespace Discord
     else
     {
       member = member_itr->second;
+      account_member(member, false);
     }
 
     member->set_roles(roles);
     member->set_user(user);
     member->set_nick(nick);
+
+    if (member_itr != std::end(m_members))
+    {
+      account_member(member, true);
+    }
   }
 
   void Guild::add_role(Role role)
   {
     m_roles.push_back(std::make_shared<Role>(role));
+    account_role(m_roles.back(), true);
   }
 
   void Guild::remove_role(Snowflake id)
   {
     m_roles.erase(
       std::remove_if(std::begin(m_roles), std::end(m_roles),
-        [id](std::shared_ptr<Role> old) { return old->id() == id; }));
+        [this, id](std::shared_ptr<Role> old)
+        {
+          if (old->id() != id)
+          {
+            return false;
+          }
+
+          account_role(old, false);
+          return true;
+        }), std::end(m_roles));
   }
 
   void Guild::update_role(Role role)
@@ -278,31 +602,45 @@ namespace Discord
     }
 
     auto old = *old_role;
+    account_role(old, false);
     old->merge(role);
+    account_role(old, true);
   }
 
   void Guild::add_channel(std::shared_ptr<Channel> channel)
   {
     m_channels.push_back(channel);
+    account_channel(channel, true);
   }
 
   void Guild::remove_channel(std::shared_ptr<Channel> channel)
   {
-    m_channels.erase(std::remove_if(std::begin(m_channels), std::end(m_channels), [channel](std::shared_ptr<Channel> chan)
+    m_channels.erase(std::remove_if(std::begin(m_channels), std::end(m_channels), [this, channel](std::shared_ptr<Channel> chan)
     {
-      return chan->id() == channel->id();
-    }));
+      if (chan->id() != channel->id())
+      {
+        return false;
+      }
+
+      account_channel(chan, false);
+      return true;
+    }), std::end(m_channels));
   }
 
   void Guild::update_presence(std::shared_ptr<PresenceUpdate> presence)
   {
-    if (m_presences.count(presence->user()->id()))
+    auto presence_itr = m_presences.find(presence->user()->id());
+
+    if (presence_itr != std::end(m_presences))
     {
-      m_presences[presence->user()->id()]->merge(presence);
+      account_presence(presence_itr->second, false);
+      presence_itr->second->merge(presence);
+      account_presence(presence_itr->second, true);
     }
     else
     {
       m_presences[presence->user()->id()] = presence;
+      account_presence(presence, true);
     }
   }
 
@@ -340,6 +678,11 @@ namespace Discord
     return Discord::API::Guild::get_channels(m_id);
   }
 
+  std::vector<std::shared_ptr<Channel>> Guild::cached_channels() const
+  {
+    return m_channels;
+  }
+
   std::shared_ptr<Channel> Guild::create_text_channel(std::string name, std::vector<std::shared_ptr<Overwrite>> permission_overwrites) const
   {
     return Discord::API::Guild::create_text_channel(m_id, name, permission_overwrites);
@@ -0,0 +1,122 @@
+#include "histogram.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace Discord
+{
+  Histogram::Histogram(std::vector<double> bounds) : m_bounds(bounds), m_counts(new std::atomic<uint64_t>[bounds.size() + 1])
+  {
+    for (size_t i = 0; i <= m_bounds.size(); ++i)
+    {
+      m_counts[i] = 0;
+    }
+
+    m_count = 0;
+    m_sum = 0;
+
+    //  Anything recorded is larger, so the first value always becomes the maximum.
+    m_max = -std::numeric_limits<double>::infinity();
+  }
+
+  std::vector<double> Histogram::exponential_bounds(double start, double factor, size_t count)
+  {
+    std::vector<double> bounds;
+    bounds.reserve(count);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+      bounds.push_back(start);
+      start *= factor;
+    }
+
+    return bounds;
+  }
+
+  void Histogram::observe(double value)
+  {
+    //  The first bucket whose upper bound is not below the value, or the overflow bucket.
+    auto bucket = std::lower_bound(std::begin(m_bounds), std::end(m_bounds), value) - std::begin(m_bounds);
+
+    m_counts[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    auto sum = m_sum.load(std::memory_order_relaxed);
+    while (!m_sum.compare_exchange_weak(sum, sum + value, std::memory_order_relaxed))
+    {
+    }
+
+    auto max = m_max.load(std::memory_order_relaxed);
+    while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+    {
+    }
+
+    //  Counted last, so a reader that sees the count also sees the value in the sum and buckets.
+    m_count.fetch_add(1, std::memory_order_release);
+  }
+
+  std::vector<double> Histogram::bounds() const
+  {
+    return m_bounds;
+  }
+
+  std::vector<uint64_t> Histogram::counts() const
+  {
+    std::vector<uint64_t> counts;
+    counts.reserve(m_bounds.size() + 1);
+
+    for (size_t i = 0; i <= m_bounds.size(); ++i)
+    {
+      counts.push_back(m_counts[i].load(std::memory_order_relaxed));
+    }
+
+    return counts;
+  }
+
+  uint64_t Histogram::count() const
+  {
+    return m_count.load(std::memory_order_acquire);
+  }
+
+  double Histogram::sum() const
+  {
+    return m_sum.load(std::memory_order_relaxed);
+  }
+
+  double Histogram::mean() const
+  {
+    auto count = m_count.load(std::memory_order_acquire);
+    return count ? m_sum.load(std::memory_order_relaxed) / count : 0;
+  }
+
+  double Histogram::percentile(double percentile) const
+  {
+    auto counts = this->counts();
+    uint64_t count = 0;
+
+    for (auto bucket : counts)
+    {
+      count += bucket;
+    }
+
+    if (count == 0)
+    {
+      return 0;
+    }
+
+    auto max = m_max.load(std::memory_order_relaxed);
+    auto rank = std::max(static_cast<uint64_t>(percentile / 100.0 * count + 0.5), static_cast<uint64_t>(1));
+    uint64_t seen = 0;
+
+    for (size_t i = 0; i < m_bounds.size(); ++i)
+    {
+      seen += counts[i];
+
+      if (seen >= rank)
+      {
+        return std::min(m_bounds[i], max);
+      }
+    }
+
+    return max;
+  }
+}
@@ -0,0 +1,182 @@
+#include "history.h"
+
+#include "api/api_channel.h"
+#include "message.h"
+
+#include <thread>
+
+namespace Discord
+{
+  const int32_t MessageHistory::PageSize;
+
+  namespace
+  {
+    std::vector<std::shared_ptr<Message>> fetch_page(Snowflake channel_id, Snowflake before, int32_t size)
+    {
+      if (before == 0)
+      {
+        return Discord::API::Channel::get_messages(channel_id, size);
+      }
+
+      return Discord::API::Channel::get_messages(channel_id, size, SearchCriteria::Before, before);
+    }
+  }
+
+  MessageHistory::State::State(Snowflake channel_id, size_t limit, std::function<bool(std::shared_ptr<Message>)> until, Snowflake before)
+  {
+    m_channel_id = channel_id;
+    m_before = before;
+    m_until = until;
+    m_limit = limit;
+    m_count = 0;
+    m_started = false;
+    m_last_page = false;
+    m_done = false;
+    m_index = 0;
+  }
+
+  void MessageHistory::State::start()
+  {
+    if (!m_started)
+    {
+      m_started = true;
+      load_next_page();
+    }
+  }
+
+  bool MessageHistory::State::done() const
+  {
+    return m_done;
+  }
+
+  std::shared_ptr<Message> MessageHistory::State::current() const
+  {
+    return m_page[m_index];
+  }
+
+  void MessageHistory::State::advance()
+  {
+    if (m_done)
+    {
+      return;
+    }
+
+    m_count++;
+    m_index++;
+
+    if (m_limit && m_count >= m_limit)
+    {
+      m_done = true;
+    }
+    else if (m_index < m_page.size())
+    {
+      check_current();
+    }
+    else if (m_last_page)
+    {
+      m_done = true;
+    }
+    else
+    {
+      load_next_page();
+    }
+  }
+
+  void MessageHistory::State::prefetch()
+  {
+    LOG(TRACE) << "Prefetching messages before " << m_before.to_string() << " in channel " << m_channel_id.to_string();
+
+    //  Not std::async, whose future would block the destructor of an abandoned range until the request finished.
+    std::packaged_task<std::vector<std::shared_ptr<Message>>()> task(std::bind(fetch_page, m_channel_id, m_before, PageSize));
+    m_next_page = task.get_future();
+    std::thread(std::move(task)).detach();
+  }
+
+  void MessageHistory::State::load_next_page()
+  {
+    if (m_next_page.valid())
+    {
+      m_page = m_next_page.get();
+    }
+    else
+    {
+      m_page = fetch_page(m_channel_id, m_before, PageSize);
+    }
+
+    m_index = 0;
+
+    if (m_page.empty())
+    {
+      m_done = true;
+      return;
+    }
+
+    //  Pages come newest first, so the next page starts before the last message.
+    m_before = m_page.back()->id();
+
+    //  Only request another page if this one was full and we still need more messages.
+    if (m_page.size() == static_cast<size_t>(PageSize) && (!m_limit || m_count + m_page.size() < m_limit))
+    {
+      prefetch();
+    }
+    else
+    {
+      m_last_page = true;
+    }
+
+    check_current();
+  }
+
+  void MessageHistory::State::check_current()
+  {
+    if (m_until && m_until(m_page[m_index]))
+    {
+      m_done = true;
+    }
+  }
+
+  std::shared_ptr<Message> MessageHistory::iterator::operator*() const
+  {
+    return m_state->current();
+  }
+
+  MessageHistory::iterator& MessageHistory::iterator::operator++()
+  {
+    m_state->advance();
+    return *this;
+  }
+
+  bool MessageHistory::iterator::operator==(const iterator& rhs) const
+  {
+    auto lhs_end = !m_state || m_state->done();
+    auto rhs_end = !rhs.m_state || rhs.m_state->done();
+
+    if (lhs_end || rhs_end)
+    {
+      return lhs_end == rhs_end;
+    }
+
+    return m_state == rhs.m_state;
+  }
+
+  bool MessageHistory::iterator::operator!=(const iterator& rhs) const
+  {
+    return !(*this == rhs);
+  }
+
+  MessageHistory::MessageHistory(Snowflake channel_id, size_t limit, std::function<bool(std::shared_ptr<Message>)> until, Snowflake before)
+  {
+    m_state = std::make_shared<State>(channel_id, limit, until, before);
+  }
+
+  MessageHistory::iterator MessageHistory::begin() const
+  {
+    m_state->start();
+    return iterator(m_state);
+  }
+
+  MessageHistory::iterator MessageHistory::end() const
+  {
+    return iterator();
+  }
+}
@@ -0,0 +1,498 @@
+#include "logging.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+namespace Discord
+{
+  namespace Logging
+  {
+    namespace
+    {
+      /** The log records of one thread, waiting to be written. Only the owning thread writes to it
+          and only the writer thread reads from it, so neither side takes a lock.
+
+          Each record is stored as its length (u32) followed by: time in microseconds since the epoch
+          (i64), level (u32), logger id length (u8), the logger id, then the message.
+       */
+      class ThreadBuffer
+      {
+        std::unique_ptr<char[]> m_data;
+        size_t m_mask;
+
+        alignas(64) std::atomic<size_t> m_head;   //  Next byte to read
+        alignas(64) std::atomic<size_t> m_tail;   //  Next byte to write
+
+        void copy_in(size_t position, const char* data, size_t size)
+        {
+          auto offset = position & m_mask;
+          auto first = std::min(size, m_mask + 1 - offset);
+
+          std::memcpy(&m_data[offset], data, first);
+          std::memcpy(&m_data[0], data + first, size - first);
+        }
+
+        void copy_out(size_t position, char* data, size_t size) const
+        {
+          auto offset = position & m_mask;
+          auto first = std::min(size, m_mask + 1 - offset);
+
+          std::memcpy(data, &m_data[offset], first);
+          std::memcpy(data + first, &m_data[0], size - first);
+        }
+      public:
+        std::atomic<bool> finished;   //  Set when the owning thread exits.
+
+        explicit ThreadBuffer(size_t capacity)
+        {
+          size_t size = 1;
+
+          while (size < capacity)
+          {
+            size <<= 1;
+          }
+
+          m_data.reset(new char[size]);
+          m_mask = size - 1;
+          m_head = 0;
+          m_tail = 0;
+          finished = false;
+        }
+
+        bool write(const std::string& record)
+        {
+          auto tail = m_tail.load(std::memory_order_relaxed);
+          auto used = tail - m_head.load(std::memory_order_acquire);
+          auto size = static_cast<uint32_t>(record.size());
+
+          if (m_mask + 1 - used < sizeof(size) + size)
+          {
+            return false;
+          }
+
+          copy_in(tail, reinterpret_cast<const char*>(&size), sizeof(size));
+          copy_in(tail + sizeof(size), record.data(), size);
+          m_tail.store(tail + sizeof(size) + size, std::memory_order_release);
+
+          return true;
+        }
+
+        bool read(std::string& record)
+        {
+          auto head = m_head.load(std::memory_order_relaxed);
+
+          if (head == m_tail.load(std::memory_order_acquire))
+          {
+            return false;
+          }
+
+          uint32_t size;
+          copy_out(head, reinterpret_cast<char*>(&size), sizeof(size));
+
+          record.resize(size);
+          copy_out(head + sizeof(size), &record[0], size);
+          m_head.store(head + sizeof(size) + size, std::memory_order_release);
+
+          return true;
+        }
+
+        bool empty() const
+        {
+          return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+        }
+      };
+
+      struct Record
+      {
+        int64_t time_us;
+        el::Level level;
+        std::string logger;
+        std::string message;
+      };
+
+      std::string encode(int64_t time_us, el::Level level, const std::string& logger, const std::string& message)
+      {
+        auto level_value = static_cast<uint32_t>(level);
+        auto logger_size = static_cast<uint8_t>(std::min(logger.size(), static_cast<size_t>(255)));
+
+        std::string record;
+        record.reserve(sizeof(time_us) + sizeof(level_value) + 1 + logger_size + message.size());
+        record.append(reinterpret_cast<const char*>(&time_us), sizeof(time_us));
+        record.append(reinterpret_cast<const char*>(&level_value), sizeof(level_value));
+        record.push_back(static_cast<char>(logger_size));
+        record.append(logger, 0, logger_size);
+        record.append(message);
+
+        return record;
+      }
+
+      Record decode(const std::string& data)
+      {
+        Record record;
+        uint32_t level_value;
+        size_t position = 0;
+
+        std::memcpy(&record.time_us, &data[position], sizeof(record.time_us));
+        position += sizeof(record.time_us);
+
+        std::memcpy(&level_value, &data[position], sizeof(level_value));
+        position += sizeof(level_value);
+        record.level = static_cast<el::Level>(level_value);
+
+        auto logger_size = static_cast<uint8_t>(data[position++]);
+        record.logger = data.substr(position, logger_size);
+        record.message = data.substr(position + logger_size);
+
+        return record;
+      }
+
+      /** Drains every thread's buffer from a background thread and writes the records out. */
+      class Writer
+      {
+        size_t m_buffer_bytes;
+        std::vector<std::shared_ptr<ThreadBuffer>> m_buffers;
+
+        std::ofstream m_file;
+        bool m_to_standard_output;
+
+        //  Cached so the date only needs formatting once a second.
+        time_t m_formatted_second;
+        std::string m_formatted_date;
+
+        std::thread m_thread;
+        std::mutex m_mutex;
+        std::condition_variable m_wakeup;
+        std::condition_variable m_flushed;
+        bool m_stopping;
+        uint64_t m_flush_requests;
+        uint64_t m_flushes_done;
+        uint64_t m_reported_dropped;
+
+        void run()
+        {
+          std::unique_lock<std::mutex> lock(m_mutex);
+
+          for (;;)
+          {
+            m_wakeup.wait_for(lock, std::chrono::milliseconds(10), [this]()
+            {
+              return m_stopping || m_flush_requests != m_flushes_done;
+            });
+
+            auto stopping = m_stopping;
+            auto requests = m_flush_requests;
+            auto buffers = m_buffers;
+
+            //  Threads that have exited won't write again, so forget them once they're drained.
+            m_buffers.erase(std::remove_if(std::begin(m_buffers), std::end(m_buffers), [](const std::shared_ptr<ThreadBuffer>& buffer)
+            {
+              return buffer->finished && buffer->empty();
+            }), std::end(m_buffers));
+
+            lock.unlock();
+            drain(buffers);
+            lock.lock();
+
+            m_flushes_done = requests;
+            m_flushed.notify_all();
+
+            if (stopping)
+            {
+              break;
+            }
+          }
+        }
+
+        void drain(const std::vector<std::shared_ptr<ThreadBuffer>>& buffers)
+        {
+          std::vector<Record> records;
+          std::string data;
+
+          for (auto& buffer : buffers)
+          {
+            while (buffer->read(data))
+            {
+              records.push_back(decode(data));
+            }
+          }
+
+          //  Each thread's records are in order, so merging by time keeps the log readable.
+          std::stable_sort(std::begin(records), std::end(records), [](const Record& a, const Record& b)
+          {
+            return a.time_us < b.time_us;
+          });
+
+          std::string text;
+
+          for (auto& record : records)
+          {
+            format(text, record);
+          }
+
+          auto lost = dropped.load(std::memory_order_relaxed);
+
+          if (lost != m_reported_dropped)
+          {
+            auto now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            format(text, { now, el::Level::Warning, "default", "Dropped " + std::to_string(lost - m_reported_dropped) +
+                                                                " log records because a thread's log buffer was full." });
+            m_reported_dropped = lost;
+          }
+
+          if (text.empty())
+          {
+            return;
+          }
+
+          if (m_file.is_open())
+          {
+            m_file.write(text.data(), text.size());
+            m_file.flush();
+          }
+
+          if (m_to_standard_output)
+          {
+            std::cout.write(text.data(), text.size());
+            std::cout.flush();
+          }
+        }
+
+        //  Matches easylogging++'s default "%datetime %level [%logger] %msg" format.
+        void format(std::string& out, const Record& record)
+        {
+          auto second = static_cast<time_t>(record.time_us / 1000000);
+
+          if (second != m_formatted_second || m_formatted_date.empty())
+          {
+            std::tm local;
+#if defined(_WIN32)
+            localtime_s(&local, &second);
+#else
+            localtime_r(&second, &local);
+#endif
+            char date[32];
+            std::strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &local);
+
+            m_formatted_second = second;
+            m_formatted_date = date;
+          }
+
+          char milliseconds[8];
+          std::snprintf(milliseconds, sizeof(milliseconds), ",%03d ", static_cast<int>(record.time_us / 1000 % 1000));
+
+          out += m_formatted_date;
+          out += milliseconds;
+          std::string level = el::LevelHelper::convertToString(record.level);
+
+          out += level;
+          out.append(level.size() < 5 ? 5 - level.size() : 0, ' ');
+          out += " [";
+          out += record.logger;
+          out += "] ";
+          out += record.message;
+          out += '\n';
+        }
+      public:
+        const uint64_t generation;
+        std::atomic<uint64_t> dropped;
+
+        Writer(std::string path, size_t buffer_bytes, bool to_standard_output, uint64_t generation) : generation(generation)
+        {
+          m_buffer_bytes = buffer_bytes;
+          m_to_standard_output = to_standard_output;
+          m_formatted_second = 0;
+          m_stopping = false;
+          m_flush_requests = 0;
+          m_flushes_done = 0;
+          m_reported_dropped = 0;
+          dropped = 0;
+
+          if (!path.empty())
+          {
+            m_file.open(path, std::ios::app | std::ios::binary);
+
+            if (!m_file.is_open())
+            {
+              std::cerr << "Could not open " << path << " for async logging." << std::endl;
+            }
+          }
+
+          m_thread = std::thread(&Writer::run, this);
+        }
+
+        ~Writer()
+        {
+          {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+          }
+
+          m_wakeup.notify_all();
+          m_thread.join();
+        }
+
+        std::shared_ptr<ThreadBuffer> add_thread()
+        {
+          auto buffer = std::make_shared<ThreadBuffer>(m_buffer_bytes);
+
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_buffers.push_back(buffer);
+
+          return buffer;
+        }
+
+        void flush()
+        {
+          std::unique_lock<std::mutex> lock(m_mutex);
+          auto request = ++m_flush_requests;
+
+          m_wakeup.notify_all();
+          m_flushed.wait(lock, [this, request]() { return m_flushes_done >= request || m_stopping; });
+        }
+      };
+
+      std::shared_ptr<Writer> CurrentWriter;
+      uint64_t WriterGeneration = 0;
+      std::mutex StartMutex;
+
+      //  The buffer of the current thread, and the generation of the writer it was made for.
+      struct LocalBuffer
+      {
+        std::shared_ptr<ThreadBuffer> buffer;
+        uint64_t generation = 0;
+
+        ~LocalBuffer()
+        {
+          if (buffer)
+          {
+            buffer->finished = true;
+          }
+        }
+      };
+
+      thread_local LocalBuffer Local;
+
+      /** Replaces easylogging++'s default dispatch, which formats and writes on the logging thread. */
+      class Sink : public el::LogDispatchCallback
+      {
+      protected:
+        void handle(const el::LogDispatchData* data) override
+        {
+          auto writer = std::atomic_load(&CurrentWriter);
+
+          if (!writer || data->dispatchAction() != el::base::DispatchAction::NormalLog)
+          {
+            return;
+          }
+
+          if (Local.generation != writer->generation)
+          {
+            if (Local.buffer)
+            {
+              Local.buffer->finished = true;
+            }
+
+            Local.buffer = writer->add_thread();
+            Local.generation = writer->generation;
+          }
+
+          auto message = data->logMessage();
+          auto now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+          if (!Local.buffer->write(encode(now, message->level(), message->logger()->id(), message->message())))
+          {
+            writer->dropped.fetch_add(1, std::memory_order_relaxed);
+          }
+
+          //  A fatal log aborts the program next, so make sure it's written first.
+          if (message->level() == el::Level::Fatal)
+          {
+            writer->flush();
+          }
+        }
+      };
+
+      const std::string SinkId = "DiscordAsyncLogging";
+      const std::string DefaultSinkId = "DefaultLogDispatchCallback";
+    }
+
+    void start_async(std::string path, size_t buffer_bytes)
+    {
+      std::lock_guard<std::mutex> lock(StartMutex);
+
+      if (std::atomic_load(&CurrentWriter))
+      {
+        return;
+      }
+
+      //  Follow where the default logger was already configured to write.
+      auto configuration = el::Loggers::getLogger("default")->typedConfigurations();
+
+      if (path.empty() && configuration->toFile(el::Level::Info))
+      {
+        path = configuration->filename(el::Level::Info);
+      }
+
+      std::atomic_store(&CurrentWriter, std::make_shared<Writer>(path, buffer_bytes, configuration->toStandardOutput(el::Level::Info), ++WriterGeneration));
+
+      el::Helpers::installLogDispatchCallback<Sink>(SinkId);
+      el::Helpers::uninstallLogDispatchCallback<el::base::DefaultLogDispatchCallback>(DefaultSinkId);
+    }
+
+    void stop_async()
+    {
+      std::lock_guard<std::mutex> lock(StartMutex);
+      auto writer = std::atomic_load(&CurrentWriter);
+
+      if (!writer)
+      {
+        return;
+      }
+
+      el::Helpers::installLogDispatchCallback<el::base::DefaultLogDispatchCallback>(DefaultSinkId);
+      el::Helpers::uninstallLogDispatchCallback<Sink>(SinkId);
+
+      std::atomic_store(&CurrentWriter, std::shared_ptr<Writer>());
+      writer->flush();
+    }
+
+    bool async()
+    {
+      return std::atomic_load(&CurrentWriter) != nullptr;
+    }
+
+    void flush()
+    {
+      auto writer = std::atomic_load(&CurrentWriter);
+
+      if (writer)
+      {
+        writer->flush();
+      }
+    }
+
+    uint64_t dropped()
+    {
+      auto writer = std::atomic_load(&CurrentWriter);
+      return writer ? writer->dropped.load(std::memory_order_relaxed) : 0;
+    }
+
+    bool debug_enabled()
+    {
+#if ELPP_DEBUG_LOG
+      static auto logger = el::Loggers::getLogger("default");
+      return logger->enabled(el::Level::Debug);
+#else
+      return false;
+#endif
+    }
+  }
+}
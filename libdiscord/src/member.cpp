@@ -12,6 +12,17 @@ namespace Discord
     m_mute = false;
   }
 
+  void to_json(nlohmann::json& json, const Member& member)
+  {
+    json["user"] = member.user();
+    json["roles"] = member.roles();
+
+    if (!member.nick().empty())
+    {
+      json["nick"] = member.nick();
+    }
+  }
+
   Member::Member(const nlohmann::json& data)
   {
     set_from_json(m_user, "user", data);
@@ -42,6 +53,11 @@ namespace Discord
     return nick();
   }
 
+  std::string Member::joined_at() const
+  {
+    return m_joined_at;
+  }
+
   void Member::set_user(std::shared_ptr<User> user)
   {
     m_user = user;
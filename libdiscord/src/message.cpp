@@ -48,6 +48,21 @@ namespace Discord
     }
   }
 
+  void Message::update(const nlohmann::json& data)
+  {
+    update_from_json(m_author, "author", data);
+    update_from_json(m_content, "content", data);
+    update_from_json(m_edited_timestamp, "edited_timestamp", data);
+    update_from_json(m_tts, "tts", data);
+    update_from_json(m_mention_everyone, "mention_everyone", data);
+    update_from_json(m_mentions, "mentions", data);
+    update_from_json(m_mention_roles, "mention_roles", data);
+    update_from_json(m_attachments, "attachments", data);
+    update_from_json(m_embeds, "embeds", data);
+    update_from_json(m_reactions, "reactions", data);
+    update_from_json(m_pinned, "pinned", data);
+  }
+
   Snowflake Message::channel_id() const
   {
     return m_channel_id;
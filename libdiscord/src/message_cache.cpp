@@ -0,0 +1,233 @@
+#include "message_cache.h"
+
+#include "message.h"
+#include "user.h"
+
+#include <algorithm>
+
+namespace Discord
+{
+  namespace
+  {
+    //  Rough size of a message including the heap data it owns.
+    size_t approximate_size(const std::shared_ptr<Message>& message)
+    {
+      return sizeof(Message) + message->content().size() + message->mentions().size() * sizeof(User);
+    }
+  }
+
+  MessageCache::MessageCache(size_t depth, size_t max_bytes)
+  {
+    m_depth = depth;
+    m_max_bytes = max_bytes;
+    m_bytes = 0;
+    m_count = 0;
+    m_sequence = 0;
+  }
+
+  void MessageCache::set_limits(size_t depth, size_t max_bytes)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_depth = depth;
+    m_max_bytes = max_bytes;
+
+    for (auto channel = std::begin(m_channels); channel != std::end(m_channels);)
+    {
+      while (channel->second.size() > m_depth)
+      {
+        pop_front(channel->second);
+      }
+
+      channel = channel->second.empty() ? m_channels.erase(channel) : std::next(channel);
+    }
+
+    evict();
+  }
+
+  void MessageCache::pop_front(std::deque<Entry>& ring)
+  {
+    m_bytes -= ring.front().bytes;
+    m_count -= 1;
+    ring.pop_front();
+  }
+
+  void MessageCache::evict()
+  {
+    while (m_bytes > m_max_bytes && !m_order.empty())
+    {
+      auto oldest = m_order.front();
+      m_order.pop_front();
+
+      auto channel = m_channels.find(oldest.first);
+
+      //  The message may already be gone if it was pushed out by the channel's depth.
+      if (channel != std::end(m_channels) && !channel->second.empty() && channel->second.front().sequence == oldest.second)
+      {
+        pop_front(channel->second);
+
+        //  Drop emptied channels so the map doesn't keep every channel ever seen.
+        if (channel->second.empty())
+        {
+          m_channels.erase(channel);
+        }
+      }
+    }
+
+    //  The order queue can hold entries that were already evicted, so keep it from growing unbounded.
+    if (m_order.size() > 2 * m_count + 64)
+    {
+      std::deque<std::pair<Snowflake, uint64_t>> order;
+
+      for (auto& entry : m_order)
+      {
+        auto channel = m_channels.find(entry.first);
+
+        if (channel != std::end(m_channels) && !channel->second.empty() && channel->second.front().sequence <= entry.second)
+        {
+          order.push_back(entry);
+        }
+      }
+
+      m_order.swap(order);
+    }
+  }
+
+  void MessageCache::add(std::shared_ptr<Message> message)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_depth == 0)
+    {
+      return;
+    }
+
+    auto& ring = m_channels[message->channel_id()];
+
+    if (ring.size() >= m_depth)
+    {
+      pop_front(ring);
+    }
+
+    Entry entry = { m_sequence++, approximate_size(message), message };
+
+    m_bytes += entry.bytes;
+    m_count += 1;
+    m_order.emplace_back(message->channel_id(), entry.sequence);
+    ring.push_back(entry);
+
+    evict();
+  }
+
+  std::shared_ptr<Message> MessageCache::update(const nlohmann::json& data)
+  {
+    Snowflake channel_id;
+    Snowflake message_id;
+
+    set_from_json(channel_id, "channel_id", data);
+    set_from_json(message_id, "id", data);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto channel = m_channels.find(channel_id);
+
+    if (channel == std::end(m_channels))
+    {
+      return nullptr;
+    }
+
+    auto& ring = channel->second;
+    auto entry = std::find_if(std::begin(ring), std::end(ring), [message_id](const Entry& e)
+    {
+      return e.message->id() == message_id;
+    });
+
+    if (entry == std::end(ring))
+    {
+      return nullptr;
+    }
+
+    //  Handlers may still hold the old message, so replace it rather than changing it in place.
+    auto previous = entry->message;
+    auto updated = std::make_shared<Message>(*previous);
+    updated->update(data);
+
+    m_bytes -= entry->bytes;
+    entry->bytes = approximate_size(updated);
+    entry->message = updated;
+    m_bytes += entry->bytes;
+
+    evict();
+
+    return previous;
+  }
+
+  std::shared_ptr<Message> MessageCache::remove(Snowflake channel_id, Snowflake message_id)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto channel = m_channels.find(channel_id);
+
+    if (channel == std::end(m_channels))
+    {
+      return nullptr;
+    }
+
+    auto& ring = channel->second;
+    auto entry = std::find_if(std::begin(ring), std::end(ring), [message_id](const Entry& e)
+    {
+      return e.message->id() == message_id;
+    });
+
+    if (entry == std::end(ring))
+    {
+      return nullptr;
+    }
+
+    auto message = entry->message;
+
+    m_bytes -= entry->bytes;
+    m_count -= 1;
+    ring.erase(entry);
+
+    if (ring.empty())
+    {
+      m_channels.erase(channel);
+    }
+
+    return message;
+  }
+
+  std::shared_ptr<Message> MessageCache::get(Snowflake channel_id, Snowflake message_id) const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto channel = m_channels.find(channel_id);
+
+    if (channel == std::end(m_channels))
+    {
+      return nullptr;
+    }
+
+    //  Recent messages are the most likely to be looked up, so search from the back.
+    auto& ring = channel->second;
+    auto entry = std::find_if(ring.rbegin(), ring.rend(), [message_id](const Entry& e)
+    {
+      return e.message->id() == message_id;
+    });
+
+    return entry == ring.rend() ? nullptr : entry->message;
+  }
+
+  size_t MessageCache::size() const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_count;
+  }
+
+  size_t MessageCache::bytes() const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytes;
+  }
+}
@@ -0,0 +1,520 @@
+#include "message_store.h"
+
+#include "message.h"
+
+#include <algorithm>
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Discord
+{
+  namespace
+  {
+    enum RecordKind : uint8_t
+    {
+      Stored = 0,
+      Deleted
+    };
+
+    //  kind (u8) + id (u64) + length (u32)
+    const uint64_t HeaderSize = 13;
+  }
+
+  class MessageStore::ChannelLog
+  {
+    struct IndexEntry
+    {
+      uint64_t id;
+      uint64_t offset;
+      bool deleted;
+
+      bool operator<(const IndexEntry& rhs) const
+      {
+        return id < rhs.id;
+      }
+    };
+
+    std::string m_path;
+    std::ofstream m_out;
+    uint64_t m_size;
+
+#ifdef _WIN32
+    HANDLE m_file;
+    HANDLE m_mapping;
+#else
+    int m_fd;
+#endif
+    const char* m_view;
+    uint64_t m_view_size;
+
+    //  Message id to the offset of its newest stored record, sorted by id. Deleted messages keep
+    //  pointing at their last stored copy so a delete can still see what was removed.
+    std::vector<IndexEntry> m_index;
+    size_t m_live;
+
+    void unmap()
+    {
+#ifdef _WIN32
+      if (m_view)
+      {
+        UnmapViewOfFile(m_view);
+      }
+
+      if (m_mapping)
+      {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+      }
+#else
+      if (m_view)
+      {
+        munmap(const_cast<char*>(m_view), m_view_size);
+      }
+#endif
+      m_view = nullptr;
+      m_view_size = 0;
+    }
+
+    void remap()
+    {
+      unmap();
+
+      if (m_size == 0)
+      {
+        return;
+      }
+
+#ifdef _WIN32
+      m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      auto view = m_mapping ? MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+      auto view = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+
+      if (view == MAP_FAILED)
+      {
+        view = nullptr;
+      }
+#endif
+
+      if (!view)
+      {
+        LOG(ERROR) << "Could not memory map message log " << m_path;
+        return;
+      }
+
+      m_view = static_cast<const char*>(view);
+      m_view_size = m_size;
+    }
+
+    const char* at(uint64_t offset, uint64_t length)
+    {
+      if (offset + length > m_view_size)
+      {
+        remap();
+      }
+
+      return offset + length <= m_view_size ? m_view + offset : nullptr;
+    }
+
+    std::vector<IndexEntry>::iterator find(uint64_t id)
+    {
+      auto itr = std::lower_bound(std::begin(m_index), std::end(m_index), IndexEntry{ id, 0, false });
+      return (itr != std::end(m_index) && itr->id == id) ? itr : std::end(m_index);
+    }
+
+    void apply(uint8_t kind, uint64_t id, uint64_t offset)
+    {
+      auto itr = std::lower_bound(std::begin(m_index), std::end(m_index), IndexEntry{ id, 0, false });
+      auto exists = itr != std::end(m_index) && itr->id == id;
+
+      if (kind == Deleted)
+      {
+        if (exists && !itr->deleted)
+        {
+          itr->deleted = true;
+          m_live--;
+        }
+      }
+      else if (exists)
+      {
+        if (itr->deleted)
+        {
+          itr->deleted = false;
+          m_live++;
+        }
+
+        itr->offset = offset;
+      }
+      else
+      {
+        //  Messages mostly arrive in id order, so this is almost always an append.
+        m_index.insert(itr, IndexEntry{ id, offset, false });
+        m_live++;
+      }
+    }
+
+    //  Rebuild the index from the log, returning the length of the log that holds whole records.
+    uint64_t rebuild_index()
+    {
+      uint64_t pos = 0;
+
+      while (pos + HeaderSize <= m_size)
+      {
+        auto header = at(pos, HeaderSize);
+
+        if (!header)
+        {
+          //  Mapping failed, so keep everything as is rather than dropping records.
+          return m_size;
+        }
+
+        auto kind = static_cast<uint8_t>(header[0]);
+        auto id = read_le(header + 1, 8);
+        auto length = read_le(header + 9, 4);
+
+        if (pos + HeaderSize + length > m_size)
+        {
+          break;
+        }
+
+        apply(kind, id, pos);
+        pos += HeaderSize + length;
+      }
+
+      return pos;
+    }
+
+    void truncate(uint64_t size)
+    {
+      unmap();
+
+#ifdef _WIN32
+      auto file = CreateFileA(m_path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+      LARGE_INTEGER end;
+      end.QuadPart = static_cast<LONGLONG>(size);
+
+      auto ok = file != INVALID_HANDLE_VALUE && SetFilePointerEx(file, end, nullptr, FILE_BEGIN) && SetEndOfFile(file);
+
+      if (file != INVALID_HANDLE_VALUE)
+      {
+        CloseHandle(file);
+      }
+#else
+      auto ok = ::truncate(m_path.c_str(), static_cast<off_t>(size)) == 0;
+#endif
+
+      if (ok)
+      {
+        m_size = size;
+      }
+      else
+      {
+        LOG(ERROR) << "Could not truncate message log " << m_path;
+      }
+
+      remap();
+    }
+  public:
+    std::mutex mutex;
+
+    explicit ChannelLog(std::string path) : m_path(path), m_size(0), m_view(nullptr), m_view_size(0), m_live(0)
+    {
+      //  Make sure the file exists before opening it for mapping.
+      std::ofstream(m_path, std::ios::binary | std::ios::app);
+
+#ifdef _WIN32
+      m_mapping = nullptr;
+      m_file = CreateFileA(m_path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+      LARGE_INTEGER size;
+      if (m_file != INVALID_HANDLE_VALUE && GetFileSizeEx(m_file, &size))
+      {
+        m_size = static_cast<uint64_t>(size.QuadPart);
+      }
+#else
+      m_fd = open(m_path.c_str(), O_RDONLY);
+
+      struct stat info;
+      if (m_fd >= 0 && fstat(m_fd, &info) == 0)
+      {
+        m_size = static_cast<uint64_t>(info.st_size);
+      }
+#endif
+
+      remap();
+      auto valid = rebuild_index();
+
+      if (valid != m_size)
+      {
+        //  A write was cut short last time. Drop it so new records line up with the index.
+        LOG(WARNING) << "Message log " << m_path << " ends with a truncated record. Removing it.";
+        truncate(valid);
+      }
+
+      m_out.open(m_path, std::ios::binary | std::ios::app);
+
+      if (!m_out.is_open())
+      {
+        LOG(ERROR) << "Could not open message log " << m_path;
+      }
+
+      LOG(DEBUG) << "Opened message log " << m_path << " with " << m_live << " messages and " << m_index.size() - m_live << " deleted.";
+    }
+
+    ~ChannelLog()
+    {
+      unmap();
+
+#ifdef _WIN32
+      if (m_file != INVALID_HANDLE_VALUE)
+      {
+        CloseHandle(m_file);
+      }
+#else
+      if (m_fd >= 0)
+      {
+        close(m_fd);
+      }
+#endif
+    }
+
+    void append(uint8_t kind, uint64_t id, const std::string& payload)
+    {
+      std::string record;
+      record.reserve(HeaderSize + payload.size());
+      record.push_back(static_cast<char>(kind));
+      write_le(record, id, 8);
+      write_le(record, payload.size(), 4);
+      record += payload;
+
+      m_out.write(record.data(), record.size());
+      m_out.flush();
+
+      apply(kind, id, m_size);
+      m_size += record.size();
+    }
+
+    nlohmann::json read(uint64_t id, bool include_deleted)
+    {
+      auto itr = find(id);
+
+      if (itr == std::end(m_index) || (itr->deleted && !include_deleted))
+      {
+        return nullptr;
+      }
+
+      return read_at(itr->offset);
+    }
+
+    //  Mark a stored message deleted, returning its last stored copy.
+    nlohmann::json remove(uint64_t id)
+    {
+      auto itr = find(id);
+
+      if (itr == std::end(m_index))
+      {
+        return nullptr;
+      }
+
+      auto offset = itr->offset;
+
+      if (!itr->deleted)
+      {
+        append(Deleted, id, "");
+      }
+
+      return read_at(offset);
+    }
+
+    nlohmann::json read_at(uint64_t offset)
+    {
+      auto header = at(offset, HeaderSize);
+
+      if (!header)
+      {
+        return nullptr;
+      }
+
+      auto length = read_le(header + 9, 4);
+      auto payload = at(offset + HeaderSize, length);
+
+      if (!payload)
+      {
+        return nullptr;
+      }
+
+      return nlohmann::json::parse(std::string(payload, length));
+    }
+
+    std::vector<nlohmann::json> read_range(uint64_t after, uint64_t before)
+    {
+      std::vector<nlohmann::json> messages;
+
+      auto first = std::upper_bound(std::begin(m_index), std::end(m_index), IndexEntry{ after, 0, false });
+      auto last = before ? std::lower_bound(first, std::end(m_index), IndexEntry{ before, 0, false }) : std::end(m_index);
+
+      for (auto itr = first; itr != last; ++itr)
+      {
+        if (itr->deleted)
+        {
+          continue;
+        }
+
+        auto message = read_at(itr->offset);
+
+        if (!message.is_null())
+        {
+          messages.push_back(message);
+        }
+      }
+
+      return messages;
+    }
+
+    size_t count() const
+    {
+      return m_live;
+    }
+  };
+
+  MessageStore::MessageStore(std::string directory) : m_directory(directory)
+  {
+    if (!m_directory.empty() && m_directory.back() != '/' && m_directory.back() != '\\')
+    {
+      m_directory += "/";
+    }
+  }
+
+  MessageStore::~MessageStore()
+  {
+  }
+
+  MessageStore::ChannelLog* MessageStore::get_log(Snowflake channel_id) const
+  {
+    std::lock_guard<std::mutex> lock(m_logs_mutex);
+    auto& log = m_logs[channel_id];
+
+    if (!log)
+    {
+      log = std::make_unique<ChannelLog>(m_directory + channel_id.to_string() + ".msgs");
+    }
+
+    return log.get();
+  }
+
+  void MessageStore::store(const nlohmann::json& data)
+  {
+    Snowflake channel_id;
+    Snowflake message_id;
+
+    set_from_json(channel_id, "channel_id", data);
+    set_from_json(message_id, "id", data);
+
+    auto log = get_log(channel_id);
+    std::lock_guard<std::mutex> lock(log->mutex);
+
+    auto message = log->read(static_cast<uint64_t>(message_id), false);
+
+    if (message.is_object())
+    {
+      //  Updates only carry the fields that changed, so merge them into what we have.
+      for (auto it = data.begin(); it != data.end(); ++it)
+      {
+        message[it.key()] = it.value();
+      }
+    }
+    else if (data.count("author") && data.count("timestamp"))
+    {
+      message = data;
+    }
+    else
+    {
+      //  A partial update, such as an embed being added, would be read back as if it were a whole message.
+      LOG(TRACE) << "Not storing a partial update for message " << message_id.to_string() << " that was never stored.";
+      return;
+    }
+
+    log->append(Stored, static_cast<uint64_t>(message_id), message.dump());
+  }
+
+  nlohmann::json MessageStore::remove(Snowflake channel_id, Snowflake message_id)
+  {
+    auto log = get_log(channel_id);
+    std::lock_guard<std::mutex> lock(log->mutex);
+
+    return log->remove(static_cast<uint64_t>(message_id));
+  }
+
+  nlohmann::json MessageStore::get_json(Snowflake channel_id, Snowflake message_id, bool include_deleted) const
+  {
+    auto log = get_log(channel_id);
+    std::lock_guard<std::mutex> lock(log->mutex);
+
+    return log->read(static_cast<uint64_t>(message_id), include_deleted);
+  }
+
+  std::shared_ptr<Message> MessageStore::get(Snowflake channel_id, Snowflake message_id, bool include_deleted) const
+  {
+    auto json = get_json(channel_id, message_id, include_deleted);
+
+    if (json.is_null())
+    {
+      return nullptr;
+    }
+
+    return std::make_shared<Message>(json);
+  }
+
+  std::vector<std::shared_ptr<Message>> MessageStore::range(Snowflake channel_id, Snowflake after, Snowflake before) const
+  {
+    std::vector<nlohmann::json> payloads;
+
+    {
+      auto log = get_log(channel_id);
+      std::lock_guard<std::mutex> lock(log->mutex);
+      payloads = log->read_range(static_cast<uint64_t>(after), static_cast<uint64_t>(before));
+    }
+
+    std::vector<std::shared_ptr<Message>> messages;
+    messages.reserve(payloads.size());
+
+    for (auto& payload : payloads)
+    {
+      messages.push_back(std::make_shared<Message>(payload));
+    }
+
+    return messages;
+  }
+
+  std::vector<std::shared_ptr<Message>> MessageStore::range(Snowflake channel_id, std::chrono::system_clock::time_point begin, std::chrono::system_clock::time_point end) const
+  {
+    using namespace std::chrono;
+
+    auto begin_ms = duration_cast<milliseconds>(begin.time_since_epoch()).count();
+    auto end_ms = duration_cast<milliseconds>(end.time_since_epoch()).count();
+
+    //  Snowflakes encode their creation time, so a time span is just an id range.
+    auto after = static_cast<uint64_t>(Snowflake::from_timestamp(begin_ms));
+    auto before = static_cast<uint64_t>(Snowflake::from_timestamp(end_ms + 1));
+
+    return range(channel_id, after ? after - 1 : 0, before);
+  }
+
+  size_t MessageStore::count(Snowflake channel_id) const
+  {
+    auto log = get_log(channel_id);
+    std::lock_guard<std::mutex> lock(log->mutex);
+
+    return log->count();
+  }
+}
@@ -0,0 +1,295 @@
+#include "metrics.h"
+
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include <cpprest/http_listener.h>
+
+namespace Discord
+{
+  namespace Metrics
+  {
+    namespace
+    {
+      typedef std::pair<std::string, std::string> Key;
+
+      //  Covers sub-millisecond gateway stages up to slow REST calls.
+      const std::vector<double> DefaultBounds = { 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000 };
+
+      std::atomic<bool> Enabled(false);
+
+      //  Counters and histograms are never removed, so references handed out stay valid without the lock.
+      std::mutex RegistryMutex;
+      std::map<Key, std::unique_ptr<Counter>> Counters;
+      std::map<Key, std::unique_ptr<Histogram>> Histograms;
+      std::map<Key, std::function<double()>> Gauges;
+
+      std::string series(const std::string& name, const std::string& labels, const std::string& extra = "")
+      {
+        if (labels.empty() && extra.empty())
+        {
+          return name;
+        }
+
+        return name + "{" + labels + (labels.empty() || extra.empty() ? "" : ",") + extra + "}";
+      }
+
+      std::string format_number(double value)
+      {
+        std::ostringstream out;
+        out.precision(10);
+        out << value;
+        return out.str();
+      }
+
+      //  Writes each metric family once with its TYPE line, then every label set in that family.
+      template<typename Map, typename Write>
+      void write_family(std::ostringstream& out, const Map& metrics, const std::string& type, Write write)
+      {
+        std::string last;
+
+        for (auto& metric : metrics)
+        {
+          if (metric.first.first != last)
+          {
+            last = metric.first.first;
+            out << "# TYPE " << last << " " << type << "\n";
+          }
+
+          write(metric.first.first, metric.first.second, metric.second);
+        }
+      }
+
+      class Exporter
+      {
+        std::string m_path;
+        std::chrono::seconds m_interval;
+        std::thread m_thread;
+        std::mutex m_mutex;
+        std::condition_variable m_wakeup;
+        bool m_stopping;
+        std::unique_ptr<web::http::experimental::listener::http_listener> m_listener;
+
+        void run()
+        {
+          std::unique_lock<std::mutex> lock(m_mutex);
+
+          while (!m_stopping)
+          {
+            m_wakeup.wait_for(lock, m_interval, [this]() { return m_stopping; });
+
+            auto path = m_path;
+            lock.unlock();
+            write_prometheus(path);
+            lock.lock();
+          }
+        }
+
+        void stop_thread()
+        {
+          {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+          }
+
+          m_wakeup.notify_all();
+
+          if (m_thread.joinable())
+          {
+            m_thread.join();
+          }
+        }
+      public:
+        Exporter() : m_interval(15), m_stopping(false) {};
+
+        ~Exporter()
+        {
+          stop();
+        }
+
+        void start(std::string path, std::chrono::seconds interval)
+        {
+          stop_thread();
+
+          m_path = path;
+          m_interval = interval;
+          m_stopping = false;
+          m_thread = std::thread(&Exporter::run, this);
+        }
+
+        bool serve(uint16_t port)
+        {
+          using namespace web::http;
+          using namespace web::http::experimental::listener;
+
+          auto url = utility::conversions::to_string_t("http://127.0.0.1:" + std::to_string(port) + "/metrics");
+
+          try
+          {
+            std::unique_ptr<http_listener> listener(new http_listener(url));
+
+            listener->support(methods::GET, [](http_request request)
+            {
+              request.reply(status_codes::OK, utility::conversions::to_string_t(prometheus()), U("text/plain; version=0.0.4"));
+            });
+
+            listener->open().wait();
+            m_listener = std::move(listener);
+          }
+          catch (const std::exception& e)
+          {
+            LOG(ERROR) << "Could not serve metrics on port " << port << ": " << e.what();
+            return false;
+          }
+
+          LOG(INFO) << "Serving metrics on " << utility::conversions::to_utf8string(url);
+          return true;
+        }
+
+        void stop()
+        {
+          stop_thread();
+
+          if (m_listener)
+          {
+            m_listener->close().wait();
+            m_listener.reset();
+          }
+        }
+      };
+
+      //  Defined after the registry so it is destroyed first, while the metrics it writes still exist.
+      Exporter Export;
+    }
+
+    void set_enabled(bool enabled)
+    {
+      Enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    bool enabled()
+    {
+      return Enabled.load(std::memory_order_relaxed);
+    }
+
+    Counter& counter(const std::string& name, const std::string& labels)
+    {
+      std::lock_guard<std::mutex> lock(RegistryMutex);
+      auto& counter = Counters[Key(name, labels)];
+
+      if (!counter)
+      {
+        counter = std::make_unique<Counter>();
+      }
+
+      return *counter;
+    }
+
+    Histogram& histogram(const std::string& name, const std::string& labels)
+    {
+      std::lock_guard<std::mutex> lock(RegistryMutex);
+      auto& histogram = Histograms[Key(name, labels)];
+
+      if (!histogram)
+      {
+        histogram = std::make_unique<Histogram>(DefaultBounds);
+      }
+
+      return *histogram;
+    }
+
+    void gauge(const std::string& name, std::function<double()> read, const std::string& labels)
+    {
+      std::lock_guard<std::mutex> lock(RegistryMutex);
+      Gauges[Key(name, labels)] = read;
+    }
+
+    void remove_gauge(const std::string& name, const std::string& labels)
+    {
+      std::lock_guard<std::mutex> lock(RegistryMutex);
+      Gauges.erase(Key(name, labels));
+    }
+
+    std::string prometheus()
+    {
+      std::ostringstream out;
+      std::lock_guard<std::mutex> lock(RegistryMutex);
+
+      write_family(out, Counters, "counter", [&out](const std::string& name, const std::string& labels, const std::unique_ptr<Counter>& counter)
+      {
+        out << series(name, labels) << " " << counter->value() << "\n";
+      });
+
+      write_family(out, Gauges, "gauge", [&out](const std::string& name, const std::string& labels, const std::function<double()>& read)
+      {
+        out << series(name, labels) << " " << format_number(read()) << "\n";
+      });
+
+      write_family(out, Histograms, "histogram", [&out](const std::string& name, const std::string& labels, const std::unique_ptr<Histogram>& histogram)
+      {
+        auto bounds = histogram->bounds();
+        auto counts = histogram->counts();
+        uint64_t cumulative = 0;
+
+        for (size_t i = 0; i < bounds.size(); ++i)
+        {
+          cumulative += counts[i];
+          out << series(name + "_bucket", labels, "le=\"" + format_number(bounds[i]) + "\"") << " " << cumulative << "\n";
+        }
+
+        //  Built from the buckets rather than count(), so the +Inf bucket and the count always agree.
+        cumulative += counts.back();
+        out << series(name + "_bucket", labels, "le=\"+Inf\"") << " " << cumulative << "\n";
+        out << series(name + "_sum", labels) << " " << format_number(histogram->sum()) << "\n";
+        out << series(name + "_count", labels) << " " << cumulative << "\n";
+      });
+
+      return out.str();
+    }
+
+    bool write_prometheus(std::string path)
+    {
+      auto temporary = path + ".tmp";
+
+      {
+        std::ofstream file(temporary, std::ios::trunc);
+
+        if (!file.is_open())
+        {
+          LOG(ERROR) << "Could not open " << temporary << " to write metrics.";
+          return false;
+        }
+
+        file << prometheus();
+      }
+
+      //  Renaming over an existing file fails on some platforms, so fall back to removing it first.
+      if (std::rename(temporary.c_str(), path.c_str()) != 0 && (std::remove(path.c_str()), std::rename(temporary.c_str(), path.c_str())) != 0)
+      {
+        LOG(ERROR) << "Could not replace " << path << " with the new metrics.";
+        std::remove(temporary.c_str());
+        return false;
+      }
+
+      return true;
+    }
+
+    void start_export(std::string path, std::chrono::seconds interval)
+    {
+      Export.start(path, interval);
+    }
+
+    bool serve(uint16_t port)
+    {
+      return Export.serve(port);
+    }
+
+    void stop_export()
+    {
+      Export.stop();
+    }
+  }
+}
@@ -0,0 +1,192 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <thread>
+
+namespace Discord
+{
+  namespace Trace
+  {
+    namespace
+    {
+      //  Enough for a few minutes of sampled production traffic without growing without bound.
+      const size_t MaxSpans = 200000;
+
+      struct SpanRecord
+      {
+        std::string name;
+        const char* category;
+        uint64_t trace;
+        uint32_t thread;
+        int64_t start_us;
+        int64_t duration_us;
+      };
+
+      std::atomic<double> SampleRate(0);
+      std::atomic<uint64_t> NextTrace(1);
+
+      //  Chrome traces use microseconds, measured here from when the library was loaded.
+      const TimePoint Epoch = std::chrono::steady_clock::now();
+
+      std::mutex SpanMutex;
+      std::deque<SpanRecord> Spans;
+      std::map<std::thread::id, uint32_t> Threads;
+      uint64_t Dropped = 0;
+
+      thread_local uint64_t CurrentTrace = 0;
+
+      int64_t microseconds(TimePoint time)
+      {
+        return std::chrono::duration_cast<std::chrono::microseconds>(time - Epoch).count();
+      }
+
+      //  Chrome wants small integer thread ids, so number threads in the order they first record.
+      uint32_t thread_number()
+      {
+        auto id = std::this_thread::get_id();
+        auto thread = Threads.find(id);
+
+        if (thread == std::end(Threads))
+        {
+          thread = Threads.emplace(id, static_cast<uint32_t>(Threads.size() + 1)).first;
+        }
+
+        return thread->second;
+      }
+    }
+
+    void set_sample_rate(double rate)
+    {
+      SampleRate.store(std::min(std::max(rate, 0.0), 1.0), std::memory_order_relaxed);
+    }
+
+    double sample_rate()
+    {
+      return SampleRate.load(std::memory_order_relaxed);
+    }
+
+    uint64_t sample()
+    {
+      auto rate = SampleRate.load(std::memory_order_relaxed);
+
+      if (rate <= 0)
+      {
+        return 0;
+      }
+
+      thread_local std::minstd_rand rng(std::random_device{}());
+
+      if (rate < 1 && std::uniform_real_distribution<double>(0, 1)(rng) >= rate)
+      {
+        return 0;
+      }
+
+      return NextTrace.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t current()
+    {
+      return CurrentTrace;
+    }
+
+    void record(const std::string& name, const char* category, TimePoint start, TimePoint end, uint64_t trace)
+    {
+      if (trace == 0)
+      {
+        return;
+      }
+
+      std::lock_guard<std::mutex> lock(SpanMutex);
+
+      if (Spans.size() >= MaxSpans)
+      {
+        Spans.pop_front();
+        Dropped++;
+      }
+
+      Spans.push_back({ name, category, trace, thread_number(), microseconds(start), microseconds(end) - microseconds(start) });
+    }
+
+    Scope::Scope(uint64_t trace)
+    {
+      m_previous = CurrentTrace;
+      CurrentTrace = trace;
+    }
+
+    Scope::~Scope()
+    {
+      CurrentTrace = m_previous;
+    }
+
+    Span::Span(std::string name, const char* category) : m_category(category), m_trace(CurrentTrace)
+    {
+      if (m_trace)
+      {
+        m_name = name;
+        m_start = std::chrono::steady_clock::now();
+      }
+    }
+
+    Span::~Span()
+    {
+      if (m_trace)
+      {
+        record(m_name, m_category, m_start, std::chrono::steady_clock::now(), m_trace);
+      }
+    }
+
+    std::string chrome_trace()
+    {
+      auto events = nlohmann::json::array();
+      std::lock_guard<std::mutex> lock(SpanMutex);
+
+      for (auto& span : Spans)
+      {
+        events.push_back({
+          { "name", span.name },
+          { "cat", span.category },
+          { "ph", "X" },
+          { "ts", span.start_us },
+          { "dur", span.duration_us },
+          { "pid", 1 },
+          { "tid", span.thread },
+          { "args", { { "trace", span.trace } } }
+        });
+      }
+
+      nlohmann::json trace = {
+        { "traceEvents", events },
+        { "displayTimeUnit", "ms" },
+        { "otherData", { { "dropped_spans", Dropped } } }
+      };
+
+      return trace.dump();
+    }
+
+    bool write_chrome_trace(std::string path)
+    {
+      std::ofstream file(path, std::ios::trunc);
+
+      if (!file.is_open())
+      {
+        LOG(ERROR) << "Could not open " << path << " to write the trace.";
+        return false;
+      }
+
+      file << chrome_trace();
+      return true;
+    }
+
+    void clear()
+    {
+      std::lock_guard<std::mutex> lock(SpanMutex);
+      Spans.clear();
+      Dropped = 0;
+    }
+  }
+}
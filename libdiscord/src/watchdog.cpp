@@ -0,0 +1,171 @@
+#include "watchdog.h"
+
+#include "api_exceptions.h"
+#include "metrics.h"
+
+#include <algorithm>
+
+namespace Discord
+{
+  namespace
+  {
+    std::string describe(const std::string& name, Snowflake guild_id)
+    {
+      if (guild_id == Snowflake())
+      {
+        return "Handler \"" + name + "\" in a direct message";
+      }
+
+      return "Handler \"" + name + "\" in guild " + guild_id.to_string();
+    }
+
+    int64_t elapsed_ms(std::chrono::steady_clock::time_point start)
+    {
+      return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+  }
+
+  HandlerWatchdog::HandlerWatchdog(std::chrono::milliseconds budget, bool cancel)
+  {
+    m_budget = budget;
+    m_cancel = cancel;
+    m_next_id = 1;
+    m_stop = false;
+    m_thread = std::thread(&HandlerWatchdog::watch, this);
+  }
+
+  HandlerWatchdog::~HandlerWatchdog()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+
+    m_wake.notify_all();
+    m_thread.join();
+  }
+
+  std::chrono::milliseconds HandlerWatchdog::budget() const
+  {
+    return m_budget;
+  }
+
+  bool HandlerWatchdog::cancels() const
+  {
+    return m_cancel;
+  }
+
+  size_t HandlerWatchdog::running() const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_running.size();
+  }
+
+  uint64_t HandlerWatchdog::start(std::string name, Snowflake guild_id, CancellationToken token)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto id = m_next_id++;
+    m_running[id] = { name, guild_id, std::chrono::steady_clock::now(), token, false };
+
+    return id;
+  }
+
+  void HandlerWatchdog::finish(uint64_t id)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto running = m_running.find(id);
+
+    if (running == std::end(m_running))
+    {
+      return;
+    }
+
+    auto handler = running->second;
+    m_running.erase(running);
+    lock.unlock();
+
+    if (handler.flagged)
+    {
+      LOG(WARNING) << describe(handler.name, handler.guild_id) << " finished after " << elapsed_ms(handler.start) << "ms.";
+    }
+  }
+
+  void HandlerWatchdog::watch()
+  {
+    //  Check a few times per budget, but not so often that short budgets busy the thread.
+    auto interval = std::min(std::max(m_budget / 4, std::chrono::milliseconds(10)), std::chrono::milliseconds(1000));
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (!m_stop)
+    {
+      m_wake.wait_for(lock, interval);
+
+      auto now = std::chrono::steady_clock::now();
+
+      for (auto& running : m_running)
+      {
+        auto& handler = running.second;
+
+        if (handler.flagged || now - handler.start < m_budget)
+        {
+          continue;
+        }
+
+        handler.flagged = true;
+
+        auto cancel = m_cancel && handler.token.can_cancel();
+
+        LOG(WARNING) << describe(handler.name, handler.guild_id) << " has run for " << elapsed_ms(handler.start)
+                     << "ms, over its budget of " << m_budget.count() << "ms." << (cancel ? " Cancelling it." : "");
+
+        if (Metrics::enabled())
+        {
+          Metrics::counter("discord_handler_slow_total", "handler=\"" + handler.name + "\"").increment();
+        }
+
+        if (cancel)
+        {
+          handler.token.cancel();
+        }
+      }
+    }
+  }
+
+  void HandlerWatchdog::run(const std::shared_ptr<HandlerWatchdog>& watchdog, const std::string& name, Snowflake guild_id, const CancellationToken& token, const std::function<void()>& handler)
+  {
+    CancellationScope scope(token);
+
+    auto id = watchdog ? watchdog->start(name, guild_id, token) : 0;
+    auto start = std::chrono::steady_clock::now();
+
+    auto finish = [&]()
+    {
+      if (watchdog)
+      {
+        watchdog->finish(id);
+      }
+
+      if (Metrics::enabled())
+      {
+        Metrics::histogram("discord_handler_ms", "handler=\"" + name + "\"").observe(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+      }
+    };
+
+    try
+    {
+      handler();
+    }
+    catch (const CancelledException&)
+    {
+      LOG(WARNING) << describe(name, guild_id) << " stopped after being cancelled.";
+    }
+    catch (...)
+    {
+      finish();
+      throw;
+    }
+
+    finish();
+  }
+}
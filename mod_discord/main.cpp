@@ -5,6 +5,8 @@
 #include "external/easylogging++.h"
 #include "external/getRSS.h"
 
+#include <algorithm>
+#include <functional>
 #include <iostream>
 #include <memory>
 
@@ -140,10 +142,54 @@ int main(int argc, char* argv[])
   });
 
 
-  bot->add_command("mem", [](Discord::MessageEvent event) {
+  bot->add_command("mem", [bot](Discord::MessageEvent event) {
     auto current_mb = std::round(RSS::current() / 1000.0) / 1000.0;
     auto peak_mb = std::round(RSS::peak() / 1000.0) / 1000.0;
-    event.respond("```Current memory usage: " + std::to_string(current_mb) + "MB\nPeak memory usage:    " + std::to_string(peak_mb) + "MB```");
+    auto kb = [](size_t bytes) { return std::to_string(bytes / 1000) + "KB"; };
+
+    //  Each guild keeps its own approximate figures, so this doesn't walk any members.
+    Discord::GuildMemory total;
+    std::vector<std::pair<size_t, std::string>> largest;
+
+    for (auto& guild : bot->guilds())
+    {
+      auto memory = guild->memory();
+      total += memory;
+      largest.emplace_back(memory.bytes(), guild->name());
+    }
+
+    std::sort(std::begin(largest), std::end(largest), std::greater<std::pair<size_t, std::string>>());
+    largest.resize(std::min<size_t>(largest.size(), 5));
+
+    std::vector<std::pair<std::string, Discord::CacheUsage>> caches = {
+      { "Guilds:      ", total.guilds },
+      { "Channels:    ", total.channels },
+      { "Members:     ", total.members },
+      { "Users:       ", total.users },
+      { "Presences:   ", total.presences },
+      { "Roles:       ", total.roles },
+      { "Emojis:      ", total.emojis },
+      { "Voice states:", total.voice_states }
+    };
+
+    std::string response = "```Current memory usage: " + std::to_string(current_mb) + "MB\nPeak memory usage:    " + std::to_string(peak_mb) + "MB\n\n";
+    response += "Cached (approximate): " + kb(total.bytes()) + "\n";
+
+    for (auto& cache : caches)
+    {
+      response += cache.first + " " + std::to_string(cache.second.count) + " using " + kb(cache.second.bytes) + "\n";
+    }
+
+    response += "\nLargest guilds:\n";
+
+    for (auto& guild : largest)
+    {
+      response += guild.second + ": " + kb(guild.first) + "\n";
+    }
+
+    response += "```";
+
+    event.respond(response);
   });
 
   bot->add_command("layout", [](Discord::MessageEvent event)
@@ -210,7 +256,7 @@ int main(int argc, char* argv[])
           << "guilds: A list of guilds this bot is currently in.\n"
           << "new   : Create a new channel.\n"
           << "rem   : Remove a channel.\n"
-          << "mem   : Get current a peak memory of this bot process.\n"
+          << "mem   : Get current and peak memory of this bot process, and what the caches use.\n"
           << "layout: Test if user, channel, and guild information can be retrieved correctly.\n"
           << "```";
 